@@ -0,0 +1,785 @@
+#include "aot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+using namespace std;
+
+namespace aot {
+
+    namespace {
+        // Sources a translated program links against, relative to the runtime directory
+        const char* const RUNTIME_SOURCES[] = {
+            "runtime.cpp", "call_stack.cpp", "cycle_collector.cpp", "arena.cpp", "bignum.cpp", "symbol.cpp",
+        };
+
+        // C++ literal of the string. Octal escapes always take three digits, so a digit
+        // that follows one is not read as part of it.
+        string QuoteString(const string& value) {
+            string result = "\""s;
+
+            for (unsigned char c : value) {
+                if (c == '"' || c == '\\') {
+                    result += '\\';
+                    result += static_cast<char>(c);
+                } else if (c < 0x20 || c >= 0x7F) {
+                    char escape[5];
+                    snprintf(escape, sizeof(escape), "\\%03o", c);
+                    result += escape;
+                } else {
+                    result += static_cast<char>(c);
+                }
+            }
+
+            return result + '"';
+        }
+
+        string QuoteShellArgument(const string& value) {
+            string result = "'"s;
+
+            for (char c : value) {
+                if (c == '\'') {
+                    result += "'\\''"s;
+                } else {
+                    result += c;
+                }
+            }
+
+            return result + '\'';
+        }
+
+        // Lines of a function body with their indentation levels
+        class Code {
+        public:
+            void Line(string text) {
+                lines_.push_back({ indent_, std::move(text) });
+            }
+
+            void Open(string text) {
+                Line(std::move(text) + " {"s);
+                ++indent_;
+            }
+
+            void Close(string text = "}"s) {
+                --indent_;
+                Line(std::move(text));
+            }
+
+            void Else() {
+                --indent_;
+                Line("} else {"s);
+                ++indent_;
+            }
+
+            size_t GetSize() const {
+                return lines_.size();
+            }
+
+            // Puts the lines from `start` on into a block of their own
+            void WrapInBlock(size_t start) {
+                for (size_t i = start; i < lines_.size(); ++i) {
+                    ++lines_[i].first;
+                }
+                lines_.insert(lines_.begin() + start, { indent_, "{"s });
+                Line("}"s);
+            }
+
+            void Write(ostream& out, int base_indent) const {
+                for (const auto& [indent, text] : lines_) {
+                    out << string((base_indent + indent) * 4, ' ') << text << '\n';
+                }
+            }
+
+        private:
+            vector<pair<int, string>> lines_;
+            int indent_ = 0;
+        };
+
+        class Translator;
+
+        // Translates a method body or the top-level code into one C++ function. Values
+        // go to temporaries declared where they are computed; statements that declare
+        // any get a block of their own, so the values die with their statement as they
+        // do on the tree walker. Variables are C++ locals: frame slots in a method,
+        // the globals in the top-level code.
+        class FunctionTranslator : public ast::Visitor {
+        public:
+            // Method with the given number of frame slots, of which the first
+            // `argument_count` hold self and the arguments on entry
+            FunctionTranslator(Translator& unit, size_t frame_size, size_t argument_count)
+                : unit_(unit)
+                , in_method_(true)
+                , bound_(frame_size, false) {
+                for (size_t i = 0; i < frame_size; ++i) {
+                    variables_.push_back("l"s + to_string(i));
+                }
+                fill(bound_.begin(), bound_.begin() + argument_count, true);
+            }
+
+            // Top-level code
+            explicit FunctionTranslator(Translator& unit)
+                : unit_(unit)
+                , in_method_(false) {
+            }
+
+            // Writes the function, declaring its variables in front of the body
+            void Write(ostream& out, const string& signature, size_t argument_count) {
+                out << "    "sv << signature << " {\n"sv;
+
+                for (size_t i = 0; i < variables_.size(); ++i) {
+                    out << "        runtime::ObjectHolder "sv << variables_[i]
+                        << (i < argument_count ? " = std::move(args["s + to_string(i) + "]);"s
+                                               : " = aot::Unbound();"s)
+                        << '\n';
+                }
+
+                code_.Write(out, 2);
+                out << "        return runtime::ObjectHolder();\n"sv;
+                out << "    }\n"sv;
+            }
+
+            // Translates the whole body of the function
+            void TranslateBody(ast::Statement& body) {
+                discard_value_ = true;
+                body.Accept(*this);
+            }
+
+            // Translates a statement of a compound; its value is not used
+            void TranslateStatement(ast::Statement& statement) {
+                const size_t start = code_.GetSize();
+                const size_t temps = temp_count_;
+
+                const bool discard_value = std::exchange(discard_value_, true);
+                statement.Accept(*this);
+                discard_value_ = discard_value;
+
+                if (temp_count_ != temps) {
+                    code_.WrapInBlock(start);
+                }
+            }
+
+            void Visit(ast::NumericConst& node) override {
+                SetConstant("runtime::MakeNumber("s + to_string(node.GetValue().GetValue()) + ")"s);
+            }
+
+            void Visit(ast::BigNumericConst& node) override;
+            void Visit(ast::StringConst& node) override;
+
+            void Visit(ast::BoolConst& node) override {
+                SetConstant(node.GetValue().GetValue() ? "runtime::MakeBool(true)"s : "runtime::MakeBool(false)"s);
+            }
+
+            void Visit(ast::None& /* node */) override {
+                SetConstant("runtime::ObjectHolder()"s);
+            }
+
+            void Visit(ast::VariableValue& node) override;
+
+            void Visit(ast::Assignment& node) override {
+                Translate(node.GetValue());
+                const string value = TakeValue();
+
+                const size_t variable = node.GetLocalSlot() != runtime::NO_LOCAL_SLOT ? CheckLocal(node.GetLocalSlot())
+                                                                                      : GetGlobal(node.GetName());
+                code_.Line(variables_[variable] + " = "s + value + ";"s);
+                bound_[variable] = true;
+
+                SetVariable(variables_[variable]);
+            }
+
+            void Visit(ast::FieldAssignment& node) override;
+
+            void Visit(ast::NewInstance& node) override;
+
+            void Visit(ast::MethodCall& node) override;
+
+            void Visit(ast::Compound& node) override {
+                const bool discard_value = discard_value_;
+
+                for (const auto& statement : node.GetStatements()) {
+                    TranslateStatement(*statement);
+
+                    // The statements after a return are never reached
+                    if (dynamic_cast<ast::Return*>(statement.get()) != nullptr) {
+                        break;
+                    }
+                    code_.Line("runtime::CycleCollector::Safepoint();"s);
+                }
+
+                if (!discard_value) {
+                    SetConstant("runtime::ObjectHolder()"s);
+                }
+            }
+
+            void Visit(ast::Return& node) override {
+                Translate(node.GetValue());
+                // A temporary is moved by the return itself
+                code_.Line("return "s + result_ + ";"s);
+
+                // Nothing after a return is reached with unassigned variables
+                fill(bound_.begin(), bound_.end(), true);
+                SetConstant("runtime::ObjectHolder()"s);
+            }
+
+            void Visit(ast::MethodBody& /* node */) override {
+                throw runtime_error("a method body can only be translated as a method"s);
+            }
+
+            void Visit(ast::ClassDefinition& node) override;
+
+            void Visit(ast::Print& node) override {
+                const auto& args = node.GetArgs();
+
+                // The value of the statement is the last argument
+                for (size_t i = 0; i < args.size(); ++i) {
+                    if (i != 0) {
+                        code_.Line("context.GetOutputStream() << ' ';"s);
+                    }
+                    Translate(*args[i]);
+                    code_.Line("aot::Print("s + result_ + ", context);"s);
+                }
+
+                code_.Line("context.GetOutputStream() << '\\n';"s);
+
+                if (args.empty()) {
+                    SetConstant("runtime::ObjectHolder()"s);
+                }
+            }
+
+            void Visit(ast::Stringify& node) override {
+                if (node.GetArgument() == nullptr) {
+                    throw runtime_error("null operands are not supported"s);
+                }
+
+                Translate(*node.GetArgument());
+                SetTemp("runtime::Stringify("s + result_ + ")"s);
+            }
+
+            void Visit(ast::Add& node) override {
+                TranslateBinary(node, "aot::Add"s);
+            }
+
+            void Visit(ast::Sub& node) override {
+                TranslateBinary(node, "aot::Sub"s);
+            }
+
+            void Visit(ast::Mult& node) override {
+                TranslateBinary(node, "aot::Mult"s);
+            }
+
+            void Visit(ast::Div& node) override {
+                TranslateBinary(node, "aot::Div"s);
+            }
+
+            void Visit(ast::Or& node) override {
+                TranslateShortCircuit(node, true);
+            }
+
+            void Visit(ast::And& node) override {
+                TranslateShortCircuit(node, false);
+            }
+
+            void Visit(ast::Not& node) override {
+                if (node.GetArgument() == nullptr) {
+                    throw runtime_error("null operands are not supported"s);
+                }
+
+                Translate(*node.GetArgument());
+                SetTemp("runtime::MakeBool(!runtime::IsTrue("s + result_ + "))"s);
+            }
+
+            void VisitComparison(ast::BinaryOperation& node, runtime::CompareOp op) override {
+                SetTemp("runtime::MakeBool("s + TranslateComparison(node, op) + ")"s);
+            }
+
+            void Visit(ast::IfElse& node) override {
+                const bool discard_value = discard_value_;
+                string result;
+
+                if (!discard_value) {
+                    result = NewTemp();
+                    code_.Line("runtime::ObjectHolder "s + result + ";"s);
+                }
+
+                code_.Open("if ("s + TranslateCondition(node.GetCondition()) + ")"s);
+                const vector<bool> bound_before = bound_;
+
+                TranslateBranch(node.GetIfBody(), result);
+                vector<bool> bound_after_if = std::move(bound_);
+                bound_ = bound_before;
+
+                if (node.GetElseBody() != nullptr) {
+                    code_.Else();
+                    TranslateBranch(*node.GetElseBody(), result);
+                }
+                code_.Close();
+
+                // A variable is assigned after the statement only if both branches assign it
+                for (size_t i = 0; i < bound_.size(); ++i) {
+                    bound_[i] = bound_[i] && (i >= bound_after_if.size() || bound_after_if[i]);
+                }
+
+                if (discard_value) {
+                    SetConstant("runtime::ObjectHolder()"s);
+                } else {
+                    SetTemp(result, false);
+                }
+            }
+
+        private:
+            enum class ValueKind {
+                // A side-effect free expression, like a constant
+                Constant,
+                // A variable of the program, which must be copied
+                Variable,
+                // A temporary whose value can be moved
+                Temp,
+            };
+
+            void Translate(ast::Statement& statement) {
+                const bool discard_value = std::exchange(discard_value_, false);
+                statement.Accept(*this);
+                discard_value_ = discard_value;
+            }
+
+            string NewTemp() {
+                return "t"s + to_string(temp_count_++);
+            }
+
+            void SetConstant(string expression) {
+                result_ = std::move(expression);
+                result_kind_ = ValueKind::Constant;
+            }
+
+            void SetVariable(string name) {
+                result_ = std::move(name);
+                result_kind_ = ValueKind::Variable;
+            }
+
+            // Stores the value of the expression in a new temporary, or makes an already
+            // declared one the result
+            void SetTemp(string expression, bool declare = true) {
+                if (declare) {
+                    const string temp = NewTemp();
+                    code_.Line("runtime::ObjectHolder "s + temp + " = "s + expression + ";"s);
+                    expression = temp;
+                }
+                result_ = std::move(expression);
+                result_kind_ = ValueKind::Temp;
+            }
+
+            // Expression passing the result on, moved if it is a temporary
+            string TakeValue() const {
+                return result_kind_ == ValueKind::Temp ? "std::move("s + result_ + ")"s : result_;
+            }
+
+            size_t CheckLocal(size_t slot) const {
+                if (!in_method_ || slot >= variables_.size()) {
+                    throw runtime_error("local variable outside of a method frame"s);
+                }
+                return slot;
+            }
+
+            // Variable of a global of the top-level code, declared on first use
+            size_t GetGlobal(runtime::Symbol name) {
+                if (in_method_) {
+                    throw runtime_error("method bodies can't refer to global variables"s);
+                }
+
+                auto [it, inserted] = globals_.emplace(name, variables_.size());
+
+                if (inserted) {
+                    variables_.push_back("g_"s + name.GetName());
+                    bound_.push_back(false);
+                }
+
+                return it->second;
+            }
+
+            // Reads the variable, checking that it is assigned unless that's known
+            string ReadVariable(size_t variable) {
+                if (bound_[variable]) {
+                    return variables_[variable];
+                }
+
+                bound_[variable] = true;
+                return "aot::CheckBound("s + variables_[variable] + ")"s;
+            }
+
+            void TranslateBranch(ast::Statement& body, const string& result) {
+                if (result.empty()) {
+                    TranslateStatement(body);
+                } else {
+                    Translate(body);
+                    code_.Line(result + " = "s + TakeValue() + ";"s);
+                }
+            }
+
+            pair<string, string> TranslateOperands(ast::BinaryOperation& node) {
+                if (node.GetLhs() == nullptr || node.GetRhs() == nullptr) {
+                    throw runtime_error("null operands are not supported"s);
+                }
+
+                Translate(*node.GetLhs());
+                string lhs = result_;
+                Translate(*node.GetRhs());
+                return { std::move(lhs), result_ };
+            }
+
+            void TranslateBinary(ast::BinaryOperation& node, const string& function) {
+                const auto [lhs, rhs] = TranslateOperands(node);
+                SetTemp(function + "("s + lhs + ", "s + rhs + ", context)"s);
+            }
+
+            string TranslateComparison(ast::BinaryOperation& node, runtime::CompareOp op) {
+                static const char* const OPS[] = {
+                    "Equal", "NotEqual", "Less", "Greater", "LessOrEqual", "GreaterOrEqual",
+                };
+
+                const auto [lhs, rhs] = TranslateOperands(node);
+                return "aot::Compare<runtime::CompareOp::"s + OPS[static_cast<size_t>(op)] + ">("s + lhs + ", "s + rhs
+                     + ", context)"s;
+            }
+
+            // Comparisons are tested on their operands without materializing a Bool
+            string TranslateCondition(ast::Statement& condition) {
+                if (auto op = ast::GetCompareOp(condition)) {
+                    return TranslateComparison(static_cast<ast::BinaryOperation&>(condition), *op);
+                }
+
+                Translate(condition);
+                return "runtime::IsTrue("s + result_ + ")"s;
+            }
+
+            // lhs or rhs: the rhs is evaluated in a block of its own only when the lhs
+            // doesn't decide the result
+            void TranslateShortCircuit(ast::BinaryOperation& node, bool is_or) {
+                if (node.GetLhs() == nullptr || node.GetRhs() == nullptr) {
+                    throw runtime_error("null operands are not supported"s);
+                }
+
+                Translate(*node.GetLhs());
+                const string value = "b"s + to_string(temp_count_++);
+                code_.Line("bool "s + value + " = runtime::IsTrue("s + result_ + ");"s);
+
+                const vector<bool> bound_before = bound_;
+                code_.Open(is_or ? "if (!"s + value + ")"s : "if ("s + value + ")"s);
+                Translate(*node.GetRhs());
+                code_.Line(value + " = runtime::IsTrue("s + result_ + ");"s);
+                code_.Close();
+                bound_ = bound_before;
+
+                SetTemp("runtime::MakeBool("s + value + ")"s);
+            }
+
+            // Evaluates the arguments into args[1] and on
+            void TranslateArguments(const string& args, const vector<unique_ptr<ast::Statement>>& arguments) {
+                for (size_t i = 0; i < arguments.size(); ++i) {
+                    Translate(*arguments[i]);
+                    code_.Line(args + "["s + to_string(i + 1) + "] = "s + TakeValue() + ";"s);
+                }
+            }
+
+            Translator& unit_;
+            const bool in_method_;
+            Code code_;
+
+            vector<string> variables_;
+            // Variables known to be assigned at the current point of the code
+            vector<bool> bound_;
+            unordered_map<runtime::Symbol, size_t> globals_;
+
+            size_t temp_count_ = 0;
+            bool discard_value_ = false;
+            string result_;
+            ValueKind result_kind_ = ValueKind::Constant;
+        };
+
+        // Collects the parts of the translation unit. Classes are translated when the
+        // code first refers to them, their parents and methods first.
+        class Translator {
+        public:
+            string Translate(ast::Statement& program) {
+                FunctionTranslator main(*this);
+                main.TranslateBody(program);
+
+                ostringstream out;
+                out << "// Translated from Mython by aot::Translate\n"sv;
+                out << "#include \"aot_runtime.h\"\n\n"sv;
+                out << "#include <iostream>\n"sv;
+                out << "#include <string>\n\n"sv;
+                out << "namespace {\n\n"sv;
+                out << declarations_.str() << '\n';
+                out << sites_.str() << '\n';
+                out << definitions_.str();
+                main.Write(out, "runtime::ObjectHolder RunProgram([[maybe_unused]] runtime::Context& context)"s, 0);
+                out << "\n} // namespace\n\n"sv;
+                out << "int main() {\n"sv;
+                out << "    return aot::RunMain(RunProgram, std::cout, std::cerr);\n"sv;
+                out << "}\n"sv;
+
+                return out.str();
+            }
+
+            // Function returning the class
+            const string& GetClass(const runtime::Class& cls) {
+                auto it = classes_.find(&cls);
+
+                if (it != classes_.end()) {
+                    return it->second;
+                }
+
+                const string name = "class_"s + to_string(classes_.size());
+                classes_.emplace(&cls, name);
+                declarations_ << "    runtime::Class& "sv << name << "();\n"sv;
+
+                string parent = "nullptr"s;
+                if (cls.GetParent() != nullptr) {
+                    parent = "&"s + GetClass(*cls.GetParent()) + "()"s;
+                }
+
+                // Every method is declared before any body refers to it
+                for (const auto& method : cls.GetMethods()) {
+                    const string function = "method_"s + to_string(methods_.size());
+                    methods_.emplace(&method, function);
+                    declarations_ << "    runtime::ObjectHolder "sv << function
+                                  << "(runtime::ObjectHolder* args, runtime::Context& context);\n"sv;
+                }
+
+                for (const auto& method : cls.GetMethods()) {
+                    TranslateMethod(cls, method);
+                }
+
+                definitions_ << "    // class "sv << cls.GetName() << '\n';
+                definitions_ << "    runtime::Class& "sv << name << "() {\n"sv;
+                definitions_ << "        static runtime::Class cls = [] {\n"sv;
+                definitions_ << "            std::vector<runtime::Method> methods;\n"sv;
+
+                for (const auto& method : cls.GetMethods()) {
+                    definitions_ << "            methods.push_back(aot::MakeMethod("sv << QuoteString(method.name)
+                                 << ", {"sv;
+                    for (size_t i = 0; i < method.formal_params.size(); ++i) {
+                        definitions_ << (i == 0 ? " "sv : ", "sv) << QuoteString(method.formal_params[i].GetName());
+                    }
+                    definitions_ << (method.formal_params.empty() ? "}, "sv : " }, "sv) << method.frame_size << ", "sv
+                                 << method.self_field_count << ", "sv << methods_.at(&method) << "));\n"sv;
+                }
+
+                definitions_ << "            return runtime::Class("sv << QuoteString(cls.GetName())
+                             << ", std::move(methods), "sv << parent << ");\n"sv;
+                definitions_ << "        }();\n"sv;
+                definitions_ << "        return cls;\n"sv;
+                definitions_ << "    }\n\n"sv;
+
+                return classes_.at(&cls);
+            }
+
+            // Function of a method of a translated class
+            const string& GetMethod(const runtime::Method& method) const {
+                return methods_.at(&method);
+            }
+
+            string AddString(const string& value) {
+                const string name = "string_"s + to_string(site_count_++);
+                sites_ << "    runtime::String "sv << name << "{ std::string("sv << QuoteString(value) << ", "sv
+                       << value.size() << ") };\n"sv;
+                return name;
+            }
+
+            string AddBigNumber(const runtime::BigInt& value) {
+                const string name = "big_number_"s + to_string(site_count_++);
+                sites_ << "    runtime::BigNumber "sv << name << "{ runtime::BigInt(\""sv << value << "\") };\n"sv;
+                return name;
+            }
+
+            // Every field access gets its own cache, like the tree nodes
+            string AddFieldSite(runtime::Symbol field) {
+                const string name = "field_site_"s + to_string(site_count_++);
+                sites_ << "    aot::FieldSite "sv << name << "{ "sv << QuoteString(field.GetName()) << " };\n"sv;
+                return name;
+            }
+
+            string AddCallSite(runtime::Symbol method, size_t argument_count) {
+                const string name = "call_site_"s + to_string(site_count_++);
+                sites_ << "    aot::CallSite "sv << name << "{ "sv << QuoteString(method.GetName()) << ", "sv
+                       << argument_count << " };\n"sv;
+                return name;
+            }
+
+        private:
+            void TranslateMethod(const runtime::Class& cls, const runtime::Method& method) {
+                auto* body = dynamic_cast<ast::MethodBody*>(method.body.get());
+
+                if (method.frame_size == 0 || body == nullptr) {
+                    throw runtime_error("method "s + cls.GetName() + "."s + method.name
+                                        + " has no frame slots and can't be translated"s);
+                }
+
+                const size_t argument_count = method.formal_params.size() + 1;
+                FunctionTranslator function(*this, method.frame_size, argument_count);
+                function.TranslateBody(body->GetBody());
+
+                ostringstream out;
+                out << "    // "sv << cls.GetName() << "."sv << method.name << '\n';
+                function.Write(out,
+                               "runtime::ObjectHolder "s + methods_.at(&method)
+                                   + "(runtime::ObjectHolder* args, [[maybe_unused]] runtime::Context& context)"s,
+                               argument_count);
+                definitions_ << out.str() << '\n';
+            }
+
+            ostringstream declarations_;
+            ostringstream sites_;
+            ostringstream definitions_;
+
+            unordered_map<const runtime::Class*, string> classes_;
+            unordered_map<const runtime::Method*, string> methods_;
+            size_t site_count_ = 0;
+        };
+
+        void FunctionTranslator::Visit(ast::BigNumericConst& node) {
+            SetConstant("runtime::ObjectHolder::Share("s + unit_.AddBigNumber(node.GetValue().GetValue()) + ")"s);
+        }
+
+        void FunctionTranslator::Visit(ast::StringConst& node) {
+            SetConstant("runtime::ObjectHolder::Share("s + unit_.AddString(node.GetValue().GetValue()) + ")"s);
+        }
+
+        void FunctionTranslator::Visit(ast::VariableValue& node) {
+            const auto& ids = node.GetDottedIds();
+            const size_t variable = node.GetLocalSlot() != runtime::NO_LOCAL_SLOT ? CheckLocal(node.GetLocalSlot())
+                                                                                  : GetGlobal(ids.front());
+            SetVariable(ReadVariable(variable));
+
+            for (size_t i = 1; i < ids.size(); ++i) {
+                SetTemp("aot::LoadField("s + result_ + ", "s + unit_.AddFieldSite(ids[i]) + ")"s);
+            }
+        }
+
+        void FunctionTranslator::Visit(ast::FieldAssignment& node) {
+            const bool discard_value = discard_value_;
+
+            Translate(node.GetObject());
+            const string instance = "i"s + to_string(temp_count_++);
+            code_.Line("runtime::ClassInstance& "s + instance + " = aot::AsInstance("s + result_ + ");"s);
+
+            Translate(node.GetValue());
+            const string site = unit_.AddFieldSite(node.GetFieldName());
+
+            if (discard_value) {
+                code_.Line("aot::StoreField("s + instance + ", "s + site + ", "s + TakeValue() + ");"s);
+                SetConstant("runtime::ObjectHolder()"s);
+            } else {
+                SetTemp(result_);
+                code_.Line("aot::StoreField("s + instance + ", "s + site + ", "s + result_ + ");"s);
+            }
+        }
+
+        void FunctionTranslator::Visit(ast::NewInstance& node) {
+            const auto& arguments = node.GetArgs();
+            const string& cls = unit_.GetClass(node.GetClass());
+            SetTemp("aot::NewInstance("s + cls + "())"s);
+            const string instance = result_;
+
+            // Arguments are evaluated even when there is no __init__ taking them
+            const runtime::Method* init = node.GetClass().GetSpecialMethod(runtime::SpecialMethod::Init);
+
+            if (init == nullptr || init->formal_params.size() != arguments.size()) {
+                for (const auto& argument : arguments) {
+                    Translate(*argument);
+                }
+                SetTemp(instance, false);
+                return;
+            }
+
+            const string args = "a"s + to_string(temp_count_++);
+            code_.Line("runtime::ObjectHolder "s + args + "["s + to_string(arguments.size() + 1) + "];"s);
+            code_.Line(args + "[0] = "s + instance + ";"s);
+            TranslateArguments(args, arguments);
+
+            // The __init__ of the class is known, so it is called directly
+            code_.Line(unit_.GetMethod(*init) + "("s + args + ", context);"s);
+            SetTemp(instance, false);
+        }
+
+        void FunctionTranslator::Visit(ast::MethodCall& node) {
+            const auto& arguments = node.GetArgs();
+            const string site = unit_.AddCallSite(node.GetMethodName(), arguments.size());
+
+            Translate(node.GetObject());
+            const string object = TakeValue();
+
+            const string args = "a"s + to_string(temp_count_++);
+            code_.Line("runtime::ObjectHolder "s + args + "["s + to_string(arguments.size() + 1) + "];"s);
+            code_.Line(args + "[0] = "s + object + ";"s);
+
+            // A bad receiver is reported before the arguments are evaluated
+            const string entry = "e"s + to_string(temp_count_++);
+            code_.Line("const aot::CallSite::Entry "s + entry + " = "s + site + ".Find("s + args + "[0]);"s);
+            TranslateArguments(args, arguments);
+
+            SetTemp("aot::Invoke("s + entry + ", "s + args + ", context)"s);
+        }
+
+        void FunctionTranslator::Visit(ast::ClassDefinition& node) {
+            auto* cls = node.GetClass().TryAs<runtime::Class>();
+            const string& function = unit_.GetClass(*cls);
+
+            const size_t variable = GetGlobal(node.GetName());
+            code_.Line(variables_[variable] + " = runtime::ObjectHolder::Share("s + function + "());"s);
+            bound_[variable] = true;
+
+            SetConstant("runtime::ObjectHolder()"s);
+        }
+    } // namespace
+
+    string Translate(runtime::Executable& program) {
+        auto* statement = dynamic_cast<ast::Statement*>(&program);
+
+        if (statement == nullptr) {
+            throw runtime_error("only syntax trees can be translated"s);
+        }
+
+        return Translator().Translate(*statement);
+    }
+
+    void Build(const string& translation_unit, const string& output, BuildOptions options) {
+        if (options.compiler.empty()) {
+            const char* compiler = getenv("CXX");
+            options.compiler = compiler != nullptr ? compiler : "c++"s;
+        }
+        if (options.runtime_dir.empty()) {
+            const char* runtime_dir = getenv("MYTHON_RUNTIME_DIR");
+            options.runtime_dir = runtime_dir != nullptr ? runtime_dir : ".."s;
+        }
+
+        const string source = output + ".cpp"s;
+        {
+            ofstream out(source);
+            out << translation_unit;
+
+            if (!out) {
+                throw runtime_error("can't write "s + source);
+            }
+        }
+
+        string command = options.compiler + " "s + options.flags + " -I"s + QuoteShellArgument(options.runtime_dir)
+                       + " "s + QuoteShellArgument(source);
+        for (const char* runtime_source : RUNTIME_SOURCES) {
+            command += " "s + QuoteShellArgument(options.runtime_dir + "/"s + runtime_source);
+        }
+        command += " -o "s + QuoteShellArgument(output);
+
+        if (system(command.c_str()) != 0) {
+            throw runtime_error("failed to build "s + output + ": "s + command);
+        }
+    }
+
+} // namespace aot
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "statement.h"
+
+#include <string>
+
+namespace aot {
+
+    // Ahead-of-time translation of a parsed program into a standalone C++ translation
+    // unit. Every method becomes a function whose frame slots are C++ local variables,
+    // the top-level code becomes straight-line code whose global variables are locals
+    // too, and every class a runtime::Class built once with those functions as method
+    // bodies. Calls go through per-site inline caches to the native functions; the
+    // __init__ called by an instance creation is known statically and called directly.
+    //
+    // The unit includes aot_runtime.h and links against the runtime sources, see Build.
+    // Throws std::runtime_error if the tree can't be translated, such as a method body
+    // that works on a Closure instead of frame slots.
+    std::string Translate(runtime::Executable& program);
+
+    struct BuildOptions {
+        // Compiler driver; $CXX if set, c++ otherwise
+        std::string compiler;
+        // Directory with aot_runtime.h and the runtime sources; $MYTHON_RUNTIME_DIR if
+        // set, the parent directory otherwise (where main looks for test.txt too)
+        std::string runtime_dir;
+        std::string flags = "-std=c++17 -O2";
+    };
+
+    // Writes the translation unit to <output>.cpp and builds the executable <output>
+    // with the system compiler. Throws std::runtime_error if the compiler fails.
+    void Build(const std::string& translation_unit, const std::string& output, BuildOptions options = {});
+
+} // namespace aot
@@ -0,0 +1,332 @@
+#pragma once
+
+#include "call_stack.h"
+#include "runtime.h"
+
+#include <array>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Support code of the C++ translation units emitted by aot::Translate. Only this
+// header and the runtime (runtime.h and the sources it links against) are needed to
+// build a translated program.
+namespace aot {
+
+    // Translated method: args[0] is self, the arguments follow it. The function moves
+    // the values out of the array on entry, before it evaluates anything.
+    using NativeMethod = runtime::ObjectHolder (*)(runtime::ObjectHolder* args, runtime::Context& context);
+
+    // Body of a translated method. Calls dispatched by the runtime (special methods,
+    // ClassInstance::Call) reach it through CallInFrame and pass the filled frame;
+    // calls from translated code go to the function directly, see CallSite.
+    class NativeBody : public runtime::Executable {
+    public:
+        explicit NativeBody(NativeMethod function)
+            : function_(function) {
+        }
+
+        runtime::ObjectHolder Execute(runtime::Closure& /* closure */, runtime::Context& context) override {
+            return function_(&runtime::CallStack::Get().Local(0), context);
+        }
+
+        NativeMethod GetFunction() const {
+            return function_;
+        }
+
+    private:
+        NativeMethod function_;
+    };
+
+    inline runtime::Method MakeMethod(std::string name, std::vector<runtime::Symbol> formal_params,
+                                      size_t frame_size, size_t self_field_count, NativeMethod function) {
+        runtime::Method method;
+        method.name = std::move(name);
+        method.formal_params = std::move(formal_params);
+        method.body = std::make_unique<NativeBody>(function);
+        method.frame_size = frame_size;
+        method.self_field_count = self_field_count;
+        return method;
+    }
+
+    // Marks locals and globals read before their first assignment
+    class UnboundValue : public runtime::Object {
+    public:
+        void Print(std::ostream& /* os */, runtime::Context& /* context */) override {
+        }
+    };
+
+    inline UnboundValue unbound_value;
+
+    inline runtime::ObjectHolder Unbound() {
+        return runtime::ObjectHolder::Share(unbound_value);
+    }
+
+    inline const runtime::ObjectHolder& CheckBound(const runtime::ObjectHolder& variable) {
+        if (variable.Get() == &unbound_value) {
+            throw std::runtime_error("var is not found");
+        }
+        return variable;
+    }
+
+    // Field read or written by the translated code, with the cache of ast::FieldCache
+    struct FieldSite {
+        explicit FieldSite(runtime::Symbol field)
+            : name(field) {
+        }
+
+        runtime::Symbol name;
+        const runtime::Shape* shape = nullptr;
+        runtime::Shape* next_shape = nullptr;
+        size_t slot = 0;
+    };
+
+    // Value of object.<field>; an object that is not an instance is returned as it is,
+    // like the tree walker does for dotted names
+    inline runtime::ObjectHolder LoadField(const runtime::ObjectHolder& object, FieldSite& site) {
+        auto* instance = object.TryAs<runtime::ClassInstance>();
+
+        if (instance == nullptr) {
+            return object;
+        }
+
+        runtime::FieldTable& fields = instance->Fields();
+        const runtime::Shape* shape = &fields.GetShape();
+
+        if (shape != site.shape) {
+            size_t slot = shape->FindSlot(site.name);
+
+            if (slot == runtime::Shape::NO_SLOT) {
+                throw std::runtime_error("var is not found");
+            }
+
+            site.shape = shape;
+            site.next_shape = nullptr;
+            site.slot = slot;
+        }
+
+        return fields.GetSlot(site.slot);
+    }
+
+    inline runtime::ClassInstance& AsInstance(const runtime::ObjectHolder& object) {
+        auto* instance = object.TryAs<runtime::ClassInstance>();
+
+        if (instance == nullptr) {
+            throw std::runtime_error("fields can be assigned only to class instances");
+        }
+
+        return *instance;
+    }
+
+    inline void StoreField(runtime::ClassInstance& instance, FieldSite& site, runtime::ObjectHolder value) {
+        runtime::FieldTable& fields = instance.Fields();
+        runtime::Shape& shape = fields.GetShape();
+
+        if (&shape != site.shape) {
+            size_t slot = shape.FindSlot(site.name);
+
+            site.shape = &shape;
+            if (slot == runtime::Shape::NO_SLOT) {
+                site.next_shape = shape.AddField(site.name);
+                site.slot = shape.GetFieldCount();
+            } else {
+                site.next_shape = nullptr;
+                site.slot = slot;
+            }
+        }
+
+        runtime::ObjectHolder& field = site.next_shape != nullptr ? fields.AddSlot(*site.next_shape)
+                                                                  : fields.GetSlot(site.slot);
+        field = std::move(value);
+    }
+
+    // Method call site with the polymorphic inline cache of ast::MethodCall. Entries
+    // keep the native function of translated methods, so a cache hit is a direct call.
+    class CallSite {
+    public:
+        struct Entry {
+            const runtime::Class* cls = nullptr;
+            const runtime::Method* method = nullptr;
+            // nullptr if the method is not translated
+            NativeMethod function = nullptr;
+        };
+
+        CallSite(runtime::Symbol method_name, size_t argument_count)
+            : method_slot_(runtime::GetMethodSlot(method_name))
+            , argument_count_(argument_count) {
+        }
+
+        // Method to call on the object; throws if there is none
+        const Entry& Find(const runtime::ObjectHolder& object) {
+            auto* instance = object.TryAs<runtime::ClassInstance>();
+
+            if (instance == nullptr) {
+                throw std::runtime_error("methods can be called only on class instances");
+            }
+
+            const runtime::Class* cls = &instance->GetClass();
+
+            for (size_t i = 0; i < cache_size_; ++i) {
+                if (cache_[i].cls == cls) {
+                    return cache_[i];
+                }
+            }
+
+            const runtime::Method* method = cls->GetMethodBySlot(method_slot_);
+
+            if (method == nullptr || method->formal_params.size() != argument_count_) {
+                throw std::runtime_error("No method found");
+            }
+
+            auto* body = dynamic_cast<const NativeBody*>(method->body.get());
+            Entry entry{ cls, method, body != nullptr ? body->GetFunction() : nullptr };
+
+            if (!megamorphic_) {
+                if (cache_size_ < cache_.size()) {
+                    return cache_[cache_size_++] = entry;
+                }
+                megamorphic_ = true;
+            }
+
+            return last_ = entry;
+        }
+
+    private:
+        static constexpr size_t POLYMORPHIC_CACHE_SIZE = 4;
+
+        size_t method_slot_;
+        size_t argument_count_;
+
+        std::array<Entry, POLYMORPHIC_CACHE_SIZE> cache_{};
+        size_t cache_size_ = 0;
+        bool megamorphic_ = false;
+        // Result of the last megamorphic lookup
+        Entry last_;
+    };
+
+    // Calls the method with self and the arguments in args, moving them
+    inline runtime::ObjectHolder Invoke(const CallSite::Entry& entry, runtime::ObjectHolder* args,
+                                        runtime::Context& context) {
+        if (entry.function != nullptr) {
+            return entry.function(args, context);
+        }
+
+        const size_t argument_count = entry.method->formal_params.size();
+
+        if (entry.method->frame_size != 0) {
+            runtime::CallStack::Frame frame(entry.method->frame_size);
+
+            for (size_t i = 0; i <= argument_count; ++i) {
+                frame.Slot(i) = std::move(args[i]);
+            }
+
+            return runtime::CallInFrame(*entry.method, frame, context);
+        }
+
+        std::vector<runtime::ObjectHolder> actual_args(args + 1, args + 1 + argument_count);
+        return args[0].TryAs<runtime::ClassInstance>()->Call(*entry.method, actual_args, context);
+    }
+
+    inline runtime::ObjectHolder NewInstance(const runtime::Class& cls) {
+        return runtime::ObjectHolder::Own(runtime::ClassInstance(cls));
+    }
+
+    inline void Print(const runtime::ObjectHolder& object, runtime::Context& context) {
+        if (object) {
+            object->Print(context.GetOutputStream(), context);
+        } else {
+            context.GetOutputStream() << "None";
+        }
+    }
+
+    // Arithmetic with the int64 fast path of the specialized tree nodes
+    inline runtime::ObjectHolder Add(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+                                     runtime::Context& context) {
+        auto* l_number = lhs.TryAs<runtime::Number>();
+        auto* r_number = rhs.TryAs<runtime::Number>();
+        int64_t result;
+
+        if (l_number != nullptr && r_number != nullptr
+            && !__builtin_add_overflow(l_number->GetValue(), r_number->GetValue(), &result)) {
+            return runtime::MakeNumber(result);
+        }
+
+        return runtime::Add(lhs, rhs, context);
+    }
+
+    inline runtime::ObjectHolder Sub(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+                                     runtime::Context& context) {
+        auto* l_number = lhs.TryAs<runtime::Number>();
+        auto* r_number = rhs.TryAs<runtime::Number>();
+        int64_t result;
+
+        if (l_number != nullptr && r_number != nullptr
+            && !__builtin_sub_overflow(l_number->GetValue(), r_number->GetValue(), &result)) {
+            return runtime::MakeNumber(result);
+        }
+
+        return runtime::Sub(lhs, rhs, context);
+    }
+
+    inline runtime::ObjectHolder Mult(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+                                      runtime::Context& context) {
+        auto* l_number = lhs.TryAs<runtime::Number>();
+        auto* r_number = rhs.TryAs<runtime::Number>();
+        int64_t result;
+
+        if (l_number != nullptr && r_number != nullptr
+            && !__builtin_mul_overflow(l_number->GetValue(), r_number->GetValue(), &result)) {
+            return runtime::MakeNumber(result);
+        }
+
+        return runtime::Mult(lhs, rhs, context);
+    }
+
+    inline runtime::ObjectHolder Div(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs,
+                                     runtime::Context& context) {
+        auto* l_number = lhs.TryAs<runtime::Number>();
+        auto* r_number = rhs.TryAs<runtime::Number>();
+
+        // Division by zero and INT64_MIN / -1 are left to runtime::Div
+        if (l_number != nullptr && r_number != nullptr && r_number->GetValue() != 0
+            && !(l_number->GetValue() == INT64_MIN && r_number->GetValue() == -1)) {
+            return runtime::MakeNumber(l_number->GetValue() / r_number->GetValue());
+        }
+
+        return runtime::Div(lhs, rhs, context);
+    }
+
+    template <runtime::CompareOp op>
+    bool Compare(const runtime::ObjectHolder& lhs, const runtime::ObjectHolder& rhs, runtime::Context& context) {
+        auto* l_number = lhs.TryAs<runtime::Number>();
+        auto* r_number = rhs.TryAs<runtime::Number>();
+
+        if (l_number != nullptr && r_number != nullptr) {
+            return runtime::ApplyCompareOp(op, l_number->GetValue(), r_number->GetValue());
+        }
+
+        return runtime::Compare(op, lhs, rhs, context);
+    }
+
+    // Runs the translated top-level code like RunMythonProgram does: in an arena and
+    // with a cycle collector, printing to the output stream. Returns the exit status.
+    inline int RunMain(runtime::ObjectHolder (*program)(runtime::Context& context), std::ostream& output,
+                       std::ostream& errors) {
+        try {
+            runtime::Arena arena;
+            runtime::Arena::Scope arena_scope(arena);
+            runtime::CycleCollector collector;
+            runtime::CycleCollector::Scope collector_scope(collector);
+
+            runtime::SimpleContext context{ output };
+            program(context);
+        } catch (const std::exception& e) {
+            errors << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+} // namespace aot
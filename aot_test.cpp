@@ -0,0 +1,202 @@
+#include "aot.h"
+#include "parse.h"
+#include "statement.h"
+#include "test_runner_p.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+
+namespace parse {
+    unique_ptr<ast::Statement> ParseProgramFromString(const string& program);
+}  // namespace parse
+
+namespace aot {
+
+    using parse::ParseProgramFromString;
+
+    namespace {
+        // Output of the tree walker, followed by the message of the error that stopped
+        // the program, as a translated program prints it
+        string RunTreeWalker(const string& program) {
+            runtime::DummyContext context;
+            runtime::Closure closure;
+
+            try {
+                ParseProgramFromString(program)->Execute(closure, context);
+            } catch (const runtime_error& e) {
+                context.output << e.what() << '\n';
+            }
+
+            return context.output.str();
+        }
+
+        // Builds the translated program and returns its exit status, with stdout and
+        // stderr in output
+        int BuildAndRun(const string& program, const string& name, string& output) {
+            const auto dir = filesystem::temp_directory_path() / "mython_aot_test";
+            filesystem::create_directories(dir);
+            const string executable = (dir / name).string();
+
+            // -O0 keeps the test quick, the code is the same
+            BuildOptions options;
+            options.flags = "-std=c++17 -O0"s;
+            Build(Translate(*ParseProgramFromString(program)), executable, options);
+
+            FILE* pipe = popen(("'"s + executable + "' 2>&1"s).c_str(), "r");
+            ASSERT(pipe != nullptr);
+
+            char buffer[256];
+            size_t size;
+            while ((size = fread(buffer, 1, sizeof(buffer), pipe)) > 0) {
+                output.append(buffer, size);
+            }
+
+            return pclose(pipe);
+        }
+
+        // The runtime sources must be where Build looks for them by default. Without
+        // MYTHON_RUNTIME_DIR a missing ../runtime.cpp skips the test with a message; a
+        // MYTHON_RUNTIME_DIR that has no runtime.cpp fails it.
+        bool CanBuild(const string& test_name) {
+            const char* runtime_dir = getenv("MYTHON_RUNTIME_DIR");
+            const string runtime_source = string(runtime_dir != nullptr ? runtime_dir : "..") + "/runtime.cpp"s;
+
+            if (ifstream(runtime_source).is_open()) {
+                return true;
+            }
+
+            Assert(runtime_dir == nullptr, "MYTHON_RUNTIME_DIR has no runtime.cpp: "s + runtime_source);
+            cerr << test_name << " skipped: "s << runtime_source << " not found, set MYTHON_RUNTIME_DIR"s << endl;
+            return false;
+        }
+
+        void TestTranslation() {
+            const string program = R"(
+class Counter:
+  def __init__(start):
+    self.value = start
+
+  def add(n):
+    self.value = self.value + n
+    return self
+
+c = Counter(1)
+d = c.add(2)
+print d.value
+)"s;
+
+            const string unit = Translate(*ParseProgramFromString(program));
+
+            // One function per method, the locals are C++ variables
+            ASSERT(unit.find("// Counter.__init__\n"s) != string::npos);
+            ASSERT(unit.find("runtime::ObjectHolder l1 = std::move(args[1]);"s) != string::npos);
+            // The __init__ of an instance creation is called directly, other calls go
+            // through a call site
+            ASSERT(unit.find("method_0(a"s) != string::npos);
+            ASSERT(unit.find("aot::CallSite call_site_"s) != string::npos);
+            ASSERT(unit.find("runtime::ObjectHolder g_c = aot::Unbound();"s) != string::npos);
+            ASSERT(unit.find("int main() {"s) != string::npos);
+        }
+
+        void TestBuiltPrograms() {
+            if (!CanBuild("aot::TestBuiltPrograms"s)) {
+                return;
+            }
+
+            const string program = R"(
+class Pair:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def __str__():
+    return '(' + str(self.x) + ', ' + str(self.y) + ')'
+
+class Point(Pair):
+  def __add__(other):
+    return Pair(self.x + other.x, self.y + other.y)
+
+  def __eq__(other):
+    return self.x == other.x and self.y == other.y
+
+class Named(Point):
+  def __init__(name):
+    self.x = 0
+    self.y = 0
+    self.name = name
+
+  def __str__():
+    return self.name + "\t\"quoted\"\n"
+
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+  def unbound(flag):
+    if flag:
+      x = 1
+    return x
+
+p = Point(1, 2)
+q = p + Point(3, 4)
+print p, q, q.x, p == Point(1, 2), p != q
+n = Named('n')
+print Named('origin'), n.x
+f = Fib()
+print f.calc(15), f.unbound(True)
+print 9223372036854775807 + 1, 7 / 2, 'a' < 'b', not None, None
+if f.calc(3) > 1 or f.calc(100000):
+  print 'short', Point
+else:
+  print 'long'
+y = 5
+print y * -2, f.unbound(False)
+print 'unreachable'
+)"s;
+
+            string output;
+            const int status = BuildAndRun(program, "points"s, output);
+
+            ASSERT_EQUAL(output, RunTreeWalker(program));
+            ASSERT(output.find("short Class Point\n-10 var is not found\n"s) != string::npos);
+            ASSERT(status != 0);
+        }
+
+        void TestBuildErrors() {
+            if (!CanBuild("aot::TestBuildErrors"s)) {
+                return;
+            }
+
+            BuildOptions options;
+            options.flags = "-std=c++17 -O0"s;
+            const auto dir = filesystem::temp_directory_path() / "mython_aot_test";
+            filesystem::create_directories(dir);
+
+            ASSERT_THROWS(Build("int main() { return undeclared; }\n"s, (dir / "broken").string(), options),
+                          std::runtime_error);
+        }
+
+        void TestRejectedMethods() {
+            // A method built by hand has no frame slots and can't be translated
+            vector<runtime::Method> methods;
+            methods.push_back({ "get"s, {}, make_unique<ast::NumericConst>(1) });
+            runtime::Class cls("C"s, std::move(methods), nullptr);
+
+            ast::NewInstance program(cls);
+            ASSERT_THROWS(Translate(program), std::runtime_error);
+        }
+    } // namespace
+
+    void RunAotTests(TestRunner& tr) {
+        RUN_TEST(tr, aot::TestTranslation);
+        RUN_TEST(tr, aot::TestBuiltPrograms);
+        RUN_TEST(tr, aot::TestBuildErrors);
+        RUN_TEST(tr, aot::TestRejectedMethods);
+    }
+
+} // namespace aot
@@ -0,0 +1,98 @@
+#include "arena.h"
+
+#include <cassert>
+#include <cstdint>
+#include <new>
+
+using namespace std;
+
+namespace runtime {
+
+    namespace {
+        thread_local Arena* current_arena = nullptr;
+
+        // Every region starts with a pointer to its arena, regions are aligned to
+        // their size so the owner of any block is found by masking its address
+        struct RegionHeader {
+            Arena* owner;
+        };
+
+        constexpr size_t REGION_HEADER_SIZE = 16;
+        static_assert(sizeof(RegionHeader) <= REGION_HEADER_SIZE);
+    } // namespace
+
+    Arena::~Arena() {
+        for (void* region : regions_) {
+            ::operator delete(region, align_val_t{ REGION_SIZE });
+        }
+    }
+
+    void* Arena::Allocate(size_t size, unsigned char& size_class) {
+        const size_t index = (size + SIZE_CLASS_STEP - 1) / SIZE_CLASS_STEP - 1;
+
+        if (size == 0 || index >= SIZE_CLASS_COUNT) {
+            size_class = NO_SIZE_CLASS;
+            return nullptr;
+        }
+
+        size_class = static_cast<unsigned char>(index);
+        SizeClass& cls = size_classes_[index];
+
+        if (cls.free_list != nullptr) {
+            FreeBlock* block = cls.free_list;
+            cls.free_list = block->next;
+            return block;
+        }
+
+        const size_t block_size = (index + 1) * SIZE_CLASS_STEP;
+        if (cls.cursor == nullptr || cls.cursor + block_size > cls.end) {
+            AddRegion(cls);
+        }
+
+        void* result = cls.cursor;
+        cls.cursor += block_size;
+        return result;
+    }
+
+    void Arena::Deallocate(void* ptr, unsigned char size_class) {
+        assert(size_class < SIZE_CLASS_COUNT);
+
+        SizeClass& cls = size_classes_[size_class];
+        auto* block = static_cast<FreeBlock*>(ptr);
+        block->next = cls.free_list;
+        cls.free_list = block;
+    }
+
+    size_t Arena::GetReservedBytes() const {
+        return regions_.size() * REGION_SIZE;
+    }
+
+    Arena& Arena::Owner(const void* ptr) {
+        auto address = reinterpret_cast<uintptr_t>(ptr) & ~(uintptr_t{ REGION_SIZE } - 1);
+        return *reinterpret_cast<const RegionHeader*>(address)->owner;
+    }
+
+    Arena* Arena::Current() {
+        return current_arena;
+    }
+
+    void Arena::AddRegion(SizeClass& size_class) {
+        void* region = ::operator new(REGION_SIZE, align_val_t{ REGION_SIZE });
+        regions_.push_back(region);
+
+        new (region) RegionHeader{ this };
+
+        size_class.cursor = static_cast<char*>(region) + REGION_HEADER_SIZE;
+        size_class.end = static_cast<char*>(region) + REGION_SIZE;
+    }
+
+    Arena::Scope::Scope(Arena& arena)
+        : previous_(current_arena) {
+        current_arena = &arena;
+    }
+
+    Arena::Scope::~Scope() {
+        current_arena = previous_;
+    }
+
+} // namespace runtime
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <vector>
+
+namespace runtime {
+
+    // Bump-pointer allocator for runtime objects of a single program run.
+    // Memory is carved from large regions per size class; freed blocks go to a
+    // per-class free list and all regions are released at once when the arena dies.
+    // Objects allocated from an arena must not outlive it.
+    class Arena {
+    public:
+        static constexpr unsigned char NO_SIZE_CLASS = 0xFF;
+
+        Arena() = default;
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+        ~Arena();
+
+        // Returns nullptr if size is too large for the arena
+        void* Allocate(size_t size, unsigned char& size_class);
+        void Deallocate(void* ptr, unsigned char size_class);
+
+        size_t GetReservedBytes() const;
+
+        // The arena a block was allocated from
+        static Arena& Owner(const void* ptr);
+
+        // Arena used by ObjectHolder::Own() on this thread, nullptr if none is active
+        static Arena* Current();
+
+        class Scope {
+        public:
+            explicit Scope(Arena& arena);
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+            ~Scope();
+
+        private:
+            Arena* previous_;
+        };
+
+    private:
+        static constexpr size_t REGION_SIZE = 64 * 1024;
+        static constexpr size_t SIZE_CLASS_STEP = 16;
+        static constexpr size_t SIZE_CLASS_COUNT = 16;
+
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+
+        struct SizeClass {
+            char* cursor = nullptr;
+            char* end = nullptr;
+            FreeBlock* free_list = nullptr;
+        };
+
+        void AddRegion(SizeClass& size_class);
+
+        std::array<SizeClass, SIZE_CLASS_COUNT> size_classes_;
+        std::vector<void*> regions_;
+    };
+
+} // namespace runtime
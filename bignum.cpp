@@ -0,0 +1,346 @@
+#include "bignum.h"
+
+#include <algorithm>
+#include <ostream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace runtime {
+
+    BigInt::BigInt(int64_t value)
+        : negative_(value < 0) {
+        // Negating in unsigned arithmetic keeps INT64_MIN well defined
+        uint64_t magnitude = negative_ ? 0 - static_cast<uint64_t>(value) : static_cast<uint64_t>(value);
+
+        while (magnitude != 0) {
+            limbs_.push_back(static_cast<uint32_t>(magnitude % BASE));
+            magnitude /= BASE;
+        }
+    }
+
+    BigInt::BigInt(string_view digits) {
+        // Each limb takes BASE_DIGITS digits, counted from the end of the literal
+        for (size_t end = digits.size(); end > 0;) {
+            const size_t begin = end > BASE_DIGITS ? end - BASE_DIGITS : 0;
+            uint32_t limb = 0;
+
+            for (size_t i = begin; i < end; ++i) {
+                if (digits[i] < '0' || digits[i] > '9') {
+                    throw invalid_argument("not a decimal integer: "s + string(digits));
+                }
+                limb = limb * 10 + static_cast<uint32_t>(digits[i] - '0');
+            }
+
+            limbs_.push_back(limb);
+            end = begin;
+        }
+
+        Trim(limbs_);
+    }
+
+    BigInt::BigInt(bool negative, Limbs limbs)
+        : negative_(negative)
+        , limbs_(std::move(limbs)) {
+        Trim(limbs_);
+        if (limbs_.empty()) {
+            negative_ = false;
+        }
+    }
+
+    bool BigInt::ToInt64(int64_t& value) const {
+        uint64_t magnitude = 0;
+
+        for (auto it = limbs_.rbegin(); it != limbs_.rend(); ++it) {
+            if (__builtin_mul_overflow(magnitude, uint64_t{ BASE }, &magnitude)
+                || __builtin_add_overflow(magnitude, uint64_t{ *it }, &magnitude)) {
+                return false;
+            }
+        }
+
+        constexpr uint64_t MAX_POSITIVE = static_cast<uint64_t>(INT64_MAX);
+        if (magnitude > MAX_POSITIVE + (negative_ ? 1 : 0)) {
+            return false;
+        }
+
+        value = negative_ ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+        return true;
+    }
+
+    string BigInt::ToString() const {
+        if (limbs_.empty()) {
+            return "0"s;
+        }
+
+        string result = negative_ ? "-"s : ""s;
+        result += to_string(limbs_.back());
+
+        for (auto it = next(limbs_.rbegin()); it != limbs_.rend(); ++it) {
+            string limb = to_string(*it);
+            result.append(BASE_DIGITS - limb.size(), '0');
+            result += limb;
+        }
+
+        return result;
+    }
+
+    int BigInt::CompareMagnitudes(const Limbs& lhs, const Limbs& rhs) {
+        if (lhs.size() != rhs.size()) {
+            return lhs.size() < rhs.size() ? -1 : 1;
+        }
+
+        for (size_t i = lhs.size(); i-- > 0;) {
+            if (lhs[i] != rhs[i]) {
+                return lhs[i] < rhs[i] ? -1 : 1;
+            }
+        }
+
+        return 0;
+    }
+
+    BigInt::Limbs BigInt::AddMagnitudes(const Limbs& lhs, const Limbs& rhs) {
+        Limbs result;
+        result.reserve(max(lhs.size(), rhs.size()) + 1);
+
+        uint32_t carry = 0;
+        for (size_t i = 0; i < max(lhs.size(), rhs.size()); ++i) {
+            uint32_t sum = carry;
+            sum += i < lhs.size() ? lhs[i] : 0;
+            sum += i < rhs.size() ? rhs[i] : 0;
+
+            carry = sum >= BASE ? 1 : 0;
+            result.push_back(sum - carry * BASE);
+        }
+
+        if (carry != 0) {
+            result.push_back(carry);
+        }
+
+        return result;
+    }
+
+    BigInt::Limbs BigInt::SubMagnitudes(const Limbs& lhs, const Limbs& rhs) {
+        Limbs result(lhs);
+
+        int64_t borrow = 0;
+        for (size_t i = 0; i < result.size(); ++i) {
+            int64_t diff = int64_t{ result[i] } - borrow - (i < rhs.size() ? int64_t{ rhs[i] } : 0);
+
+            borrow = diff < 0 ? 1 : 0;
+            result[i] = static_cast<uint32_t>(diff + borrow * BASE);
+        }
+
+        Trim(result);
+        return result;
+    }
+
+    BigInt::Limbs BigInt::MultiplySchoolbook(const Limbs& lhs, const Limbs& rhs) {
+        if (lhs.empty() || rhs.empty()) {
+            return {};
+        }
+
+        vector<uint64_t> result(lhs.size() + rhs.size(), 0);
+
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            uint64_t carry = 0;
+
+            for (size_t j = 0; j < rhs.size(); ++j) {
+                uint64_t current = result[i + j] + uint64_t{ lhs[i] } * rhs[j] + carry;
+                result[i + j] = current % BASE;
+                carry = current / BASE;
+            }
+
+            for (size_t k = i + rhs.size(); carry != 0; ++k) {
+                uint64_t current = result[k] + carry;
+                result[k] = current % BASE;
+                carry = current / BASE;
+            }
+        }
+
+        Limbs limbs(result.begin(), result.end());
+        Trim(limbs);
+        return limbs;
+    }
+
+    BigInt::Limbs BigInt::MultiplyKaratsuba(const Limbs& lhs, const Limbs& rhs) {
+        if (lhs.size() < KARATSUBA_THRESHOLD || rhs.size() < KARATSUBA_THRESHOLD) {
+            return MultiplySchoolbook(lhs, rhs);
+        }
+
+        // x = x1 * BASE^half + x0, then
+        // lhs * rhs = z2 * BASE^(2 half) + z1 * BASE^half + z0 with
+        // z1 = (l0 + l1)(r0 + r1) - z0 - z2
+        const size_t half = max(lhs.size(), rhs.size()) / 2;
+
+        auto split = [half](const Limbs& value, Limbs& low, Limbs& high) {
+            const size_t low_size = min(half, value.size());
+            low.assign(value.begin(), value.begin() + low_size);
+            high.assign(value.begin() + low_size, value.end());
+            Trim(low);
+        };
+
+        Limbs lhs_low, lhs_high, rhs_low, rhs_high;
+        split(lhs, lhs_low, lhs_high);
+        split(rhs, rhs_low, rhs_high);
+
+        Limbs z0 = MultiplyKaratsuba(lhs_low, rhs_low);
+        Limbs z2 = MultiplyKaratsuba(lhs_high, rhs_high);
+        Limbs z1 = MultiplyKaratsuba(AddMagnitudes(lhs_low, lhs_high), AddMagnitudes(rhs_low, rhs_high));
+        z1 = SubMagnitudes(SubMagnitudes(z1, z0), z2);
+
+        Limbs result;
+        AddShifted(result, z0, 0);
+        AddShifted(result, z1, half);
+        AddShifted(result, z2, 2 * half);
+        Trim(result);
+        return result;
+    }
+
+    BigInt::Limbs BigInt::MultiplyBySmall(const Limbs& lhs, uint32_t rhs) {
+        Limbs result;
+        result.reserve(lhs.size() + 1);
+
+        uint64_t carry = 0;
+        for (uint32_t limb : lhs) {
+            uint64_t current = uint64_t{ limb } * rhs + carry;
+            result.push_back(static_cast<uint32_t>(current % BASE));
+            carry = current / BASE;
+        }
+
+        if (carry != 0) {
+            result.push_back(static_cast<uint32_t>(carry));
+        }
+
+        Trim(result);
+        return result;
+    }
+
+    BigInt::Limbs BigInt::DivideMagnitudes(const Limbs& lhs, const Limbs& rhs) {
+        if (CompareMagnitudes(lhs, rhs) < 0) {
+            return {};
+        }
+
+        Limbs quotient(lhs.size(), 0);
+
+        if (rhs.size() == 1) {
+            uint64_t remainder = 0;
+
+            for (size_t i = lhs.size(); i-- > 0;) {
+                uint64_t current = remainder * BASE + lhs[i];
+                quotient[i] = static_cast<uint32_t>(current / rhs[0]);
+                remainder = current % rhs[0];
+            }
+
+            Trim(quotient);
+            return quotient;
+        }
+
+        // Long division, one base 10^9 digit at a time. Each digit is found by binary
+        // search, which is slow but only runs for numbers past the int64_t range.
+        Limbs remainder;
+        for (size_t i = lhs.size(); i-- > 0;) {
+            remainder.insert(remainder.begin(), lhs[i]);
+            Trim(remainder);
+
+            uint32_t low = 0;
+            uint32_t high = BASE - 1;
+            while (low < high) {
+                uint32_t middle = low + (high - low + 1) / 2;
+
+                if (CompareMagnitudes(MultiplyBySmall(rhs, middle), remainder) <= 0) {
+                    low = middle;
+                } else {
+                    high = middle - 1;
+                }
+            }
+
+            quotient[i] = low;
+            if (low != 0) {
+                remainder = SubMagnitudes(remainder, MultiplyBySmall(rhs, low));
+            }
+        }
+
+        Trim(quotient);
+        return quotient;
+    }
+
+    void BigInt::AddShifted(Limbs& result, const Limbs& value, size_t shift) {
+        if (value.empty()) {
+            return;
+        }
+
+        if (result.size() < value.size() + shift + 1) {
+            result.resize(value.size() + shift + 1, 0);
+        }
+
+        uint32_t carry = 0;
+        size_t i = 0;
+        for (; i < value.size() || carry != 0; ++i) {
+            if (shift + i == result.size()) {
+                result.push_back(0);
+            }
+
+            uint32_t sum = result[shift + i] + carry + (i < value.size() ? value[i] : 0);
+            carry = sum >= BASE ? 1 : 0;
+            result[shift + i] = sum - carry * BASE;
+        }
+    }
+
+    void BigInt::Trim(Limbs& limbs) {
+        while (!limbs.empty() && limbs.back() == 0) {
+            limbs.pop_back();
+        }
+    }
+
+    BigInt BigInt::AddSigned(const BigInt& lhs, const BigInt& rhs, bool negate_rhs) {
+        const bool rhs_negative = rhs.negative_ != negate_rhs;
+
+        if (lhs.negative_ == rhs_negative) {
+            return BigInt(lhs.negative_, AddMagnitudes(lhs.limbs_, rhs.limbs_));
+        }
+
+        if (CompareMagnitudes(lhs.limbs_, rhs.limbs_) >= 0) {
+            return BigInt(lhs.negative_, SubMagnitudes(lhs.limbs_, rhs.limbs_));
+        }
+
+        return BigInt(rhs_negative, SubMagnitudes(rhs.limbs_, lhs.limbs_));
+    }
+
+    BigInt operator+(const BigInt& lhs, const BigInt& rhs) {
+        return BigInt::AddSigned(lhs, rhs, false);
+    }
+
+    BigInt operator-(const BigInt& lhs, const BigInt& rhs) {
+        return BigInt::AddSigned(lhs, rhs, true);
+    }
+
+    BigInt operator*(const BigInt& lhs, const BigInt& rhs) {
+        return BigInt(lhs.negative_ != rhs.negative_, BigInt::MultiplyKaratsuba(lhs.limbs_, rhs.limbs_));
+    }
+
+    BigInt operator/(const BigInt& lhs, const BigInt& rhs) {
+        if (rhs.IsZero()) {
+            throw runtime_error("division by zero"s);
+        }
+
+        return BigInt(lhs.negative_ != rhs.negative_, BigInt::DivideMagnitudes(lhs.limbs_, rhs.limbs_));
+    }
+
+    bool operator==(const BigInt& lhs, const BigInt& rhs) {
+        return lhs.negative_ == rhs.negative_ && lhs.limbs_ == rhs.limbs_;
+    }
+
+    bool operator<(const BigInt& lhs, const BigInt& rhs) {
+        if (lhs.negative_ != rhs.negative_) {
+            return lhs.negative_;
+        }
+
+        const int compare = BigInt::CompareMagnitudes(lhs.limbs_, rhs.limbs_);
+        return lhs.negative_ ? compare > 0 : compare < 0;
+    }
+
+    ostream& operator<<(ostream& os, const BigInt& value) {
+        return os << value.ToString();
+    }
+
+} // namespace runtime
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace runtime {
+
+    // Arbitrary precision integer: a sign and a magnitude stored as base 10^9 limbs,
+    // least significant first. Numbers switch to it only when int64_t arithmetic
+    // overflows, so it favours simplicity over raw speed except for multiplication,
+    // which uses Karatsuba for long operands.
+    class BigInt {
+    public:
+        BigInt() = default;
+        BigInt(int64_t value);
+        // Parses a non-negative decimal literal; throws std::invalid_argument if digits
+        // contains anything else
+        explicit BigInt(std::string_view digits);
+
+        bool IsZero() const {
+            return limbs_.empty();
+        }
+
+        bool IsNegative() const {
+            return negative_;
+        }
+
+        // Returns false if the value does not fit int64_t
+        bool ToInt64(int64_t& value) const;
+
+        std::string ToString() const;
+
+        friend BigInt operator+(const BigInt& lhs, const BigInt& rhs);
+        friend BigInt operator-(const BigInt& lhs, const BigInt& rhs);
+        friend BigInt operator*(const BigInt& lhs, const BigInt& rhs);
+        // Truncates towards zero like int64_t division. Throws std::runtime_error when
+        // dividing by zero.
+        friend BigInt operator/(const BigInt& lhs, const BigInt& rhs);
+
+        friend bool operator==(const BigInt& lhs, const BigInt& rhs);
+        friend bool operator<(const BigInt& lhs, const BigInt& rhs);
+
+    private:
+        using Limbs = std::vector<uint32_t>;
+
+        static constexpr uint32_t BASE = 1'000'000'000;
+        static constexpr size_t BASE_DIGITS = 9;
+        static constexpr size_t KARATSUBA_THRESHOLD = 32;
+
+        BigInt(bool negative, Limbs limbs);
+
+        static int CompareMagnitudes(const Limbs& lhs, const Limbs& rhs);
+        static Limbs AddMagnitudes(const Limbs& lhs, const Limbs& rhs);
+        // Requires lhs >= rhs
+        static Limbs SubMagnitudes(const Limbs& lhs, const Limbs& rhs);
+        static Limbs MultiplySchoolbook(const Limbs& lhs, const Limbs& rhs);
+        static Limbs MultiplyKaratsuba(const Limbs& lhs, const Limbs& rhs);
+        static Limbs MultiplyBySmall(const Limbs& lhs, uint32_t rhs);
+        static Limbs DivideMagnitudes(const Limbs& lhs, const Limbs& rhs);
+        static void AddShifted(Limbs& result, const Limbs& value, size_t shift);
+        static void Trim(Limbs& limbs);
+
+        static BigInt AddSigned(const BigInt& lhs, const BigInt& rhs, bool negate_rhs);
+
+        bool negative_ = false;
+        // Empty for zero, no leading zero limbs
+        Limbs limbs_;
+    };
+
+    std::ostream& operator<<(std::ostream& os, const BigInt& value);
+
+    inline bool operator!=(const BigInt& lhs, const BigInt& rhs) {
+        return !(lhs == rhs);
+    }
+
+} // namespace runtime
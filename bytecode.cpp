@@ -0,0 +1,558 @@
+#include "bytecode.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+
+namespace bytecode {
+
+    namespace {
+        // Assigns registers while walking the tree: a compiled expression reports the
+        // register holding its value. Temporaries are allocated like a stack above the
+        // frame slots and released once their statement is compiled.
+        class Compiler : public ast::Visitor {
+        public:
+            Compiler(Function& function, size_t frame_size, size_t argument_registers)
+                : function_(function)
+                , first_temp_(frame_size)
+                , next_temp_(frame_size)
+                , bound_(frame_size, false) {
+                function_.register_count = frame_size;
+                function_.argument_registers = argument_registers;
+                fill(bound_.begin(), bound_.begin() + argument_registers, true);
+            }
+
+            // Returns the register holding the value of the statement
+            size_t Compile(ast::Statement& statement) {
+                discard_value_ = false;
+                statement.Accept(*this);
+                return result_;
+            }
+
+            // Compiles a statement whose value is not used
+            void CompileForEffect(ast::Statement& statement) {
+                discard_value_ = true;
+                statement.Accept(*this);
+                discard_value_ = false;
+            }
+
+            size_t NewTemp() {
+                const size_t reg = next_temp_++;
+                function_.register_count = max(function_.register_count, next_temp_);
+                return reg;
+            }
+
+            void Emit(OpCode op, size_t a = 0, size_t b = 0, size_t c = 0, size_t count = 0) {
+                constexpr size_t MAX_OPERAND = numeric_limits<uint32_t>::max();
+
+                if (a > MAX_OPERAND || b > MAX_OPERAND || c > MAX_OPERAND || count > numeric_limits<uint8_t>::max()) {
+                    throw runtime_error("function is too large to compile"s);
+                }
+
+                function_.code.push_back({ op, static_cast<uint8_t>(count), static_cast<uint32_t>(a),
+                                           static_cast<uint32_t>(b), static_cast<uint32_t>(c) });
+            }
+
+            void Visit(ast::NumericConst& node) override {
+                LoadConst(runtime::MakeNumber(node.GetValue().GetValue()));
+            }
+
+            void Visit(ast::BigNumericConst& node) override {
+                LoadConst(runtime::ObjectHolder::Share(node.GetValue()));
+            }
+
+            void Visit(ast::StringConst& node) override {
+                LoadConst(runtime::ObjectHolder::Share(node.GetValue()));
+            }
+
+            void Visit(ast::BoolConst& node) override {
+                LoadConst(runtime::MakeBool(node.GetValue().GetValue()));
+            }
+
+            void Visit(ast::None& /* node */) override {
+                result_ = NewTemp();
+                Emit(OpCode::LoadNone, result_);
+            }
+
+            void Visit(ast::VariableValue& node) override {
+                const auto& ids = node.GetDottedIds();
+                size_t reg;
+
+                if (node.GetLocalSlot() != runtime::NO_LOCAL_SLOT) {
+                    reg = ReadLocal(node.GetLocalSlot());
+                } else {
+                    reg = NewTemp();
+                    Emit(OpCode::LoadGlobal, reg, AddName(ids.front()));
+                }
+
+                for (size_t i = 1; i < ids.size(); ++i) {
+                    const size_t field = IsTemp(reg) ? reg : NewTemp();
+                    Emit(OpCode::LoadField, field, reg, AddFieldSite(ids[i]));
+                    reg = field;
+                }
+
+                result_ = reg;
+            }
+
+            void Visit(ast::Assignment& node) override {
+                const size_t mark = next_temp_;
+                const size_t value = Compile(node.GetValue());
+
+                if (node.GetLocalSlot() == runtime::NO_LOCAL_SLOT) {
+                    Emit(OpCode::StoreGlobal, value, AddName(node.GetName()));
+                    result_ = value;
+                    return;
+                }
+
+                const size_t local = CheckLocal(node.GetLocalSlot());
+                MoveTo(local, value);
+                bound_[local] = true;
+
+                next_temp_ = mark;
+                result_ = local;
+            }
+
+            void Visit(ast::FieldAssignment& node) override {
+                const size_t object = Compile(node.GetObject());
+                Emit(OpCode::CheckInstance, object);
+
+                const size_t value = Compile(node.GetValue());
+                Emit(OpCode::StoreField, object, value, AddFieldSite(node.GetFieldName()));
+
+                result_ = value;
+            }
+
+            void Visit(ast::NewInstance& node) override {
+                // The register in front of the arguments takes self when __init__ is called
+                const size_t self = NewTemp();
+                CompileArguments(node.GetArgs(), 1);
+
+                function_.classes.push_back(&node.GetClass());
+                next_temp_ = self + 1;
+                result_ = self;
+                Emit(OpCode::NewInstance, self, self, function_.classes.size() - 1, node.GetArgs().size());
+            }
+
+            void Visit(ast::MethodCall& node) override {
+                const auto& args = node.GetArgs();
+
+                function_.call_sites.push_back(
+                    { node.GetMethodName(), runtime::GetMethodSlot(node.GetMethodName()), args.size() });
+                const size_t site = function_.call_sites.size() - 1;
+
+                // The object and the arguments take consecutive registers, which become
+                // self and the parameters of the callee
+                const size_t object = NewTemp();
+                MoveTo(object, Compile(node.GetObject()));
+                next_temp_ = object + 1;
+
+                // The tree walker reports a bad receiver before evaluating the arguments
+                if (!args.empty()) {
+                    Emit(OpCode::LookupMethod, 0, object, site);
+                }
+                CompileArguments(args, 1);
+
+                next_temp_ = object + 1;
+                Emit(OpCode::CallMethod, object, object, site, args.size());
+                result_ = object;
+            }
+
+            void Visit(ast::Compound& node) override {
+                const bool discard_value = discard_value_;
+                const size_t mark = next_temp_;
+
+                for (const auto& statement : node.GetStatements()) {
+                    CompileForEffect(*statement);
+                    next_temp_ = mark;
+                    Emit(OpCode::Safepoint);
+                }
+
+                if (!discard_value) {
+                    result_ = NewTemp();
+                    Emit(OpCode::LoadNone, result_);
+                }
+            }
+
+            void Visit(ast::Return& node) override {
+                result_ = Compile(node.GetValue());
+                Emit(OpCode::Return, result_);
+
+                // Nothing after a return is reached with unassigned locals
+                fill(bound_.begin(), bound_.end(), true);
+            }
+
+            void Visit(ast::MethodBody& /* node */) override {
+                throw runtime_error("a method body can only be compiled as a method"s);
+            }
+
+            void Visit(ast::ClassDefinition& node) override {
+                const bool discard_value = discard_value_;
+
+                LoadConst(node.GetClass());
+                Emit(OpCode::StoreGlobal, result_, AddName(node.GetName()));
+
+                if (!discard_value) {
+                    Emit(OpCode::LoadNone, result_);
+                }
+            }
+
+            void Visit(ast::Print& node) override {
+                const auto& args = node.GetArgs();
+
+                // The value of the statement is the last argument
+                for (size_t i = 0; i < args.size(); ++i) {
+                    if (i != 0) {
+                        Emit(OpCode::PrintSpace);
+                    }
+                    result_ = Compile(*args[i]);
+                    Emit(OpCode::PrintValue, result_);
+                }
+
+                if (args.empty()) {
+                    result_ = NewTemp();
+                    Emit(OpCode::LoadNone, result_);
+                }
+                Emit(OpCode::PrintNewline);
+            }
+
+            void Visit(ast::Stringify& node) override {
+                CompileUnary(node, OpCode::Stringify);
+            }
+
+            void Visit(ast::Add& node) override {
+                CompileBinary(node, OpCode::Add);
+            }
+
+            void Visit(ast::Sub& node) override {
+                CompileBinary(node, OpCode::Sub);
+            }
+
+            void Visit(ast::Mult& node) override {
+                CompileBinary(node, OpCode::Mult);
+            }
+
+            void Visit(ast::Div& node) override {
+                CompileBinary(node, OpCode::Div);
+            }
+
+            // lhs or rhs: JumpIfTrue L lhs, ToBool result rhs, Jump end, L: result = True
+            void Visit(ast::Or& node) override {
+                CompileShortCircuit(node, OpCode::JumpIfTrue, true);
+            }
+
+            void Visit(ast::And& node) override {
+                CompileShortCircuit(node, OpCode::JumpIfFalse, false);
+            }
+
+            void Visit(ast::Not& node) override {
+                CompileUnary(node, OpCode::Not);
+            }
+
+            void VisitComparison(ast::BinaryOperation& node, runtime::CompareOp op) override {
+                CompileBinary(node, OpCode::Compare, static_cast<size_t>(op));
+            }
+
+            void Visit(ast::IfElse& node) override {
+                const bool discard_value = discard_value_;
+                const size_t mark = next_temp_;
+                const size_t result = discard_value ? 0 : NewTemp();
+
+                const size_t to_else = CompileCondition(node.GetCondition());
+                const vector<bool> bound_before = bound_;
+
+                CompileBranch(node.GetIfBody(), discard_value, result);
+                vector<bool> bound_after_if = std::move(bound_);
+                bound_ = bound_before;
+
+                if (node.GetElseBody() == nullptr && discard_value) {
+                    PatchJump(to_else);
+                } else {
+                    const size_t to_end = EmitJump(OpCode::Jump);
+
+                    PatchJump(to_else);
+                    if (node.GetElseBody() != nullptr) {
+                        CompileBranch(*node.GetElseBody(), discard_value, result);
+                    } else {
+                        Emit(OpCode::LoadNone, result);
+                    }
+                    PatchJump(to_end);
+                }
+
+                // A local is assigned after the statement only if both branches assign it
+                for (size_t i = 0; i < bound_.size(); ++i) {
+                    bound_[i] = bound_[i] && bound_after_if[i];
+                }
+
+                next_temp_ = discard_value ? mark : result + 1;
+                result_ = result;
+            }
+
+        private:
+            static constexpr size_t NO_LABEL = static_cast<size_t>(-1);
+
+            bool IsTemp(size_t reg) const {
+                return reg >= first_temp_;
+            }
+
+            size_t CheckLocal(size_t slot) const {
+                if (slot >= first_temp_) {
+                    throw runtime_error("local variable outside of a method frame"s);
+                }
+                return slot;
+            }
+
+            size_t ReadLocal(size_t slot) {
+                CheckLocal(slot);
+
+                // Only locals that may still be unassigned need the check
+                if (!bound_[slot]) {
+                    Emit(OpCode::CheckBound, slot);
+                    bound_[slot] = true;
+                }
+
+                return slot;
+            }
+
+            void LoadConst(runtime::ObjectHolder value) {
+                function_.constants.push_back(std::move(value));
+                result_ = NewTemp();
+                Emit(OpCode::LoadConst, result_, function_.constants.size() - 1);
+            }
+
+            // Copies a value to the register, writing the result of the last instruction
+            // there directly when it was computed into a temporary
+            void MoveTo(size_t reg, size_t value) {
+                if (reg == value) {
+                    return;
+                }
+
+                if (IsTemp(value) && !function_.code.empty() && last_label_ != function_.code.size()) {
+                    Instruction& last = function_.code.back();
+
+                    switch (last.op) {
+                        case OpCode::LoadConst:
+                        case OpCode::LoadNone:
+                        case OpCode::Move:
+                        case OpCode::LoadGlobal:
+                        case OpCode::LoadField:
+                        case OpCode::NewInstance:
+                        case OpCode::CallMethod:
+                        case OpCode::Add:
+                        case OpCode::Sub:
+                        case OpCode::Mult:
+                        case OpCode::Div:
+                        case OpCode::Compare:
+                        case OpCode::Not:
+                        case OpCode::Stringify:
+                        case OpCode::ToBool:
+                            if (last.a == value) {
+                                last.a = static_cast<uint32_t>(reg);
+                                return;
+                            }
+                            break;
+                        default:
+                            break;
+                    }
+                }
+
+                Emit(OpCode::Move, reg, value);
+            }
+
+            size_t EmitJump(OpCode op, size_t b = 0, size_t c = 0, size_t count = 0) {
+                Emit(op, 0, b, c, count);
+                return function_.code.size() - 1;
+            }
+
+            // Makes the jump continue at the next instruction to be emitted
+            void PatchJump(size_t jump) {
+                function_.code[jump].a = static_cast<uint32_t>(function_.code.size());
+                last_label_ = function_.code.size();
+            }
+
+            size_t AddName(runtime::Symbol name) {
+                auto& names = function_.names;
+
+                for (size_t i = 0; i < names.size(); ++i) {
+                    if (names[i] == name) {
+                        return i;
+                    }
+                }
+
+                names.push_back(name);
+                return names.size() - 1;
+            }
+
+            // Every field access gets its own cache, like the tree nodes
+            size_t AddFieldSite(runtime::Symbol field) {
+                function_.field_sites.push_back({ field, {} });
+                return function_.field_sites.size() - 1;
+            }
+
+            // Evaluates the arguments into consecutive registers, leaving `offset` free
+            // registers in front of them; returns the first of those
+            size_t CompileArguments(const vector<unique_ptr<ast::Statement>>& args, size_t offset) {
+                const size_t first = next_temp_ - offset;
+
+                for (size_t i = 0; i < args.size(); ++i) {
+                    NewTemp();
+                }
+
+                for (size_t i = 0; i < args.size(); ++i) {
+                    MoveTo(first + offset + i, Compile(*args[i]));
+                    next_temp_ = first + offset + args.size();
+                }
+
+                return first;
+            }
+
+            // Emits a jump taken when the condition is false and returns it for patching.
+            // Comparisons jump on their operands without materializing a Bool.
+            size_t CompileCondition(ast::Statement& condition) {
+                const size_t mark = next_temp_;
+                size_t jump;
+
+                if (auto op = ast::GetCompareOp(condition)) {
+                    auto& comparison = static_cast<ast::BinaryOperation&>(condition);
+                    const auto [lhs, rhs] = CompileOperands(comparison);
+                    jump = EmitJump(OpCode::JumpIfNotCompare, lhs, rhs, static_cast<size_t>(*op));
+                } else {
+                    jump = EmitJump(OpCode::JumpIfFalse, Compile(condition));
+                }
+
+                next_temp_ = mark;
+                return jump;
+            }
+
+            void CompileBranch(ast::Statement& body, bool discard_value, size_t result) {
+                if (discard_value) {
+                    CompileForEffect(body);
+                } else {
+                    MoveTo(result, Compile(body));
+                    next_temp_ = result + 1;
+                }
+            }
+
+            pair<size_t, size_t> CompileOperands(ast::BinaryOperation& node) {
+                if (node.GetLhs() == nullptr || node.GetRhs() == nullptr) {
+                    throw runtime_error("null operands are not supported"s);
+                }
+
+                const size_t lhs = Compile(*node.GetLhs());
+                const size_t rhs = Compile(*node.GetRhs());
+                return { lhs, rhs };
+            }
+
+            void CompileUnary(ast::UnaryOperation& node, OpCode op) {
+                if (node.GetArgument() == nullptr) {
+                    throw runtime_error("null operands are not supported"s);
+                }
+
+                const size_t mark = next_temp_;
+                const size_t argument = Compile(*node.GetArgument());
+
+                next_temp_ = mark;
+                result_ = NewTemp();
+                Emit(op, result_, argument);
+            }
+
+            void CompileBinary(ast::BinaryOperation& node, OpCode op, size_t count = 0) {
+                const size_t mark = next_temp_;
+                const auto [lhs, rhs] = CompileOperands(node);
+
+                // The result may reuse a register of the operands: they are read first
+                next_temp_ = mark;
+                result_ = NewTemp();
+                Emit(op, result_, lhs, rhs, count);
+            }
+
+            void CompileShortCircuit(ast::BinaryOperation& node, OpCode jump_op, bool decided_value) {
+                if (node.GetLhs() == nullptr || node.GetRhs() == nullptr) {
+                    throw runtime_error("null operands are not supported"s);
+                }
+
+                const size_t result = NewTemp();
+                const size_t to_decided = EmitJump(jump_op, Compile(*node.GetLhs()));
+
+                // The rhs runs only sometimes, so the locals it reads stay unchecked after it
+                const vector<bool> bound_before = bound_;
+                Emit(OpCode::ToBool, result, Compile(*node.GetRhs()));
+                bound_ = bound_before;
+                const size_t to_end = EmitJump(OpCode::Jump);
+
+                PatchJump(to_decided);
+                function_.constants.push_back(runtime::MakeBool(decided_value));
+                Emit(OpCode::LoadConst, result, function_.constants.size() - 1);
+                PatchJump(to_end);
+
+                next_temp_ = result + 1;
+                result_ = result;
+            }
+
+            Function& function_;
+            const size_t first_temp_;
+            size_t next_temp_;
+            // Locals certainly assigned at the current point of the code
+            vector<bool> bound_;
+            bool discard_value_ = false;
+            // Register holding the value of the last compiled statement
+            size_t result_ = 0;
+            // Latest jump target; the instruction before it can't be rewritten
+            size_t last_label_ = NO_LABEL;
+        };
+    } // namespace
+
+    Function Compile(ast::Statement& statement) {
+        Function function;
+        Compiler compiler(function, 0, 0);
+
+        compiler.Emit(OpCode::Return, compiler.Compile(statement));
+
+        return function;
+    }
+
+    Function CompileMethod(const runtime::Method& method, ast::MethodBody& body) {
+        Function function;
+        // self and the parameters are assigned by the caller
+        Compiler compiler(function, method.frame_size, method.formal_params.size() + 1);
+
+        // Falling off the end of the body returns None
+        compiler.CompileForEffect(body.GetBody());
+        const size_t none = compiler.NewTemp();
+        compiler.Emit(OpCode::LoadNone, none);
+        compiler.Emit(OpCode::Return, none);
+
+        return function;
+    }
+
+    Module::Module(runtime::Executable& program) {
+        auto* statement = dynamic_cast<ast::Statement*>(&program);
+
+        if (statement == nullptr) {
+            throw runtime_error("only syntax trees can be compiled"s);
+        }
+
+        main_ = Compile(*statement);
+    }
+
+    Function* Module::GetMethodCode(const runtime::Method& method) {
+        auto it = methods_.find(&method);
+
+        if (it == methods_.end()) {
+            unique_ptr<Function> code;
+
+            // Bodies built by hand rather than by the parser stay on the tree walker
+            auto* body = dynamic_cast<ast::MethodBody*>(method.body.get());
+            if (method.frame_size != 0 && body != nullptr) {
+                code = make_unique<Function>(CompileMethod(method, *body));
+            }
+
+            it = methods_.emplace(&method, std::move(code)).first;
+        }
+
+        return it->second.get();
+    }
+
+} // namespace bytecode
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "statement.h"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace bytecode {
+
+    // Instructions of the register machine. A function works on a window of virtual
+    // registers: in a method, the first Method::frame_size registers are its frame
+    // slots (self, the parameters and the local variables), so reading a local costs
+    // no instruction; temporaries follow them. "r[x]" is register x.
+    enum class OpCode : uint8_t {
+        LoadConst,         // r[a] = constants[b]
+        LoadNone,          // r[a] = None
+        Move,              // r[a] = r[b]
+        CheckBound,        // throws if local r[a] has not been assigned yet
+        LoadGlobal,        // r[a] = closure[names[b]]
+        StoreGlobal,       // closure[names[b]] = r[a]
+        LoadField,         // r[a] = r[b].<field_sites[c]>, a non-instance r[b] is copied as it is
+        CheckInstance,     // throws if r[a] is not a class instance
+        StoreField,        // r[a].<field_sites[c]> = r[b]
+        NewInstance,       // r[a] = new classes[c], __init__ gets self in r[b] and count args
+        LookupMethod,      // throws if the call_sites[c] method can't be called on r[b]
+        CallMethod,        // r[a] = r[b].<call_sites[c]>(count args from r[b + 1]), moves them
+        Add,               // r[a] = r[b] + r[c], and so on
+        Sub,
+        Mult,
+        Div,
+        Compare,           // r[a] = r[b] <CompareOp(count)> r[c]
+        Not,               // r[a] = not r[b]
+        Stringify,         // r[a] = str(r[b])
+        ToBool,            // r[a] = IsTrue(r[b])
+        Jump,              // continue at a
+        JumpIfFalse,       // continue at a if r[b] is false
+        JumpIfTrue,        // continue at a if r[b] is true
+        JumpIfNotCompare,  // continue at a unless r[b] <CompareOp(count)> r[c]
+        PrintSpace,
+        PrintValue,        // prints r[a]
+        PrintNewline,
+        Safepoint,         // CycleCollector::Safepoint()
+        Return,            // returns r[a] from the function
+    };
+
+    struct Instruction {
+        OpCode op;
+        // Argument count of NewInstance and CallMethod, CompareOp of the comparisons
+        uint8_t count = 0;
+        uint32_t a = 0;
+        uint32_t b = 0;
+        uint32_t c = 0;
+    };
+
+    struct Function;
+
+    // Field accessed by a LoadField or StoreField instruction
+    struct FieldSite {
+        runtime::Symbol name;
+        ast::FieldCache cache;
+    };
+
+    // Inline cache of a method call instruction, see ast::MethodCall
+    struct CallSite {
+        struct Entry {
+            const runtime::Class* cls;
+            const runtime::Method* method;
+            // nullptr if the body could not be compiled and runs on the tree walker
+            Function* code;
+        };
+
+        static constexpr size_t CACHE_SIZE = 4;
+
+        runtime::Symbol method_name;
+        size_t method_slot;
+        size_t argument_count;
+
+        std::array<Entry, CACHE_SIZE> cache{};
+        size_t cache_size = 0;
+        bool megamorphic = false;
+    };
+
+    // Compiled top-level code or method body
+    struct Function {
+        std::vector<Instruction> code;
+        // Frame slots and temporaries
+        size_t register_count = 0;
+        // Registers holding self and the arguments on entry
+        size_t argument_registers = 0;
+        std::vector<runtime::ObjectHolder> constants;
+        std::vector<runtime::Symbol> names;
+        std::vector<const runtime::Class*> classes;
+        // Caches are updated while the function runs
+        std::vector<FieldSite> field_sites;
+        std::vector<CallSite> call_sites;
+    };
+
+    // Compiled program. Method bodies are compiled on their first call from bytecode.
+    // Constants refer to values inside the tree, which must outlive the module.
+    class Module {
+    public:
+        // Throws std::runtime_error if the tree can't be compiled
+        explicit Module(runtime::Executable& program);
+
+        Function& GetMain() {
+            return main_;
+        }
+
+        // Returns nullptr if the method has no frame slots or its body is not a tree
+        // that can be compiled
+        Function* GetMethodCode(const runtime::Method& method);
+
+    private:
+        Function main_;
+        std::unordered_map<const runtime::Method*, std::unique_ptr<Function>> methods_;
+    };
+
+    // Compiles a statement, the function returns its value
+    Function Compile(ast::Statement& statement);
+
+    // Compiles the body of a method with frame slots; the function returns the value of
+    // its return statement or None
+    Function CompileMethod(const runtime::Method& method, ast::MethodBody& body);
+
+} // namespace bytecode
@@ -0,0 +1,78 @@
+#include "call_stack.h"
+
+using namespace std;
+
+namespace runtime {
+
+    namespace {
+        class UnboundValue : public Object {
+        public:
+            void Print(std::ostream& /* os */, Context& /* context */) override {
+            }
+        };
+
+        UnboundValue unbound_value;
+
+        constexpr size_t INITIAL_STACK_SIZE = 4096;
+
+        thread_local MethodCompiler* current_compiler = nullptr;
+
+        void CountCall(const Method& method) {
+            MethodCompiler* compiler = MethodCompiler::Current();
+
+            // A body that fails to compile is not retried: the count passes the threshold
+            if (compiler != nullptr && ++method.call_count == compiler->GetThreshold()) {
+                method.compiled_body = compiler->Compile(method);
+            }
+        }
+    } // namespace
+
+    CallStack::CallStack()
+        : unbound_(ObjectHolder::Share(unbound_value)) {
+        slots_.reserve(INITIAL_STACK_SIZE);
+    }
+
+    CallStack& CallStack::Get() {
+        thread_local CallStack stack;
+        return stack;
+    }
+
+    CallStack::Frame::Frame(size_t size)
+        : stack_(CallStack::Get())
+        , start_(stack_.slots_.size())
+        , previous_base_(stack_.base_) {
+        stack_.slots_.resize(start_ + size, stack_.unbound_);
+    }
+
+    CallStack::Frame::~Frame() {
+        stack_.base_ = previous_base_;
+        stack_.slots_.resize(start_);
+    }
+
+    MethodCompiler* MethodCompiler::Current() {
+        return current_compiler;
+    }
+
+    MethodCompiler::Scope::Scope(MethodCompiler& compiler)
+        : previous_(current_compiler) {
+        current_compiler = &compiler;
+    }
+
+    MethodCompiler::Scope::~Scope() {
+        current_compiler = previous_;
+    }
+
+    ObjectHolder CallInFrame(const Method& method, CallStack::Frame& frame, Context& context) {
+        frame.Enter();
+
+        if (method.compiled_body == nullptr) {
+            CountCall(method);
+        }
+        Executable& body = method.compiled_body != nullptr ? *method.compiled_body : *method.body;
+
+        // Resolved method bodies do not read the closure; an empty map does not allocate
+        Closure closure;
+        return body.Execute(closure, context);
+    }
+
+} // namespace runtime
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "runtime.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+namespace runtime {
+
+    // Marks variables resolved to the closure rather than to a frame slot
+    constexpr size_t NO_LOCAL_SLOT = static_cast<size_t>(-1);
+
+    // Contiguous stack of method frames. The parser resolves self, the parameters and
+    // the local variables of a method to slots (see Method::frame_size), so a call
+    // reserves a range of the stack instead of building a Closure. The storage only
+    // grows, so calls do not allocate once it has reached the maximum depth.
+    //
+    // Slots are addressed by index: a reference to a slot must not be kept across
+    // anything that can push a frame.
+    class CallStack {
+    public:
+        // Stack of the current thread
+        static CallStack& Get();
+
+        // Slot of the active frame
+        ObjectHolder& Local(size_t slot) {
+            return slots_[base_ + slot];
+        }
+
+        // Locals read before the first assignment hold this marker
+        bool IsUnbound(const ObjectHolder& value) const {
+            return value.Get() == unbound_.Get();
+        }
+
+        // Reserves a frame above the active one. The caller fills the slots (its own
+        // frame is still active, so arguments can be evaluated directly into them) and
+        // then enters the frame. The frame is popped on destruction.
+        class Frame {
+        public:
+            explicit Frame(size_t size);
+            Frame(const Frame&) = delete;
+            Frame& operator=(const Frame&) = delete;
+            ~Frame();
+
+            ObjectHolder& Slot(size_t slot) {
+                return stack_.slots_[start_ + slot];
+            }
+
+            void Enter() {
+                stack_.base_ = start_;
+            }
+
+        private:
+            CallStack& stack_;
+            size_t start_;
+            size_t previous_base_;
+        };
+
+    private:
+        CallStack();
+
+        std::vector<ObjectHolder> slots_;
+        size_t base_ = 0;
+        ObjectHolder unbound_;
+    };
+
+    // Compiles the bodies of hot methods; installed for a run like the cycle collector.
+    // CallInFrame counts the calls of every method with frame slots, whether they come
+    // from a MethodCall node or from ClassInstance::Call, and asks the current compiler
+    // for a body once a method reaches the threshold.
+    class MethodCompiler {
+    public:
+        virtual ~MethodCompiler() = default;
+
+        // Calls after which a method is compiled, at least 1
+        virtual size_t GetThreshold() const = 0;
+
+        // Returns nullptr if the body can't be compiled: the method then keeps running
+        // its tree. The result runs in the frame of the method, like the tree does.
+        virtual std::unique_ptr<Executable> Compile(const Method& method) = 0;
+
+        // Compiler used on this thread, nullptr if none is active
+        static MethodCompiler* Current();
+
+        class Scope {
+        public:
+            explicit Scope(MethodCompiler& compiler);
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+            ~Scope();
+
+        private:
+            MethodCompiler* previous_;
+        };
+    };
+
+    // Runs the method body in a filled frame: slot 0 holds self, the next ones the
+    // arguments
+    ObjectHolder CallInFrame(const Method& method, CallStack::Frame& frame, Context& context);
+
+} // namespace runtime
@@ -0,0 +1,273 @@
+#include "cycle_collector.h"
+
+#include "runtime.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace runtime {
+
+    namespace {
+        thread_local CycleCollector* current_collector = nullptr;
+    } // namespace
+
+    CycleCollector::CycleCollector()
+        : CycleCollector(Settings{}) {
+    }
+
+    CycleCollector::CycleCollector(Settings settings)
+        : settings_(settings)
+        , root_threshold_(settings.root_threshold) {
+    }
+
+    CycleCollector::~CycleCollector() {
+        // Runs may end the Scope before the collector. Instances freed here must still
+        // be deferred to it and leave its candidate buffer when they die.
+        Scope scope(*this);
+
+        FreeAllPending();
+
+        // Freeing garbage may drop the last outside reference to another cycle, which
+        // then shows up as a new candidate
+        while (live_roots_ != 0) {
+            const size_t reclaimed = stats_.reclaimed_objects;
+            Collect();
+            FreeAllPending();
+
+            if (stats_.reclaimed_objects == reclaimed) {
+                break;
+            }
+        }
+
+        for (ClassInstance* instance : roots_) {
+            if (instance != nullptr) {
+                instance->gc_root_index_ = ClassInstance::NO_GC_ROOT;
+            }
+        }
+    }
+
+    size_t CycleCollector::GetRootCount() const {
+        return live_roots_;
+    }
+
+    void CycleCollector::AddPossibleRoot(ClassInstance& instance) {
+        if (instance.gc_root_index_ != ClassInstance::NO_GC_ROOT) {
+            return;
+        }
+
+        instance.gc_root_index_ = static_cast<uint32_t>(roots_.size());
+        roots_.push_back(&instance);
+        ++live_roots_;
+    }
+
+    void CycleCollector::Forget(ClassInstance& instance) {
+        const uint32_t index = instance.gc_root_index_;
+
+        if (index < roots_.size() && roots_[index] == &instance) {
+            roots_[index] = nullptr;
+            --live_roots_;
+        }
+        instance.gc_root_index_ = ClassInstance::NO_GC_ROOT;
+    }
+
+    void CycleCollector::DeferFree(ClassInstance& instance) {
+        // A queued instance is unreachable, trial deletion must not see it
+        if (instance.gc_root_index_ != ClassInstance::NO_GC_ROOT) {
+            Forget(instance);
+        }
+
+        pending_frees_.push_back(&instance);
+        ++stats_.deferred_frees;
+        stats_.max_pending_frees = max(stats_.max_pending_frees, pending_frees_.size());
+    }
+
+    void CycleCollector::FreePending(size_t max_count) {
+        // Freeing an instance releases its fields, which may queue more instances
+        for (size_t freed = 0; freed < max_count && !pending_frees_.empty(); ++freed) {
+            ClassInstance* instance = pending_frees_.back();
+            pending_frees_.pop_back();
+            ObjectHolder::Delete(instance);
+        }
+    }
+
+    void CycleCollector::FreeAllPending() {
+        while (!pending_frees_.empty()) {
+            FreePending(pending_frees_.size());
+        }
+    }
+
+    void CycleCollector::Collect() {
+        const auto start = chrono::steady_clock::now();
+
+        vector<ClassInstance*> roots;
+        roots.reserve(live_roots_);
+        for (ClassInstance* instance : roots_) {
+            if (instance != nullptr) {
+                instance->gc_root_index_ = ClassInstance::NO_GC_ROOT;
+                roots.push_back(instance);
+            }
+        }
+        roots_.clear();
+        live_roots_ = 0;
+
+        MarkGray(roots);
+        Scan(roots);
+        vector<ClassInstance*> garbage = CollectWhite(roots);
+        const size_t reclaimed_bytes = Free(garbage);
+
+        const auto pause = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start);
+        ++stats_.collections;
+        stats_.reclaimed_objects += garbage.size();
+        stats_.reclaimed_bytes += reclaimed_bytes;
+        stats_.total_pause += pause;
+        stats_.max_pause = max(stats_.max_pause, pause);
+
+        root_threshold_ = garbage.empty() ? min(root_threshold_ * 2, settings_.max_root_threshold)
+                                          : settings_.root_threshold;
+    }
+
+    CycleCollector* CycleCollector::Current() {
+        return current_collector;
+    }
+
+    CycleCollector::Scope::Scope(CycleCollector& collector)
+        : previous_(current_collector) {
+        current_collector = &collector;
+    }
+
+    CycleCollector::Scope::~Scope() {
+        current_collector = previous_;
+    }
+
+    template <typename Visitor>
+    void CycleCollector::ForEachChild(ClassInstance& instance, Visitor visitor) {
+        for (size_t slot = 0; slot < instance.fields_.size(); ++slot) {
+            const ObjectHolder& field = instance.fields_.GetSlot(slot);
+
+            if (field.storage_ == ObjectHolder::Storage::Counted && field.data_ != nullptr
+                && field.data_->Kind() == ObjectKind::ClassInstance) {
+                visitor(static_cast<ClassInstance&>(*field.data_));
+            }
+        }
+    }
+
+    // Subtracts the references coming from inside the subgraph reachable from the roots
+    void CycleCollector::MarkGray(vector<ClassInstance*>& roots) {
+        vector<ClassInstance*> stack;
+
+        for (ClassInstance* root : roots) {
+            if (root->gc_color_ == ClassInstance::GcColor::Gray) {
+                continue;
+            }
+
+            root->gc_color_ = ClassInstance::GcColor::Gray;
+            stack.push_back(root);
+
+            while (!stack.empty()) {
+                ClassInstance* instance = stack.back();
+                stack.pop_back();
+
+                ForEachChild(*instance, [&stack](ClassInstance& child) {
+                    --child.ref_count_;
+
+                    if (child.gc_color_ != ClassInstance::GcColor::Gray) {
+                        child.gc_color_ = ClassInstance::GcColor::Gray;
+                        stack.push_back(&child);
+                    }
+                });
+            }
+        }
+    }
+
+    // Instances still referenced from outside are alive along with everything they
+    // reach; the rest is marked white
+    void CycleCollector::Scan(vector<ClassInstance*>& roots) {
+        vector<ClassInstance*> stack(roots.rbegin(), roots.rend());
+
+        while (!stack.empty()) {
+            ClassInstance* instance = stack.back();
+            stack.pop_back();
+
+            if (instance->gc_color_ != ClassInstance::GcColor::Gray) {
+                continue;
+            }
+
+            if (instance->ref_count_ > 0) {
+                ScanBlack(*instance);
+            } else {
+                instance->gc_color_ = ClassInstance::GcColor::White;
+                ForEachChild(*instance, [&stack](ClassInstance& child) {
+                    stack.push_back(&child);
+                });
+            }
+        }
+    }
+
+    // Restores the counts subtracted by MarkGray
+    void CycleCollector::ScanBlack(ClassInstance& instance) {
+        instance.gc_color_ = ClassInstance::GcColor::Black;
+        vector<ClassInstance*> stack{ &instance };
+
+        while (!stack.empty()) {
+            ClassInstance* current = stack.back();
+            stack.pop_back();
+
+            ForEachChild(*current, [&stack](ClassInstance& child) {
+                ++child.ref_count_;
+
+                if (child.gc_color_ != ClassInstance::GcColor::Black) {
+                    child.gc_color_ = ClassInstance::GcColor::Black;
+                    stack.push_back(&child);
+                }
+            });
+        }
+    }
+
+    vector<ClassInstance*> CycleCollector::CollectWhite(vector<ClassInstance*>& roots) {
+        vector<ClassInstance*> garbage;
+        vector<ClassInstance*> stack(roots.rbegin(), roots.rend());
+
+        while (!stack.empty()) {
+            ClassInstance* instance = stack.back();
+            stack.pop_back();
+
+            if (instance->gc_color_ != ClassInstance::GcColor::White) {
+                continue;
+            }
+
+            instance->gc_color_ = ClassInstance::GcColor::Garbage;
+            garbage.push_back(instance);
+            ForEachChild(*instance, [&stack](ClassInstance& child) {
+                stack.push_back(&child);
+            });
+        }
+
+        return garbage;
+    }
+
+    size_t CycleCollector::Free(vector<ClassInstance*>& garbage) {
+        // References between garbage instances were already subtracted, so they are
+        // dropped without touching the counts before anything is destroyed
+        for (ClassInstance* instance : garbage) {
+            for (size_t slot = 0; slot < instance->fields_.size(); ++slot) {
+                ObjectHolder& field = instance->fields_.GetSlot(slot);
+
+                if (field.storage_ == ObjectHolder::Storage::Counted && field.data_ != nullptr
+                    && field.data_->Kind() == ObjectKind::ClassInstance
+                    && static_cast<ClassInstance&>(*field.data_).gc_color_ == ClassInstance::GcColor::Garbage) {
+                    field.data_ = nullptr;
+                }
+            }
+        }
+
+        size_t bytes = 0;
+        for (ClassInstance* instance : garbage) {
+            bytes += sizeof(ClassInstance) + instance->fields_.size() * sizeof(ObjectHolder);
+            DeferFree(*instance);
+        }
+
+        return bytes;
+    }
+
+} // namespace runtime
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+namespace runtime {
+
+    class ClassInstance;
+    class ObjectHolder;
+
+    // Synchronous cycle collector for counted ClassInstances (Bacon and Rajan's trial
+    // deletion). An instance whose reference count drops to a non-zero value may have
+    // become the entry of a garbage cycle and is buffered as a candidate root. Once
+    // enough candidates accumulate, the next safepoint subtracts the references
+    // internal to the subgraph reachable from them; whatever is left without outside
+    // references is garbage and is freed.
+    //
+    // Collections only run at safepoints (between statements), where every live
+    // instance is reachable from a counted holder.
+    //
+    // The collector also defers freeing: an instance whose count drops to zero is
+    // queued instead of being destroyed in place, and the queue is drained in bounded
+    // batches at safepoints. Destroying an instance only releases its own fields, so
+    // dropping a long linked structure neither recurses nor stalls one statement.
+    class CycleCollector {
+    public:
+        struct Settings {
+            // Number of candidate roots that triggers a collection at the next safepoint
+            size_t root_threshold = 4096;
+            // A collection that reclaims nothing doubles the threshold up to this limit,
+            // any reclaimed object resets it to root_threshold
+            size_t max_root_threshold = 1 << 20;
+            // Instances freed from the pending queue at each safepoint
+            size_t free_batch_size = 1024;
+        };
+
+        struct Stats {
+            size_t deferred_frees = 0;
+            size_t max_pending_frees = 0;
+            size_t collections = 0;
+            size_t reclaimed_objects = 0;
+            size_t reclaimed_bytes = 0;
+            std::chrono::nanoseconds total_pause{};
+            std::chrono::nanoseconds max_pause{};
+        };
+
+        CycleCollector();
+        explicit CycleCollector(Settings settings);
+        CycleCollector(const CycleCollector&) = delete;
+        CycleCollector& operator=(const CycleCollector&) = delete;
+        // Frees the pending instances and collects the cycles left over when the run ends
+        ~CycleCollector();
+
+        // Collects now regardless of the threshold
+        void Collect();
+
+        // Frees up to max_count pending instances, including the ones they release
+        void FreePending(size_t max_count);
+        void FreeAllPending();
+
+        size_t GetPendingFreeCount() const {
+            return pending_frees_.size();
+        }
+
+        const Stats& GetStats() const {
+            return stats_;
+        }
+
+        size_t GetRootCount() const;
+
+        // Called by ObjectHolder when a counted instance loses a reference but stays alive
+        void AddPossibleRoot(ClassInstance& instance);
+        // Called by a dying instance that may still be buffered
+        void Forget(ClassInstance& instance);
+        // Called by ObjectHolder when the last reference to a counted instance is gone
+        void DeferFree(ClassInstance& instance);
+
+        // Collector used on this thread, nullptr if none is active
+        static CycleCollector* Current();
+
+        // Frees a batch of pending instances and runs a collection if enough candidates
+        // are buffered
+        static void Safepoint() {
+            CycleCollector* collector = Current();
+            if (collector == nullptr) {
+                return;
+            }
+
+            if (!collector->pending_frees_.empty()) {
+                collector->FreePending(collector->settings_.free_batch_size);
+            }
+            if (collector->roots_.size() >= collector->root_threshold_) {
+                collector->Collect();
+            }
+        }
+
+        class Scope {
+        public:
+            explicit Scope(CycleCollector& collector);
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+            ~Scope();
+
+        private:
+            CycleCollector* previous_;
+        };
+
+    private:
+        template <typename Visitor>
+        static void ForEachChild(ClassInstance& instance, Visitor visitor);
+
+        void MarkGray(std::vector<ClassInstance*>& roots);
+        void Scan(std::vector<ClassInstance*>& roots);
+        static void ScanBlack(ClassInstance& instance);
+        std::vector<ClassInstance*> CollectWhite(std::vector<ClassInstance*>& roots);
+        size_t Free(std::vector<ClassInstance*>& garbage);
+
+        Settings settings_;
+        size_t root_threshold_;
+        // Null entries belong to instances destroyed after being buffered
+        std::vector<ClassInstance*> roots_;
+        size_t live_roots_ = 0;
+        std::vector<ClassInstance*> pending_frees_;
+        Stats stats_;
+    };
+
+} // namespace runtime
@@ -0,0 +1,1161 @@
+#include "jit.h"
+
+#include "statement.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__x86_64__) && defined(__linux__) && !defined(MYTHON_NO_JIT)
+#define MYTHON_JIT_X86_64 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define MYTHON_JIT_X86_64 0
+#endif
+
+using namespace std;
+
+namespace jit {
+
+    using runtime::ObjectHolder;
+
+#if MYTHON_JIT_X86_64
+    namespace {
+        // Temporaries of the running compiled bodies, a window per call on top of the
+        // windows of its callers. Addressed by index: nested calls may grow the vector.
+        // It never shrinks: a window keeps its Numbers for the next call at the same
+        // depth and only the other values are released when the call ends.
+        struct Temporaries {
+            vector<ObjectHolder> values;
+            size_t top = 0;
+        };
+
+        Temporaries& GetTemporaries() {
+            thread_local Temporaries temporaries = [] {
+                Temporaries result;
+                result.values.reserve(4096);
+                return result;
+            }();
+            return temporaries;
+        }
+
+        // Values are passed to the helpers as operands: a temporary index, or a frame
+        // slot or a constant tagged with one of these bits. Locals and constants are read
+        // in place, without a helper call copying them to a temporary.
+        constexpr uint64_t LOCAL_OPERAND = uint64_t{ 1 } << 63;
+        constexpr uint64_t CONSTANT_OPERAND = uint64_t{ 1 } << 62;
+
+        // Passed to the compiled body, which passes it on to every helper
+        struct State {
+            ObjectHolder& Temp(uint64_t index) {
+                return (*temporaries)[base + index];
+            }
+
+            // Throws if the operand is a local read before its first assignment
+            const ObjectHolder& Operand(uint64_t operand) {
+                if (operand & LOCAL_OPERAND) {
+                    const ObjectHolder& local = stack->Local(operand & ~LOCAL_OPERAND);
+
+                    if (stack->IsUnbound(local)) {
+                        throw runtime_error("var is not found");
+                    }
+                    return local;
+                }
+
+                if (operand & CONSTANT_OPERAND) {
+                    return constants[operand & ~CONSTANT_OPERAND];
+                }
+
+                return Temp(operand);
+            }
+
+            // The fast paths of the compiled code address the temporaries and the frame
+            // slots through these pointers. Called on entry and after every helper: a
+            // nested call may move both.
+            void UpdateAddresses() {
+                temps = temporaries->data() + base;
+                locals = &stack->Local(0);
+            }
+
+            vector<ObjectHolder>* temporaries;
+            size_t base;
+            const ObjectHolder* constants;
+            runtime::CallStack* stack;
+            runtime::Closure* closure;
+            runtime::Context* context;
+            ObjectHolder result;
+            exception_ptr error;
+            ObjectHolder* temps;
+            ObjectHolder* locals;
+        };
+
+        // Offsets used by the fast paths, measured on sample objects
+        struct Layout {
+            int32_t temps;
+            int32_t locals;
+            int32_t holder_size;
+            ObjectHolder::NumberLayout number;
+        };
+
+        const Layout& GetLayout() {
+            static const Layout layout = [] {
+                State sample{};
+                const auto offset = [&sample](const void* member) {
+                    return static_cast<int32_t>(static_cast<const char*>(member)
+                                                - reinterpret_cast<const char*>(&sample));
+                };
+
+                return Layout{ offset(&sample.temps), offset(&sample.locals),
+                               static_cast<int32_t>(sizeof(ObjectHolder)), ObjectHolder::GetNumberLayout() };
+            }();
+            return layout;
+        }
+
+        // A helper returns FAILED once it stored the exception it caught; conditions
+        // return 1 when they hold and 0 otherwise, other helpers return 0
+        constexpr int FAILED = -1;
+
+        using Helper = int (*)(State*, uint64_t, uint64_t, uint64_t, uint64_t);
+        using HelperBody = int (*)(State&, uint64_t, uint64_t, uint64_t, uint64_t);
+        using Entry = int (*)(State*);
+
+        template <HelperBody body>
+        int Guarded(State* state, uint64_t a, uint64_t b, uint64_t c, uint64_t d) noexcept {
+            try {
+                const int result = body(*state, a, b, c, d);
+                state->UpdateAddresses();
+                return result;
+            } catch (...) {
+                state->error = current_exception();
+                return FAILED;
+            }
+        }
+
+        // Helpers that run Mython code copy their operands first: a nested call may
+        // reallocate the temporaries and the frame slots.
+
+        int Move(State& state, uint64_t dst, uint64_t src, uint64_t, uint64_t) {
+            state.Temp(dst) = state.Operand(src);
+            return 0;
+        }
+
+        int LoadNone(State& state, uint64_t dst, uint64_t, uint64_t, uint64_t) {
+            state.Temp(dst) = {};
+            return 0;
+        }
+
+        int StoreLocal(State& state, uint64_t slot, uint64_t src, uint64_t, uint64_t) {
+            state.stack->Local(slot) = state.Operand(src);
+            return 0;
+        }
+
+        // The fallback of the nodes without a template
+        int Interpret(State& state, uint64_t dst, uint64_t node, uint64_t, uint64_t) {
+            ObjectHolder value = reinterpret_cast<ast::Statement*>(node)->Execute(*state.closure, *state.context);
+            state.Temp(dst) = std::move(value);
+            return 0;
+        }
+
+        int CheckInstance(State& state, uint64_t object, uint64_t, uint64_t, uint64_t) {
+            if (state.Operand(object).TryAs<runtime::ClassInstance>() == nullptr) {
+                throw runtime_error("fields can be assigned only to class instances"s);
+            }
+            return 0;
+        }
+
+        int StoreField(State& state, uint64_t node, uint64_t object, uint64_t value, uint64_t) {
+            auto& assignment = *reinterpret_cast<ast::FieldAssignment*>(node);
+            assignment.Store(*state.Operand(object).TryAs<runtime::ClassInstance>(), state.Operand(value));
+            return 0;
+        }
+
+        const runtime::Method& FindMethod(ast::MethodCall& call, const ObjectHolder& object) {
+            auto* instance = object.TryAs<runtime::ClassInstance>();
+
+            if (instance == nullptr) {
+                throw runtime_error("methods can be called only on class instances"s);
+            }
+
+            const runtime::Method* method = call.FindMethod(instance->GetClass());
+
+            if (method == nullptr) {
+                throw runtime_error("No method found");
+            }
+
+            return *method;
+        }
+
+        // The tree walker reports a bad receiver before evaluating the arguments
+        int LookupMethod(State& state, uint64_t node, uint64_t object, uint64_t, uint64_t) {
+            FindMethod(*reinterpret_cast<ast::MethodCall*>(node), state.Operand(object));
+            return 0;
+        }
+
+        // The object is an operand, a local is passed without a copy to a temporary.
+        // The arguments are in consecutive temporaries, which are moved from.
+        int CallMethod(State& state, uint64_t dst, uint64_t node, uint64_t object, uint64_t args) {
+            auto& call = *reinterpret_cast<ast::MethodCall*>(node);
+            ObjectHolder self = state.Operand(object);
+            const runtime::Method& method = FindMethod(call, self);
+            const size_t argument_count = call.GetArgs().size();
+            ObjectHolder result;
+
+            if (method.frame_size != 0) {
+                runtime::CallStack::Frame frame(method.frame_size);
+
+                frame.Slot(0) = std::move(self);
+                for (size_t i = 0; i < argument_count; ++i) {
+                    frame.Slot(i + 1) = std::move(state.Temp(args + i));
+                }
+
+                result = runtime::CallInFrame(method, frame, *state.context);
+            } else {
+                vector<ObjectHolder> actual_args;
+
+                for (size_t i = 0; i < argument_count; ++i) {
+                    actual_args.push_back(std::move(state.Temp(args + i)));
+                }
+
+                result = self.TryAs<runtime::ClassInstance>()->Call(method, actual_args, *state.context);
+            }
+
+            state.Temp(dst) = std::move(result);
+            return 0;
+        }
+
+        // int_operation returns false when the numbers have no int64 result, which then
+        // comes from the generic operation
+        template <bool (*int_operation)(int64_t, int64_t, int64_t&),
+                  ObjectHolder (*generic_operation)(const ObjectHolder&, const ObjectHolder&, runtime::Context&)>
+        int Arithmetic(State& state, uint64_t dst, uint64_t lhs, uint64_t rhs, uint64_t) {
+            auto* l_number = state.Operand(lhs).TryAs<runtime::Number>();
+            auto* r_number = state.Operand(rhs).TryAs<runtime::Number>();
+            int64_t result;
+
+            if (l_number != nullptr && r_number != nullptr
+                && int_operation(l_number->GetValue(), r_number->GetValue(), result)) {
+                state.Temp(dst) = runtime::MakeNumber(result);
+                return 0;
+            }
+
+            const ObjectHolder l_value = state.Operand(lhs);
+            const ObjectHolder r_value = state.Operand(rhs);
+            ObjectHolder value = generic_operation(l_value, r_value, *state.context);
+            state.Temp(dst) = std::move(value);
+            return 0;
+        }
+
+        bool AddNumbers(int64_t lhs, int64_t rhs, int64_t& result) {
+            return !__builtin_add_overflow(lhs, rhs, &result);
+        }
+
+        bool SubNumbers(int64_t lhs, int64_t rhs, int64_t& result) {
+            return !__builtin_sub_overflow(lhs, rhs, &result);
+        }
+
+        bool MultNumbers(int64_t lhs, int64_t rhs, int64_t& result) {
+            return !__builtin_mul_overflow(lhs, rhs, &result);
+        }
+
+        bool DivNumbers(int64_t lhs, int64_t rhs, int64_t& result) {
+            // Division by zero and INT64_MIN / -1 are left to runtime::Div
+            if (rhs == 0 || (lhs == numeric_limits<int64_t>::min() && rhs == -1)) {
+                return false;
+            }
+            result = lhs / rhs;
+            return true;
+        }
+
+        bool CompareValues(State& state, uint64_t op, uint64_t lhs, uint64_t rhs) {
+            auto* l_number = state.Operand(lhs).TryAs<runtime::Number>();
+            auto* r_number = state.Operand(rhs).TryAs<runtime::Number>();
+
+            if (l_number != nullptr && r_number != nullptr) {
+                return runtime::ApplyCompareOp(static_cast<runtime::CompareOp>(op), l_number->GetValue(),
+                                               r_number->GetValue());
+            }
+
+            const ObjectHolder l_value = state.Operand(lhs);
+            const ObjectHolder r_value = state.Operand(rhs);
+            return runtime::Compare(static_cast<runtime::CompareOp>(op), l_value, r_value, *state.context);
+        }
+
+        int Compare(State& state, uint64_t dst, uint64_t lhs, uint64_t rhs, uint64_t op) {
+            const bool result = CompareValues(state, op, lhs, rhs);
+            state.Temp(dst) = runtime::MakeBool(result);
+            return 0;
+        }
+
+        // Condition of an if statement that is a comparison
+        int TestCompare(State& state, uint64_t op, uint64_t lhs, uint64_t rhs, uint64_t) {
+            return CompareValues(state, op, lhs, rhs) ? 1 : 0;
+        }
+
+        int Test(State& state, uint64_t src, uint64_t, uint64_t, uint64_t) {
+            return runtime::IsTrue(state.Operand(src)) ? 1 : 0;
+        }
+
+        int ToBool(State& state, uint64_t dst, uint64_t src, uint64_t, uint64_t) {
+            state.Temp(dst) = runtime::MakeBool(runtime::IsTrue(state.Operand(src)));
+            return 0;
+        }
+
+        int Not(State& state, uint64_t dst, uint64_t src, uint64_t, uint64_t) {
+            state.Temp(dst) = runtime::MakeBool(!runtime::IsTrue(state.Operand(src)));
+            return 0;
+        }
+
+        int Stringify(State& state, uint64_t dst, uint64_t src, uint64_t, uint64_t) {
+            const ObjectHolder value = state.Operand(src);
+            ObjectHolder result = runtime::Stringify(value);
+            state.Temp(dst) = std::move(result);
+            return 0;
+        }
+
+        int PrintSpace(State& state, uint64_t, uint64_t, uint64_t, uint64_t) {
+            state.context->GetOutputStream() << " "s;
+            return 0;
+        }
+
+        int PrintValue(State& state, uint64_t src, uint64_t, uint64_t, uint64_t) {
+            if (const ObjectHolder value = state.Operand(src)) {
+                value->Print(state.context->GetOutputStream(), *state.context);
+            } else {
+                state.context->GetOutputStream() << "None"s;
+            }
+            return 0;
+        }
+
+        int PrintNewline(State& state, uint64_t, uint64_t, uint64_t, uint64_t) {
+            state.context->GetOutputStream() << "\n"s;
+            return 0;
+        }
+
+        int Safepoint(State&, uint64_t, uint64_t, uint64_t, uint64_t) {
+            runtime::CycleCollector::Safepoint();
+            return 0;
+        }
+
+        int SetResult(State& state, uint64_t src, uint64_t, uint64_t, uint64_t) {
+            state.result = state.Operand(src);
+            return 0;
+        }
+
+        // Emits the machine code of a compiled body, which is called as
+        // int body(State* state) and returns 1 on success and 0 on an exception. The
+        // state stays in rbx, which the helpers preserve. The fast paths work on int64
+        // values in rax and rdx, with rcx pointing to the holders they access.
+        class Assembler {
+        public:
+            static constexpr size_t NO_POSITION = static_cast<size_t>(-1);
+
+            enum Register : uint8_t { RAX = 0, RCX = 1, RDX = 2 };
+
+            enum class Operation { Add, Sub, Mult };
+
+            struct Label {
+                size_t position = NO_POSITION;
+                // Offsets of the rel32 fields that jump to the label
+                vector<size_t> uses;
+            };
+
+            void Prologue() {
+                Emit({ 0x53 });              // push rbx, which also aligns the stack for calls
+                Emit({ 0x48, 0x89, 0xfb });  // mov rbx, rdi
+            }
+
+            // Calls helper(state, a, b, c, d) and jumps to the failure exit if it
+            // returns FAILED, leaving its result in eax
+            void Call(Helper helper, uint64_t a = 0, uint64_t b = 0, uint64_t c = 0, uint64_t d = 0) {
+                Emit({ 0x48, 0x89, 0xdf });  // mov rdi, rbx
+                LoadArgument(0x06, false, a);  // rsi
+                LoadArgument(0x02, false, b);  // rdx
+                LoadArgument(0x01, false, c);  // rcx
+                LoadArgument(0x00, true, d);   // r8
+                Emit({ 0x48, 0xb8 });          // mov rax, imm64
+                Immediate(reinterpret_cast<uint64_t>(helper), 8);
+                Emit({ 0xff, 0xd0 });  // call rax
+                Emit({ 0x85, 0xc0 });  // test eax, eax
+                Jump({ 0x0f, 0x88 }, failure_);  // js
+            }
+
+            // After a condition helper
+            void JumpIfFalse(Label& label) {
+                Jump({ 0x0f, 0x84 }, label);  // jz
+            }
+
+            void JumpIfTrue(Label& label) {
+                Jump({ 0x0f, 0x85 }, label);  // jnz
+            }
+
+            void Jump(Label& label) {
+                Jump({ 0xe9 }, label);
+            }
+
+            void Return() {
+                Jump(success_);
+            }
+
+            // mov rcx, [rbx + offset]
+            void LoadStatePointer(int32_t offset) {
+                Emit({ 0x48, 0x8b, 0x8b });
+                Immediate(static_cast<uint32_t>(offset), 4);
+            }
+
+            // cmp byte [rcx + offset], value; jne label
+            void JumpIfByteNotEqual(int32_t offset, uint8_t value, Label& label) {
+                Emit({ 0x80, 0xb9 });
+                Immediate(static_cast<uint32_t>(offset), 4);
+                Emit({ value });
+                Jump({ 0x0f, 0x85 }, label);
+            }
+
+            // mov reg, [rcx + offset]
+            void Load(Register reg, int32_t offset) {
+                Emit({ 0x48, 0x8b, static_cast<uint8_t>(0x81 | reg << 3) });
+                Immediate(static_cast<uint32_t>(offset), 4);
+            }
+
+            // mov [rcx + offset], rax
+            void StoreRax(int32_t offset) {
+                Emit({ 0x48, 0x89, 0x81 });
+                Immediate(static_cast<uint32_t>(offset), 4);
+            }
+
+            void LoadImmediate(Register reg, int64_t value) {
+                LoadArgument(reg, false, static_cast<uint64_t>(value));
+            }
+
+            // rax = rax op rdx, jumping to the label if it overflows
+            void Arithmetic(Operation op, Label& overflow) {
+                switch (op) {
+                    case Operation::Add:
+                        Emit({ 0x48, 0x01, 0xd0 });  // add rax, rdx
+                        break;
+                    case Operation::Sub:
+                        Emit({ 0x48, 0x29, 0xd0 });  // sub rax, rdx
+                        break;
+                    case Operation::Mult:
+                        Emit({ 0x48, 0x0f, 0xaf, 0xc2 });  // imul rax, rdx
+                        break;
+                }
+                Jump({ 0x0f, 0x80 }, overflow);  // jo
+            }
+
+            // Leaves 1 in eax if rax op rdx holds and 0 otherwise, with the flags a
+            // condition helper leaves
+            void Compare(runtime::CompareOp op) {
+                static constexpr uint8_t SETCC[] = {
+                    0x94,  // sete, Equal
+                    0x95,  // setne, NotEqual
+                    0x9c,  // setl, Less
+                    0x9f,  // setg, Greater
+                    0x9e,  // setle, LessOrEqual
+                    0x9d,  // setge, GreaterOrEqual
+                };
+
+                Emit({ 0x48, 0x39, 0xd0 });                            // cmp rax, rdx
+                Emit({ 0x0f, SETCC[static_cast<size_t>(op)], 0xc0 });  // setcc al
+                Emit({ 0x0f, 0xb6, 0xc0 });                            // movzx eax, al
+                Emit({ 0x85, 0xc0 });                                  // test eax, eax
+            }
+
+            void Bind(Label& label) {
+                label.position = code_.size();
+
+                for (size_t use : label.uses) {
+                    const auto offset = static_cast<int32_t>(label.position - (use + 4));
+                    memcpy(code_.data() + use, &offset, sizeof(offset));
+                }
+                label.uses.clear();
+            }
+
+            vector<uint8_t> Finish() {
+                Bind(success_);
+                Emit({ 0xb8, 0x01, 0x00, 0x00, 0x00 });  // mov eax, 1
+                Emit({ 0x5b, 0xc3 });                    // pop rbx; ret
+                Bind(failure_);
+                Emit({ 0x31, 0xc0 });  // xor eax, eax
+                Emit({ 0x5b, 0xc3 });  // pop rbx; ret
+                return std::move(code_);
+            }
+
+        private:
+            void Emit(initializer_list<uint8_t> bytes) {
+                code_.insert(code_.end(), bytes);
+            }
+
+            void Immediate(uint64_t value, size_t size) {
+                for (size_t i = 0; i < size; ++i) {
+                    code_.push_back(static_cast<uint8_t>(value >> (8 * i)));
+                }
+            }
+
+            // mov reg, value; the 32-bit form zero-extends and is shorter
+            void LoadArgument(uint8_t reg, bool extended, uint64_t value) {
+                if (value <= numeric_limits<uint32_t>::max()) {
+                    if (extended) {
+                        Emit({ 0x41 });
+                    }
+                    Emit({ static_cast<uint8_t>(0xb8 + reg) });
+                    Immediate(value, 4);
+                } else {
+                    Emit({ static_cast<uint8_t>(extended ? 0x49 : 0x48), static_cast<uint8_t>(0xb8 + reg) });
+                    Immediate(value, 8);
+                }
+            }
+
+            void Jump(initializer_list<uint8_t> opcode, Label& label) {
+                Emit(opcode);
+
+                if (label.position != NO_POSITION) {
+                    Immediate(static_cast<uint32_t>(static_cast<int32_t>(label.position - (code_.size() + 4))), 4);
+                } else {
+                    label.uses.push_back(code_.size());
+                    Immediate(0, 4);
+                }
+            }
+
+            vector<uint8_t> code_;
+            Label success_;
+            Label failure_;
+        };
+
+        // Pages holding the code of a compiled body. They are written first and then
+        // made executable, never both writable and executable.
+        class CodeBuffer {
+        public:
+            explicit CodeBuffer(const vector<uint8_t>& code) {
+                const auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+                size_ = (code.size() + page_size - 1) / page_size * page_size;
+
+                void* memory = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (memory == MAP_FAILED) {
+                    throw runtime_error("can't allocate memory for compiled code"s);
+                }
+
+                memcpy(memory, code.data(), code.size());
+
+                if (mprotect(memory, size_, PROT_READ | PROT_EXEC) != 0) {
+                    munmap(memory, size_);
+                    throw runtime_error("can't make compiled code executable"s);
+                }
+                memory_ = memory;
+            }
+
+            CodeBuffer(const CodeBuffer&) = delete;
+            CodeBuffer& operator=(const CodeBuffer&) = delete;
+
+            ~CodeBuffer() {
+                munmap(memory_, size_);
+            }
+
+            Entry GetEntry() const {
+                return reinterpret_cast<Entry>(memory_);
+            }
+
+        private:
+            void* memory_;
+            size_t size_;
+        };
+
+        class CompiledBody : public runtime::Executable {
+        public:
+            ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override {
+                Temporaries& temporaries = GetTemporaries();
+                const size_t base = temporaries.top;
+
+                // Temporaries start as inline Numbers, which the fast paths overwrite in place
+                if (temporaries.values.size() < base + temp_count) {
+                    temporaries.values.resize(base + temp_count, runtime::MakeNumber(0));
+                }
+                temporaries.top = base + temp_count;
+
+                // Releases the window whether the body returns or throws
+                struct WindowGuard {
+                    ~WindowGuard() {
+                        for (size_t i = base; i < temporaries.top; ++i) {
+                            if (temporaries.values[i].TryAs<runtime::Number>() == nullptr) {
+                                temporaries.values[i] = runtime::MakeNumber(0);
+                            }
+                        }
+                        temporaries.top = base;
+                    }
+
+                    Temporaries& temporaries;
+                    size_t base;
+                } guard{ temporaries, base };
+
+                State state{ &temporaries.values, base, constants.data(), &runtime::CallStack::Get(), &closure, &context,
+                             {},           {},   nullptr,          nullptr };
+                state.UpdateAddresses();
+
+                if (!code->GetEntry()(&state)) {
+                    rethrow_exception(state.error);
+                }
+
+                return std::move(state.result);
+            }
+
+            vector<ObjectHolder> constants;
+            size_t temp_count = 0;
+            unique_ptr<CodeBuffer> code;
+        };
+
+        // Thrown for trees the compiler has no template for, the method then keeps
+        // running on the tree walker
+        class UnsupportedTree : public runtime_error {
+        public:
+            using runtime_error::runtime_error;
+        };
+
+        // Emits the template of every node. A compiled expression leaves its value in
+        // the temporary it is given; temporaries are allocated like a stack and released
+        // once their statement is compiled.
+        class TemplateCompiler : public ast::Visitor {
+        public:
+            static constexpr size_t NO_TEMP = static_cast<size_t>(-1);
+
+            TemplateCompiler(Assembler& assembler, CompiledBody& body)
+                : assembler_(assembler)
+                , body_(body) {
+            }
+
+            // Compiles the statement into the temporary, NO_TEMP discards its value
+            void Compile(ast::Statement& statement, size_t target) {
+                const size_t saved_target = target_;
+                target_ = target;
+                statement.Accept(*this);
+                target_ = saved_target;
+            }
+
+            void CompileForEffect(ast::Statement& statement) {
+                const size_t mark = next_temp_;
+                Compile(statement, NO_TEMP);
+                next_temp_ = mark;
+            }
+
+            // Returns the operand holding the value of the statement: locals and
+            // constants are used in place, other statements are compiled to a temporary
+            uint64_t CompileOperand(ast::Statement& statement) {
+                if (!IsInPlace(statement)) {
+                    const size_t temp = NewTemp();
+                    Compile(statement, temp);
+                    return temp;
+                }
+
+                if (auto* variable = dynamic_cast<ast::VariableValue*>(&statement)) {
+                    return LOCAL_OPERAND | variable->GetLocalSlot();
+                }
+                if (auto* number = dynamic_cast<ast::NumericConst*>(&statement)) {
+                    return AddConstant(runtime::MakeNumber(number->GetValue().GetValue()));
+                }
+                if (auto* number = dynamic_cast<ast::BigNumericConst*>(&statement)) {
+                    return AddConstant(ObjectHolder::Share(number->GetValue()));
+                }
+                if (auto* string = dynamic_cast<ast::StringConst*>(&statement)) {
+                    return AddConstant(ObjectHolder::Share(string->GetValue()));
+                }
+                auto& boolean = static_cast<ast::BoolConst&>(statement);
+                return AddConstant(runtime::MakeBool(boolean.GetValue().GetValue()));
+            }
+
+            void Visit(ast::NumericConst& node) override {
+                CompileMove(node);
+            }
+
+            void Visit(ast::BigNumericConst& node) override {
+                CompileMove(node);
+            }
+
+            void Visit(ast::StringConst& node) override {
+                CompileMove(node);
+            }
+
+            void Visit(ast::BoolConst& node) override {
+                CompileMove(node);
+            }
+
+            void Visit(ast::None& /* node */) override {
+                assembler_.Call(&Guarded<LoadNone>, Target());
+            }
+
+            void Visit(ast::VariableValue& node) override {
+                if (node.GetAccess() == ast::VariableValue::Access::Local) {
+                    CompileMove(node);
+                } else {
+                    EmitInterpret(node);
+                }
+            }
+
+            void Visit(ast::Assignment& node) override {
+                if (node.GetLocalSlot() == runtime::NO_LOCAL_SLOT) {
+                    EmitInterpret(node);
+                    return;
+                }
+
+                const size_t mark = next_temp_;
+                uint64_t value;
+
+                if (target_ != NO_TEMP) {
+                    value = target_;
+                    Compile(node.GetValue(), value);
+                } else {
+                    value = CompileOperand(node.GetValue());
+                }
+
+                const uint64_t local = LOCAL_OPERAND | node.GetLocalSlot();
+                if (IsNumberOperand(value) && IsNumberOperand(local)) {
+                    CallWithFastPath(
+                        [&](Assembler::Label& slow) {
+                            LoadNumber(Assembler::RAX, value, slow);
+                            StoreNumber(local, slow);
+                        },
+                        &Guarded<StoreLocal>, node.GetLocalSlot(), value);
+                } else {
+                    assembler_.Call(&Guarded<StoreLocal>, node.GetLocalSlot(), value);
+                }
+
+                next_temp_ = mark;
+            }
+
+            void Visit(ast::FieldAssignment& node) override {
+                const size_t mark = next_temp_;
+                const uint64_t object = CompileOperand(node.GetObject());
+                uint64_t value;
+
+                assembler_.Call(&Guarded<CheckInstance>, object);
+                if (target_ != NO_TEMP) {
+                    value = target_;
+                    Compile(node.GetValue(), value);
+                } else {
+                    value = CompileOperand(node.GetValue());
+                }
+                assembler_.Call(&Guarded<StoreField>, reinterpret_cast<uint64_t>(&node), object, value);
+
+                next_temp_ = mark;
+            }
+
+            void Visit(ast::NewInstance& node) override {
+                EmitInterpret(node);
+            }
+
+            void Visit(ast::MethodCall& node) override {
+                const auto& args = node.GetArgs();
+                const size_t result = Target();
+                const size_t mark = next_temp_;
+
+                // The arguments take consecutive temporaries, which become the parameters
+                // of the callee. A local object is only read by the helpers; nothing the
+                // arguments run can assign it.
+                const uint64_t object = CompileOperand(node.GetObject());
+                const size_t first_arg = next_temp_;
+                for (size_t i = 0; i < args.size(); ++i) {
+                    NewTemp();
+                }
+
+                const auto call = reinterpret_cast<uint64_t>(&node);
+                if (!args.empty()) {
+                    assembler_.Call(&Guarded<LookupMethod>, call, object);
+                }
+                for (size_t i = 0; i < args.size(); ++i) {
+                    Compile(*args[i], first_arg + i);
+                }
+                assembler_.Call(&Guarded<CallMethod>, result, call, object, first_arg);
+
+                next_temp_ = mark;
+            }
+
+            void Visit(ast::Compound& node) override {
+                RequireStatement();
+
+                for (const auto& statement : node.GetStatements()) {
+                    CompileForEffect(*statement);
+                    assembler_.Call(&Guarded<Safepoint>);
+                }
+            }
+
+            void Visit(ast::Return& node) override {
+                RequireStatement();
+
+                assembler_.Call(&Guarded<SetResult>, CompileOperand(node.GetValue()));
+                assembler_.Return();
+            }
+
+            void Visit(ast::MethodBody& /* node */) override {
+                throw UnsupportedTree("nested method body"s);
+            }
+
+            void Visit(ast::ClassDefinition& node) override {
+                EmitInterpret(node);
+            }
+
+            void Visit(ast::Print& node) override {
+                RequireStatement();
+
+                const auto& args = node.GetArgs();
+                for (size_t i = 0; i < args.size(); ++i) {
+                    if (i != 0) {
+                        assembler_.Call(&Guarded<PrintSpace>);
+                    }
+
+                    const size_t mark = next_temp_;
+                    assembler_.Call(&Guarded<PrintValue>, CompileOperand(*args[i]));
+                    next_temp_ = mark;
+                }
+                assembler_.Call(&Guarded<PrintNewline>);
+            }
+
+            void Visit(ast::Stringify& node) override {
+                CompileUnary(node, &Guarded<Stringify>);
+            }
+
+            void Visit(ast::Add& node) override {
+                CompileArithmetic(node, &Guarded<Arithmetic<AddNumbers, runtime::Add>>, Assembler::Operation::Add);
+            }
+
+            void Visit(ast::Sub& node) override {
+                CompileArithmetic(node, &Guarded<Arithmetic<SubNumbers, runtime::Sub>>, Assembler::Operation::Sub);
+            }
+
+            void Visit(ast::Mult& node) override {
+                CompileArithmetic(node, &Guarded<Arithmetic<MultNumbers, runtime::Mult>>,
+                                  Assembler::Operation::Mult);
+            }
+
+            void Visit(ast::Div& node) override {
+                CompileBinary(node, &Guarded<Arithmetic<DivNumbers, runtime::Div>>);
+            }
+
+            void Visit(ast::Or& node) override {
+                CompileShortCircuit(node, true);
+            }
+
+            void Visit(ast::And& node) override {
+                CompileShortCircuit(node, false);
+            }
+
+            void Visit(ast::Not& node) override {
+                CompileUnary(node, &Guarded<Not>);
+            }
+
+            void VisitComparison(ast::BinaryOperation& node, runtime::CompareOp op) override {
+                CompileBinary(node, &Guarded<Compare>, static_cast<uint64_t>(op));
+            }
+
+            void Visit(ast::IfElse& node) override {
+                RequireStatement();
+
+                Assembler::Label to_else;
+                CompileCondition(node.GetCondition());
+                assembler_.JumpIfFalse(to_else);
+
+                CompileForEffect(node.GetIfBody());
+
+                if (node.GetElseBody() != nullptr) {
+                    Assembler::Label to_end;
+                    assembler_.Jump(to_end);
+                    assembler_.Bind(to_else);
+                    CompileForEffect(*node.GetElseBody());
+                    assembler_.Bind(to_end);
+                } else {
+                    assembler_.Bind(to_else);
+                }
+            }
+
+            size_t GetTempCount() const {
+                return temp_count_;
+            }
+
+        private:
+            size_t NewTemp() {
+                const size_t temp = next_temp_++;
+                temp_count_ = max(temp_count_, next_temp_);
+                return temp;
+            }
+
+            static bool IsInPlace(ast::Statement& statement) {
+                if (auto* variable = dynamic_cast<ast::VariableValue*>(&statement)) {
+                    return variable->GetAccess() == ast::VariableValue::Access::Local;
+                }
+
+                return dynamic_cast<ast::NumericConst*>(&statement) != nullptr
+                    || dynamic_cast<ast::BigNumericConst*>(&statement) != nullptr
+                    || dynamic_cast<ast::StringConst*>(&statement) != nullptr
+                    || dynamic_cast<ast::BoolConst*>(&statement) != nullptr;
+            }
+
+            // Temporary receiving the value of the node, a scratch one when it is discarded
+            size_t Target() {
+                return target_ != NO_TEMP ? target_ : NewTemp();
+            }
+
+            // Statements are only compiled where their value is not used
+            void RequireStatement() const {
+                if (target_ != NO_TEMP) {
+                    throw UnsupportedTree("statement used as a value"s);
+                }
+            }
+
+            uint64_t AddConstant(ObjectHolder value) {
+                body_.constants.push_back(std::move(value));
+                return CONSTANT_OPERAND | (body_.constants.size() - 1);
+            }
+
+            // Copies a local or a constant to the target
+            void CompileMove(ast::Statement& node) {
+                const uint64_t target = Target();
+                const uint64_t source = CompileOperand(node);
+
+                if (IsNumberOperand(source) && IsNumberOperand(target)) {
+                    CallWithFastPath(
+                        [&](Assembler::Label& slow) {
+                            LoadNumber(Assembler::RAX, source, slow);
+                            StoreNumber(target, slow);
+                        },
+                        &Guarded<Move>, target, source);
+                } else {
+                    assembler_.Call(&Guarded<Move>, target, source);
+                }
+            }
+
+            // Fast paths handle inline Numbers natively and jump to the label they are
+            // given for anything else, which the helper then handles. They apply to the
+            // Number constants and to the slots and temporaries a 32-bit displacement
+            // reaches.
+            bool IsNumberOperand(uint64_t operand) const {
+                if (operand & CONSTANT_OPERAND) {
+                    return body_.constants[operand & ~CONSTANT_OPERAND].TryAs<runtime::Number>() != nullptr;
+                }
+                return (operand & ~LOCAL_OPERAND) < MAX_DIRECT_INDEX;
+            }
+
+            template <typename FastPath>
+            void CallWithFastPath(FastPath fast_path, Helper helper, uint64_t a, uint64_t b = 0, uint64_t c = 0,
+                                  uint64_t d = 0) {
+                Assembler::Label slow;
+                Assembler::Label done;
+
+                fast_path(slow);
+                assembler_.Jump(done);
+                assembler_.Bind(slow);
+                assembler_.Call(helper, a, b, c, d);
+                assembler_.Bind(done);
+            }
+
+            // Points rcx to the slots or the temporaries and returns the displacement of
+            // the operand from there
+            int32_t AddressOperand(uint64_t operand) {
+                assembler_.LoadStatePointer(operand & LOCAL_OPERAND ? layout_.locals : layout_.temps);
+                return static_cast<int32_t>((operand & ~LOCAL_OPERAND) * layout_.holder_size);
+            }
+
+            void LoadNumber(Assembler::Register reg, uint64_t operand, Assembler::Label& slow) {
+                if (operand & CONSTANT_OPERAND) {
+                    const auto* number = body_.constants[operand & ~CONSTANT_OPERAND].TryAs<runtime::Number>();
+                    assembler_.LoadImmediate(reg, number->GetValue());
+                    return;
+                }
+
+                const int32_t holder = AddressOperand(operand);
+                assembler_.JumpIfByteNotEqual(holder + static_cast<int32_t>(layout_.number.tag_offset),
+                                              layout_.number.number_tag, slow);
+                assembler_.Load(reg, holder + static_cast<int32_t>(layout_.number.value_offset));
+            }
+
+            // Stores rax to an operand that holds an inline Number: any other value would
+            // have to be released first
+            void StoreNumber(uint64_t operand, Assembler::Label& slow) {
+                const int32_t holder = AddressOperand(operand);
+                assembler_.JumpIfByteNotEqual(holder + static_cast<int32_t>(layout_.number.tag_offset),
+                                              layout_.number.number_tag, slow);
+                assembler_.StoreRax(holder + static_cast<int32_t>(layout_.number.value_offset));
+            }
+
+            // The fallback for nodes without a template
+            void EmitInterpret(ast::Statement& node) {
+                assembler_.Call(&Guarded<Interpret>, Target(), reinterpret_cast<uint64_t>(&node));
+            }
+
+            // Leaves 1 in eax if the condition holds, 0 otherwise. Comparisons are tested
+            // on their operands without materializing a Bool.
+            void CompileCondition(ast::Statement& condition) {
+                const size_t mark = next_temp_;
+
+                if (auto op = ast::GetCompareOp(condition)) {
+                    auto& comparison = static_cast<ast::BinaryOperation&>(condition);
+                    const auto [lhs, rhs] = CompileOperands(comparison);
+
+                    if (IsNumberOperand(lhs) && IsNumberOperand(rhs)) {
+                        CallWithFastPath(
+                            [&, lhs = lhs, rhs = rhs](Assembler::Label& slow) {
+                                LoadNumber(Assembler::RAX, lhs, slow);
+                                LoadNumber(Assembler::RDX, rhs, slow);
+                                assembler_.Compare(*op);
+                            },
+                            &Guarded<TestCompare>, static_cast<uint64_t>(*op), lhs, rhs);
+                    } else {
+                        assembler_.Call(&Guarded<TestCompare>, static_cast<uint64_t>(*op), lhs, rhs);
+                    }
+                } else {
+                    assembler_.Call(&Guarded<Test>, CompileOperand(condition));
+                }
+
+                next_temp_ = mark;
+            }
+
+            pair<uint64_t, uint64_t> CompileOperands(ast::BinaryOperation& node) {
+                if (node.GetLhs() == nullptr || node.GetRhs() == nullptr) {
+                    throw UnsupportedTree("null operands are not supported"s);
+                }
+
+                // A local lhs is read, and checked to be assigned, before the code of the
+                // rhs runs
+                uint64_t lhs;
+                if (IsInPlace(*node.GetRhs())) {
+                    lhs = CompileOperand(*node.GetLhs());
+                } else {
+                    lhs = NewTemp();
+                    Compile(*node.GetLhs(), lhs);
+                }
+
+                const uint64_t rhs = CompileOperand(*node.GetRhs());
+                return { lhs, rhs };
+            }
+
+            void CompileUnary(ast::UnaryOperation& node, Helper helper) {
+                if (node.GetArgument() == nullptr) {
+                    throw UnsupportedTree("null operands are not supported"s);
+                }
+
+                const size_t result = Target();
+                const size_t mark = next_temp_;
+
+                assembler_.Call(helper, result, CompileOperand(*node.GetArgument()));
+                next_temp_ = mark;
+            }
+
+            void CompileArithmetic(ast::BinaryOperation& node, Helper helper, Assembler::Operation op) {
+                const size_t result = Target();
+                const size_t mark = next_temp_;
+                const auto [lhs, rhs] = CompileOperands(node);
+
+                if (IsNumberOperand(lhs) && IsNumberOperand(rhs) && IsNumberOperand(result)) {
+                    CallWithFastPath(
+                        [&, lhs = lhs, rhs = rhs](Assembler::Label& slow) {
+                            LoadNumber(Assembler::RAX, lhs, slow);
+                            LoadNumber(Assembler::RDX, rhs, slow);
+                            assembler_.Arithmetic(op, slow);
+                            StoreNumber(result, slow);
+                        },
+                        helper, result, lhs, rhs);
+                } else {
+                    assembler_.Call(helper, result, lhs, rhs);
+                }
+                next_temp_ = mark;
+            }
+
+            void CompileBinary(ast::BinaryOperation& node, Helper helper, uint64_t op = 0) {
+                const size_t result = Target();
+                const size_t mark = next_temp_;
+                const auto [lhs, rhs] = CompileOperands(node);
+
+                assembler_.Call(helper, result, lhs, rhs, op);
+                next_temp_ = mark;
+            }
+
+            // lhs or rhs: test lhs, jump if true to L, result = bool(rhs), jump to end,
+            // L: result = True
+            void CompileShortCircuit(ast::BinaryOperation& node, bool decided_value) {
+                if (node.GetLhs() == nullptr || node.GetRhs() == nullptr) {
+                    throw UnsupportedTree("null operands are not supported"s);
+                }
+
+                const size_t result = Target();
+                const size_t mark = next_temp_;
+                Assembler::Label to_decided;
+                Assembler::Label to_end;
+
+                assembler_.Call(&Guarded<Test>, CompileOperand(*node.GetLhs()));
+                if (decided_value) {
+                    assembler_.JumpIfTrue(to_decided);
+                } else {
+                    assembler_.JumpIfFalse(to_decided);
+                }
+
+                assembler_.Call(&Guarded<ToBool>, result, CompileOperand(*node.GetRhs()));
+                assembler_.Jump(to_end);
+
+                assembler_.Bind(to_decided);
+                assembler_.Call(&Guarded<Move>, result, AddConstant(runtime::MakeBool(decided_value)));
+                assembler_.Bind(to_end);
+
+                next_temp_ = mark;
+            }
+
+            static constexpr uint64_t MAX_DIRECT_INDEX = uint64_t{ 1 } << 20;
+
+            Assembler& assembler_;
+            CompiledBody& body_;
+            const Layout& layout_ = GetLayout();
+            size_t target_ = NO_TEMP;
+            size_t next_temp_ = 0;
+            size_t temp_count_ = 0;
+        };
+    } // namespace
+
+    bool Compiler::IsSupported() {
+        return true;
+    }
+
+    unique_ptr<runtime::Executable> Compiler::Compile(const runtime::Method& method) {
+        auto* tree = dynamic_cast<ast::MethodBody*>(method.body.get());
+
+        // Only bodies working on frame slots can run from the frame of CallInFrame
+        if (tree == nullptr || method.frame_size == 0) {
+            ++stats_.rejected_methods;
+            return nullptr;
+        }
+
+        auto body = make_unique<CompiledBody>();
+        Assembler assembler;
+        vector<uint8_t> code;
+
+        try {
+            TemplateCompiler compiler(assembler, *body);
+
+            assembler.Prologue();
+            compiler.CompileForEffect(tree->GetBody());
+            body->temp_count = compiler.GetTempCount();
+            code = assembler.Finish();
+            body->code = make_unique<CodeBuffer>(code);
+        } catch (const runtime_error&) {
+            ++stats_.rejected_methods;
+            return nullptr;
+        }
+
+        ++stats_.compiled_methods;
+        stats_.code_bytes += code.size();
+        return body;
+    }
+#else
+    bool Compiler::IsSupported() {
+        return false;
+    }
+
+    unique_ptr<runtime::Executable> Compiler::Compile(const runtime::Method& /* method */) {
+        ++stats_.rejected_methods;
+        return nullptr;
+    }
+#endif
+
+    Compiler::Compiler(size_t threshold)
+        : threshold_(max<size_t>(threshold, 1)) {
+    }
+
+} // namespace jit
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "call_stack.h"
+
+#include <cstddef>
+#include <memory>
+
+namespace jit {
+
+    // Baseline compiler of hot method bodies to x86-64 machine code. Every node type
+    // has a template: a short native sequence that passes the operands of the node to
+    // a helper function and checks its status, so the compiled body runs the tree
+    // without virtual dispatch or recursion. Values live in temporaries beside the
+    // frame of the method; helpers catch exceptions and the compiled body rethrows
+    // them on return, so no exception unwinds through native code. Additions,
+    // subtractions, multiplications, comparisons in conditions and copies of inline
+    // Numbers run natively on the slots and temporaries and only call their helper
+    // for other values or on overflow.
+    //
+    // Nodes without a template (instance creation, global variables, dotted names)
+    // fall back to the tree walker from within the compiled body. Elsewhere than
+    // x86-64 Linux, or with MYTHON_NO_JIT defined, no method is compiled.
+    class Compiler : public runtime::MethodCompiler {
+    public:
+        static constexpr size_t DEFAULT_THRESHOLD = 1000;
+
+        struct Stats {
+            size_t compiled_methods = 0;
+            // Bodies that could not be compiled
+            size_t rejected_methods = 0;
+            size_t code_bytes = 0;
+        };
+
+        explicit Compiler(size_t threshold = DEFAULT_THRESHOLD);
+
+        size_t GetThreshold() const override {
+            return threshold_;
+        }
+
+        std::unique_ptr<runtime::Executable> Compile(const runtime::Method& method) override;
+
+        const Stats& GetStats() const {
+            return stats_;
+        }
+
+        // False if this build can't generate native code
+        static bool IsSupported();
+
+    private:
+        size_t threshold_;
+        Stats stats_;
+    };
+
+} // namespace jit
@@ -0,0 +1,234 @@
+#include "jit.h"
+#include "parse.h"
+#include "statement.h"
+#include "test_runner_p.h"
+
+using namespace std;
+
+namespace parse {
+    unique_ptr<ast::Statement> ParseProgramFromString(const string& program);
+}  // namespace parse
+
+namespace jit {
+
+    using parse::ParseProgramFromString;
+    using runtime::Closure;
+
+    namespace {
+        const runtime::Method& GetMethod(Closure& closure, const string& cls, const string& method) {
+            return *closure.at(cls).TryAs<runtime::Class>()->GetMethod(method);
+        }
+
+        void TestHotMethods() {
+            const string program = R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+  def once():
+    return self.calc(20)
+
+f = Fib()
+print f.once()
+)"s;
+
+            runtime::DummyContext context;
+            Closure closure;
+            auto tree = ParseProgramFromString(program);
+
+            Compiler compiler(10);
+            {
+                runtime::MethodCompiler::Scope scope(compiler);
+                tree->Execute(closure, context);
+            }
+
+            ASSERT_EQUAL(context.output.str(), "6765\n"s);
+
+            const auto& calc = GetMethod(closure, "Fib"s, "calc"s);
+            const auto& once = GetMethod(closure, "Fib"s, "once"s);
+            ASSERT_EQUAL(once.call_count, 1U);
+            ASSERT(once.compiled_body == nullptr);
+
+            if (!Compiler::IsSupported()) {
+                ASSERT(calc.compiled_body == nullptr);
+                return;
+            }
+
+            // Counting stops once the method is compiled
+            ASSERT_EQUAL(calc.call_count, 10U);
+            ASSERT(calc.compiled_body != nullptr);
+            ASSERT_EQUAL(compiler.GetStats().compiled_methods, 1U);
+            ASSERT(compiler.GetStats().code_bytes > 0);
+
+            // The compiled body stays with the method after the compiler is gone
+            auto again = ParseProgramFromString("print f.calc(10)\n"s);
+            again->Execute(closure, context);
+            ASSERT_EQUAL(context.output.str(), "6765\n55\n"s);
+        }
+
+        void TestFallbackNodes() {
+            const string program = R"(
+class Point:
+  def __init__(x, y):
+    self.x = x
+    self.y = y
+
+  def __str__():
+    return '(' + str(self.x) + ', ' + str(self.y) + ')'
+
+  def __add__(other):
+    return self.x + other.x
+
+class Ops:
+  def run(a, b):
+    p = Point(a, b)
+    q = Point(p + Point(1, 1), b + 1)
+    q.x = q.x * 10
+    print p, q, q.y, str(a / b) + '!'
+    if not (a < b or a == b) and b != 0:
+      print 'greater', a - b
+    else:
+      print 'not greater'
+    return q
+
+o = Ops()
+print o.run(7, 2)
+r = o.run(1, 2)
+print r.x
+)"s;
+
+            runtime::DummyContext context;
+            Closure closure;
+            auto tree = ParseProgramFromString(program);
+
+            Compiler compiler(1);
+            runtime::MethodCompiler::Scope scope(compiler);
+            tree->Execute(closure, context);
+
+            ASSERT_EQUAL(context.output.str(), "(7, 2) (80, 3) 3 3!\ngreater 5\n(80, 3)\n"
+                                               "(1, 2) (20, 3) 3 0!\nnot greater\n20\n"s);
+            if (Compiler::IsSupported()) {
+                ASSERT(GetMethod(closure, "Ops"s, "run"s).compiled_body != nullptr);
+                ASSERT(GetMethod(closure, "Point"s, "__str__"s).compiled_body != nullptr);
+            }
+        }
+
+        void TestNumberFastPaths() {
+            const string program = R"(
+class Calc:
+  def mix(a, b):
+    x = a + b
+    y = x * b - a
+    if x < y:
+      x = 'less'
+    else:
+      x = x - 1
+    return x
+
+  def min(a, b):
+    if a < b:
+      return a
+    return b
+
+c = Calc()
+print c.mix(1, 2), c.mix(9223372036854775807, 1), c.mix(-3, 4)
+print c.min('b', 'a'), c.min(2, 5), c.min(9223372036854775808, 1), c.min(-1, 9223372036854775808)
+)"s;
+
+            runtime::DummyContext context;
+            Closure closure;
+            auto tree = ParseProgramFromString(program);
+
+            // Overflows, BigNumbers and strings leave the native int64 code for the helpers
+            Compiler compiler(1);
+            runtime::MethodCompiler::Scope scope(compiler);
+            tree->Execute(closure, context);
+
+            ASSERT_EQUAL(context.output.str(), "less 9223372036854775807 less\na 2 1 -1\n"s);
+        }
+
+        void TestErrors() {
+            const string program = R"(
+class Thrower:
+  def depth(n):
+    if n == 0:
+      return 1 / n
+    return 1 + self.depth(n - 1)
+
+  def unbound(flag):
+    if flag:
+      x = 1
+    return x
+
+  def call_on(obj):
+    return obj.get(1)
+
+  def loud():
+    print 'called'
+    return 1
+
+  def order(flag):
+    if flag:
+      y = 1
+    return y + self.loud()
+
+t = Thrower()
+)"s;
+
+            runtime::DummyContext context;
+            Closure closure;
+            auto tree = ParseProgramFromString(program);
+
+            Compiler compiler(1);
+            runtime::MethodCompiler::Scope scope(compiler);
+            tree->Execute(closure, context);
+
+            // Exceptions leave the compiled bodies through their callers, which release
+            // their temporaries, so the methods can be called again
+            auto failing = ParseProgramFromString("print t.depth(10)\n"s);
+            ASSERT_THROWS(failing->Execute(closure, context), std::runtime_error);
+            ASSERT_THROWS(failing->Execute(closure, context), std::runtime_error);
+
+            auto unbound = ParseProgramFromString("print t.unbound(False)\n"s);
+            ASSERT_THROWS(unbound->Execute(closure, context), std::runtime_error);
+
+            auto not_instance = ParseProgramFromString("print t.call_on(5)\n"s);
+            ASSERT_THROWS(not_instance->Execute(closure, context), std::runtime_error);
+
+            auto no_method = ParseProgramFromString("print t.call_on(t)\n"s);
+            ASSERT_THROWS(no_method->Execute(closure, context), std::runtime_error);
+
+            // Like the tree walker, the unassigned lhs fails before the rhs is evaluated
+            auto order = ParseProgramFromString("print t.order(False)\n"s);
+            ASSERT_THROWS(order->Execute(closure, context), std::runtime_error);
+            ASSERT_EQUAL(context.output.str(), ""s);
+
+            auto passing = ParseProgramFromString("print t.order(True)\n"s);
+            passing->Execute(closure, context);
+            ASSERT_EQUAL(context.output.str(), "called\n2\n"s);
+        }
+
+        void TestRejectedMethods() {
+            // A method built by hand has no frame slots and always runs its tree
+            vector<runtime::Method> methods;
+            methods.push_back({ "get"s, {}, make_unique<ast::NumericConst>(1) });
+            runtime::Class cls("C"s, std::move(methods), nullptr);
+
+            Compiler compiler;
+            ASSERT(compiler.Compile(*cls.GetMethod("get"s)) == nullptr);
+            ASSERT_EQUAL(compiler.GetStats().rejected_methods, 1U);
+            ASSERT_EQUAL(compiler.GetThreshold(), Compiler::DEFAULT_THRESHOLD);
+        }
+    } // namespace
+
+    void RunJitTests(TestRunner& tr) {
+        RUN_TEST(tr, jit::TestHotMethods);
+        RUN_TEST(tr, jit::TestFallbackNodes);
+        RUN_TEST(tr, jit::TestNumberFastPaths);
+        RUN_TEST(tr, jit::TestErrors);
+        RUN_TEST(tr, jit::TestRejectedMethods);
+    }
+
+} // namespace jit
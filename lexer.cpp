@@ -22,6 +22,9 @@ namespace parse {
         if (lhs.Is<Number>()) {
             return lhs.As<Number>().value == rhs.As<Number>().value;
         }
+        if (lhs.Is<BigNumber>()) {
+            return lhs.As<BigNumber>().value == rhs.As<BigNumber>().value;
+        }
         if (lhs.Is<String>()) {
             return lhs.As<String>().value == rhs.As<String>().value;
         }
@@ -42,6 +45,7 @@ namespace parse {
     if (auto p = rhs.TryAs<type>()) return os << #type << '{' << p->value << '}';
 
         VALUED_OUTPUT(Number);
+        VALUED_OUTPUT(BigNumber);
         VALUED_OUTPUT(Id);
         VALUED_OUTPUT(String);
         VALUED_OUTPUT(Char);
@@ -264,7 +268,22 @@ namespace parse {
 
     void Lexer::AddNumberLexem(const std::string& s)
     {
-        token_type::Number token{ std::stoi(s) };
+        int64_t value = 0;
+        const auto result = std::from_chars(s.data(), s.data() + s.size(), value);
+
+        if (result.ec == std::errc::invalid_argument)
+        {
+            throw LexerError("Invalid number literal: "s + s);
+        }
+
+        // Literals above INT64_MAX are kept as digits and become BigNumber constants
+        if (result.ec == std::errc::result_out_of_range)
+        {
+            tokens_.emplace_back(token_type::BigNumber{ s });
+            return;
+        }
+
+        token_type::Number token{ value };
         tokens_.emplace_back(token);
     }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <iosfwd>
 #include <optional>
 #include <sstream>
@@ -12,7 +13,7 @@ namespace parse {
 
     namespace token_type {
 
-        struct Number { int value; };           // 0 number lexeme
+        struct Number { int64_t value; };       // 0 number lexeme
         struct Id { std::string value; };       // 1 id lexeme
         struct Char { char value; };            // 2 character lexeme
         struct String { std::string value; };   // 3 string lexeme
@@ -36,6 +37,7 @@ namespace parse {
         struct True {};                         // 21 True-lexeme
         struct False {};                        // 22 False-lexeme
         struct Eof {};                          // 23 end of file lexeme
+        struct BigNumber { std::string value; };  // 24 number lexeme above INT64_MAX, its digits
 
     }  // namespace token_type
 
@@ -45,7 +47,8 @@ namespace parse {
         token_type::Def, token_type::Newline, token_type::Print, token_type::Indent,
         token_type::Dedent, token_type::And, token_type::Or, token_type::Not,
         token_type::Eq, token_type::NotEq, token_type::LessOrEq, token_type::GreaterOrEq,
-        token_type::None, token_type::True, token_type::False, token_type::Eof>;
+        token_type::None, token_type::True, token_type::False, token_type::Eof,
+        token_type::BigNumber>;
 
     struct Token : TokenBase {
         using TokenBase::TokenBase;
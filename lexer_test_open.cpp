@@ -48,6 +48,12 @@ namespace parse {
             ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{ 15 }));
             ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Char{ '-' }));
             ASSERT_EQUAL(lexer.NextToken(), Token(token_type::Number{ 53 }));
+
+            istringstream big_input("9223372036854775807 9223372036854775808"s);
+            Lexer big_lexer(big_input);
+
+            ASSERT_EQUAL(big_lexer.CurrentToken(), Token(token_type::Number{ INT64_MAX }));
+            ASSERT_EQUAL(big_lexer.NextToken(), Token(token_type::BigNumber{ "9223372036854775808"s }));
         }
 
         void TestIds() {
@@ -1,11 +1,20 @@
-﻿#include "lexer.h"
+﻿#include "aot.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "lexer.h"
 #include "parse.h"
 #include "runtime.h"
 #include "statement.h"
 #include "test_runner_p.h"
+#include "vm.h"
 
+#include <chrono>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <string_view>
+#include <utility>
 
 using namespace std;
 
@@ -22,17 +31,160 @@ namespace runtime {
     void RunObjectsTests(TestRunner& tr);
 }  // namespace runtime
 
+namespace vm {
+    void RunVmTests(TestRunner& tr);
+}  // namespace vm
+
+namespace jit {
+    void RunJitTests(TestRunner& tr);
+}  // namespace jit
+
+namespace aot {
+    void RunAotTests(TestRunner& tr);
+}  // namespace aot
+
 void TestParseProgram(TestRunner& tr);
 
 namespace {
 
-    void RunMythonProgram(istream& input, ostream& output) {
+    void ReportStats(const runtime::CycleCollector& collector) {
+        const auto& gc = collector.GetStats();
+        cerr << "cycle collector: " << gc.collections << " collections, " << gc.reclaimed_objects
+             << " objects (" << gc.reclaimed_bytes << " bytes) reclaimed, pause total "
+             << chrono::duration_cast<chrono::microseconds>(gc.total_pause).count() << " us, max "
+             << chrono::duration_cast<chrono::microseconds>(gc.max_pause).count() << " us" << endl;
+        cerr << "deferred frees: " << gc.deferred_frees << ", max pending " << gc.max_pending_frees << endl;
+    }
+
+    enum class Engine {
+        TreeWalker,
+        Bytecode,
+        // The tree walker with hot methods compiled to machine code
+        Jit,
+    };
+
+    void RunMythonProgram(istream& input, ostream& output, Engine engine = Engine::TreeWalker,
+                          vm::Stats* vm_stats = nullptr) {
+        // Runtime objects of the run are allocated from the arena and released in bulk
+        // at the end, so it must outlive the program and the closure
+        runtime::Arena arena;
+        runtime::Arena::Scope arena_scope(arena);
+        // Declared after the arena: collects the cycles left when the run ends
+        runtime::CycleCollector collector;
+        runtime::CycleCollector::Scope collector_scope(collector);
+
         parse::Lexer lexer(input);
         auto program = ParseProgram(lexer);
 
         runtime::SimpleContext context{ output };
-        runtime::Closure closure;
-        program->Execute(closure, context);
+        {
+            runtime::Closure closure;
+
+            if (engine == Engine::Bytecode) {
+                bytecode::Module module(*program);
+                vm::Run(module, closure, context, vm_stats);
+            } else if (engine == Engine::Jit) {
+                jit::Compiler compiler;
+                runtime::MethodCompiler::Scope compiler_scope(compiler);
+                program->Execute(closure, context);
+            } else {
+                program->Execute(closure, context);
+            }
+        }
+
+        if (getenv("MYTHON_STATS") != nullptr) {
+            collector.Collect();
+            ReportStats(collector);
+        }
+    }
+
+    // C++ translation unit of the program, see aot::Translate
+    string TranslateMythonProgram(istream& input) {
+        parse::Lexer lexer(input);
+        auto program = ParseProgram(lexer);
+
+        return aot::Translate(*program);
+    }
+
+    // Method-call-heavy programs timed by --bench
+    struct Benchmark {
+        string_view name;
+        string_view program;
+        size_t calls;
+    };
+
+    const Benchmark BENCHMARKS[] = {
+        { "recursive fib(25)"sv, R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+f = Fib()
+print f.calc(25)
+)"sv, 242785 },
+        { "early returns"sv, R"(
+class Walker:
+  def __init__():
+    self.steps = 0
+
+  def walk(n):
+    if n == 0:
+      return 0
+    self.steps = self.steps + 1
+    if n > 1000000:
+      return -1
+    return self.walk(n - 1) + self.check(n)
+
+  def check(n):
+    if n < 0:
+      return 1
+    return 0
+
+w = Walker()
+print w.walk(5000) + w.walk(5000) + w.walk(5000)
+)"sv, 30003 },
+    };
+
+    // Times are the best of several runs. All engines are also reported per operation,
+    // counting the instructions the register VM dispatches for the program.
+    void RunBenchmarks(ostream& output) {
+        constexpr int RUNS = 5;
+        const pair<Engine, string_view> engines[] = {
+            { Engine::TreeWalker, "tree walker"sv },
+            { Engine::Bytecode, "bytecode"sv },
+            { Engine::Jit, "jit"sv },
+        };
+
+        for (const auto& benchmark : BENCHMARKS) {
+            vm::Stats stats;
+            {
+                istringstream input{ string(benchmark.program) };
+                ostringstream program_output;
+                RunMythonProgram(input, program_output, Engine::Bytecode, &stats);
+            }
+
+            for (const auto& [engine, engine_name] : engines) {
+                auto best = chrono::nanoseconds::max();
+
+                for (int run = 0; run < RUNS; ++run) {
+                    istringstream input{ string(benchmark.program) };
+                    ostringstream program_output;
+
+                    const auto start = chrono::steady_clock::now();
+                    RunMythonProgram(input, program_output, engine);
+                    best = min(best, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start));
+                }
+
+                const double seconds = chrono::duration<double>(best).count();
+                output << benchmark.name << " (" << engine_name << "): "
+                       << chrono::duration_cast<chrono::microseconds>(best).count() << " us, "
+                       << static_cast<size_t>(benchmark.calls / seconds) << " calls/s, "
+                       << seconds * 1e9 / stats.instructions << " ns/op (" << stats.instructions << " ops)"
+                       << endl;
+            }
+        }
     }
 
     void TestSimplePrints() {
@@ -120,6 +272,9 @@ print y.value
         runtime::RunObjectsTests(tr);
         ast::RunUnitTests(tr);
         TestParseProgram(tr);
+        vm::RunVmTests(tr);
+        jit::RunJitTests(tr);
+        aot::RunAotTests(tr);
 
         RUN_TEST(tr, TestSimplePrints);
         RUN_TEST(tr, TestAssignments);
@@ -129,10 +284,22 @@ print y.value
 
 }  // namespace
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
         //TestAll();
 
+        if (argc > 1 && argv[1] == "--bench"sv) {
+            RunBenchmarks(cout);
+            return 0;
+        }
+
+        Engine engine = Engine::TreeWalker;
+        if (argc > 1 && argv[1] == "--vm"sv) {
+            engine = Engine::Bytecode;
+        } else if (argc > 1 && argv[1] == "--jit"sv) {
+            engine = Engine::Jit;
+        }
+
         string filename = "../test.txt"s;
         ifstream in(filename);
         if (!in.is_open())
@@ -140,7 +307,17 @@ int main() {
             cout << "There is no file!" << endl;;
             return 0;
         }
-        RunMythonProgram(in, cout);
+
+        // --emit-cpp prints the translated program, --aot <output> builds it
+        if (argc > 1 && argv[1] == "--emit-cpp"sv) {
+            cout << TranslateMythonProgram(in);
+            return 0;
+        } else if (argc > 2 && argv[1] == "--aot"sv) {
+            aot::Build(TranslateMythonProgram(in), argv[2]);
+            return 0;
+        }
+
+        RunMythonProgram(in, cout, engine);
     }
     catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
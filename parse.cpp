@@ -3,6 +3,9 @@
 #include "lexer.h"
 #include "statement.h"
 
+#include <unordered_set>
+#include <utility>
+
 using namespace std;
 
 namespace TokenType = parse::token_type;
@@ -74,7 +77,27 @@ namespace {
                 lexer_.ExpectNext<TokenType::Char>(':');
                 lexer_.NextToken();
 
+                // self takes slot 0, parameters the next ones; a repeated name refers to
+                // its last slot, as the later binding wins in a closure too
+                LocalScope scope;
+                scope.emplace("self"s, 0);
+                for (size_t i = 0; i < m.formal_params.size(); ++i) {
+                    scope[m.formal_params[i].GetName()] = i + 1;
+                }
+
+                unordered_set<string> self_fields;
+
+                LocalScope* outer_locals = std::exchange(locals_, &scope);
+                size_t outer_frame_size = std::exchange(scope_frame_size_, m.formal_params.size() + 1);
+                self_fields_ = &self_fields;
+
                 m.body = std::make_unique<ast::MethodBody>(ParseSuite());
+                m.frame_size = scope_frame_size_;
+                m.self_field_count = self_fields.size();
+
+                locals_ = outer_locals;
+                scope_frame_size_ = outer_frame_size;
+                self_fields_ = nullptr;
 
                 result.push_back(std::move(m));
             }
@@ -123,6 +146,25 @@ namespace {
             return make_unique<ast::ClassDefinition>(it->second);
         }
 
+        // Frame slot of a variable of the method being parsed, NO_LOCAL_SLOT outside methods
+        size_t ResolveLocal(const string& name) {
+            if (locals_ == nullptr) {
+                return runtime::NO_LOCAL_SLOT;
+            }
+
+            auto [it, inserted] = locals_->emplace(name, scope_frame_size_);
+            if (inserted) {
+                ++scope_frame_size_;
+            }
+
+            return it->second;
+        }
+
+        unique_ptr<ast::VariableValue> MakeVariableValue(vector<string> names) {
+            const size_t local_slot = ResolveLocal(names.front());
+            return make_unique<ast::VariableValue>(std::move(names), local_slot);
+        }
+
         vector<string> ParseDottedIds() {
             vector<string> result(1, lexer_.Expect<TokenType::Id>().value);
 
@@ -146,9 +188,14 @@ namespace {
                 lexer_.NextToken();
 
                 if (id_list.empty()) {
-                    return make_unique<ast::Assignment>(std::move(last_name), ParseTest());
+                    const size_t local_slot = ResolveLocal(last_name);
+                    return make_unique<ast::Assignment>(std::move(last_name), ParseTest(), local_slot);
+                }
+                if (self_fields_ != nullptr && id_list.size() == 1 && id_list.front() == "self"s) {
+                    self_fields_->insert(last_name);
                 }
-                return make_unique<ast::FieldAssignment>(ast::VariableValue{ std::move(id_list) },
+                const size_t object_slot = ResolveLocal(id_list.front());
+                return make_unique<ast::FieldAssignment>(ast::VariableValue{ std::move(id_list), object_slot },
                                                          std::move(last_name), ParseTest());
             }
             lexer_.Expect<TokenType::Char>('(');
@@ -165,8 +212,8 @@ namespace {
             lexer_.Expect<TokenType::Char>(')');
             lexer_.NextToken();
 
-            return make_unique<ast::MethodCall>(make_unique<ast::VariableValue>(std::move(id_list)),
-                                                std::move(last_name), std::move(args));
+            return make_unique<ast::MethodCall>(MakeVariableValue(std::move(id_list)), std::move(last_name),
+                                                std::move(args));
         }
 
         // Expr -> Adder ['+'/'-' Adder]*
@@ -227,11 +274,17 @@ namespace {
                 return make_unique<ast::Mult>(ParseMult(), make_unique<ast::NumericConst>(-1));
             }
             if (const auto* num = lexer_.CurrentToken().TryAs<TokenType::Number>()) {
-                int result = num->value;
+                int64_t result = num->value;
                 lexer_.NextToken();
 
                 return make_unique<ast::NumericConst>(result);
             }
+            if (const auto* num = lexer_.CurrentToken().TryAs<TokenType::BigNumber>()) {
+                runtime::BigInt result(num->value);
+                lexer_.NextToken();
+
+                return make_unique<ast::BigNumericConst>(std::move(result));
+            }
             if (const auto* str = lexer_.CurrentToken().TryAs<TokenType::String>()) {
                 string result = str->value;
                 lexer_.NextToken();
@@ -274,9 +327,8 @@ namespace {
                 names.pop_back();
 
                 if (!names.empty()) {
-                    return make_unique<ast::MethodCall>(
-                        make_unique<ast::VariableValue>(std::move(names)), std::move(method_name),
-                        std::move(args));
+                    return make_unique<ast::MethodCall>(MakeVariableValue(std::move(names)),
+                                                        std::move(method_name), std::move(args));
                 }
 
                 if (auto it = declared_classes_.find(method_name); it != declared_classes_.end()) {
@@ -294,7 +346,7 @@ namespace {
                 throw ParseError("Unknown call to "s + method_name + "()"s);
             }
 
-            return make_unique<ast::VariableValue>(std::move(names));
+            return MakeVariableValue(std::move(names));
         }
 
         vector<unique_ptr<ast::Statement>> ParseTestList() {
@@ -373,38 +425,32 @@ namespace {
 
             if (tok == '<') {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::Less, std::move(result),
-                                                    ParseExpression());
+                return make_unique<ast::Less>(std::move(result), ParseExpression());
             }
 
             if (tok == '>') {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::Greater, std::move(result),
-                                                    ParseExpression());
+                return make_unique<ast::Greater>(std::move(result), ParseExpression());
             }
 
             if (tok.Is<TokenType::Eq>()) {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::Equal, std::move(result),
-                                                    ParseExpression());
+                return make_unique<ast::Equal>(std::move(result), ParseExpression());
             }
 
             if (tok.Is<TokenType::NotEq>()) {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::NotEqual, std::move(result),
-                                                    ParseExpression());
+                return make_unique<ast::NotEqual>(std::move(result), ParseExpression());
             }
 
             if (tok.Is<TokenType::LessOrEq>()) {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::LessOrEqual, std::move(result),
-                                                    ParseExpression());
+                return make_unique<ast::LessOrEqual>(std::move(result), ParseExpression());
             }
 
             if (tok.Is<TokenType::GreaterOrEq>()) {
                 lexer_.NextToken();
-                return make_unique<ast::Comparison>(runtime::GreaterOrEqual, std::move(result),
-                                                    ParseExpression());
+                return make_unique<ast::GreaterOrEqual>(std::move(result), ParseExpression());
             }
 
             return result;
@@ -439,6 +485,9 @@ namespace {
             const auto& tok = lexer_.CurrentToken();
 
             if (tok.Is<TokenType::Return>()) {
+                if (locals_ == nullptr) {
+                    throw ParseError("return outside of a method"s);
+                }
                 lexer_.NextToken();
                 return make_unique<ast::Return>(ParseTest());
             }
@@ -457,12 +506,19 @@ namespace {
             return ParseAssignmentOrCall();
         }
 
+        using LocalScope = unordered_map<string, size_t>;
+
         parse::Lexer& lexer_;
         runtime::Closure declared_classes_;
+        // Variables of the method being parsed
+        LocalScope* locals_ = nullptr;
+        size_t scope_frame_size_ = 0;
+        // Fields the method being parsed assigns on self
+        unordered_set<string>* self_fields_ = nullptr;
     };
 
 } // namespace
 
-unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer) {
+unique_ptr<ast::Statement> ParseProgram(parse::Lexer& lexer) {
     return Parser{ lexer }.ParseProgram();
 }
\ No newline at end of file
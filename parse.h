@@ -7,12 +7,12 @@ namespace parse {
     class Lexer;
 }
 
-namespace runtime {
-    class Executable;
+namespace ast {
+    class Statement;
 }
 
 struct ParseError : std::runtime_error {
     using std::runtime_error::runtime_error;
 };
 
-std::unique_ptr<runtime::Executable> ParseProgram(parse::Lexer& lexer);
\ No newline at end of file
+std::unique_ptr<ast::Statement> ParseProgram(parse::Lexer& lexer);
\ No newline at end of file
@@ -1,12 +1,16 @@
+#include "bytecode.h"
+#include "jit.h"
 #include "lexer.h"
 #include "parse.h"
 #include "statement.h"
 #include "test_runner_p.h"
+#include "vm.h"
 
 using namespace std;
 
 namespace parse {
 
+    // Also used by the vm, jit and aot tests
     unique_ptr<ast::Statement> ParseProgramFromString(const string& program) {
         istringstream is(program);
         parse::Lexer lexer(is);
@@ -14,6 +18,39 @@ namespace parse {
         return ParseProgram(lexer);
     }
 
+    // Set while the tests run on the bytecode VM instead of the tree walker
+    bool run_on_vm = false;
+
+    void Execute(ast::Statement& tree, runtime::Closure& closure, runtime::Context& context) {
+        if (run_on_vm) {
+            bytecode::Module module(tree);
+            vm::Run(module, closure, context);
+        } else {
+            tree.Execute(closure, context);
+        }
+    }
+
+    template <void (*Test)()>
+    void OnVm() {
+        struct Reset {
+            ~Reset() {
+                run_on_vm = false;
+            }
+        } reset;
+
+        run_on_vm = true;
+        Test();
+    }
+
+    // Runs the test on the tree walker with every method compiled on its first call
+    template <void (*Test)()>
+    void OnJit() {
+        jit::Compiler compiler(1);
+        runtime::MethodCompiler::Scope scope(compiler);
+
+        Test();
+    }
+
     void TestSimpleProgram() {
         const string program = R"(
 x = 4
@@ -27,7 +64,7 @@ print x + y, z + n
 
         runtime::Closure closure;
         auto tree = ParseProgramFromString(program);
-        tree->Execute(closure, context);
+        Execute(*tree, closure, context);
 
         ASSERT_EQUAL(context.output.str(), "9 hello, world\n"s);
     }
@@ -48,7 +85,7 @@ print "9 hello, world"
 
         runtime::Closure closure;
         auto tree = ParseProgramFromString(program);
-        tree->Execute(closure, context);
+        Execute(*tree, closure, context);
 
         ASSERT_EQUAL(context.output.str(), "9 hello, world\n"s);
     }
@@ -86,7 +123,7 @@ print program_name, origin, far_far_away, origin.SetX(1)
 
         runtime::Closure closure;
         auto tree = ParseProgramFromString(program);
-        tree->Execute(closure, context);
+        Execute(*tree, closure, context);
 
         ASSERT_EQUAL(context.output.str(), "Classes test (0; 0) (10000; 50000) None\n"s);
     }
@@ -112,7 +149,7 @@ else:
 
         runtime::Closure closure;
         auto tree = ParseProgramFromString(program);
-        tree->Execute(closure, context);
+        Execute(*tree, closure, context);
 
         ASSERT_EQUAL(context.output.str(), "x <= y\ny >= 0\n"s);
     }
@@ -134,7 +171,7 @@ print x.calc(2)
 
         runtime::Closure closure;
         auto tree = ParseProgramFromString(program);
-        tree->Execute(closure, context);
+        Execute(*tree, closure, context);
 
         ASSERT_EQUAL(context.output.str(), "2\n"s);
     }
@@ -161,7 +198,7 @@ print x.result
 
         runtime::Closure closure;
         auto tree = ParseProgramFromString(program);
-        tree->Execute(closure, context);
+        Execute(*tree, closure, context);
 
         ASSERT_EQUAL(context.output.str(), "55\n"s);
     }
@@ -190,7 +227,7 @@ print x.call_count
 
         runtime::Closure closure;
         auto tree = ParseProgramFromString(program);
-        tree->Execute(closure, context);
+        Execute(*tree, closure, context);
 
         ASSERT_EQUAL(context.output.str(), "17\n1\n115\n"s);
     }
@@ -208,7 +245,7 @@ print ok
 
         runtime::Closure closure;
         auto tree = ParseProgramFromString(program);
-        tree->Execute(closure, context);
+        Execute(*tree, closure, context);
 
         ASSERT_EQUAL(context.output.str(), "False\n"s);
     }
@@ -260,12 +297,143 @@ print r, c, t1, t2
 
         runtime::Closure closure;
         auto tree = ParseProgramFromString(program);
-        tree->Execute(closure, context);
+        Execute(*tree, closure, context);
 
         ASSERT_EQUAL(context.output.str(),
                      "Rect(10x20) Circle(52) Triangle(3, 4, 5) Wrong triangle\n"s);
     }
 
+    void TestMethodFrames() {
+        const string program = R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    a = self.calc(n - 1)
+    b = self.calc(n - 2)
+    return a + b
+
+  def shadow(self, x, x):
+    y = self + x
+    return y
+
+  def unbound(flag):
+    if flag:
+      z = 1
+    return z
+
+f = Fib()
+print f.calc(20), f.shadow(1, 2, 3), f.unbound(True)
+)"s;
+
+        runtime::DummyContext context;
+
+        runtime::Closure closure;
+        auto tree = ParseProgramFromString(program);
+        Execute(*tree, closure, context);
+
+        ASSERT_EQUAL(context.output.str(), "6765 4 1\n"s);
+
+        auto failing = ParseProgramFromString(program + "print f.unbound(False)\n"s);
+        runtime::Closure failing_closure;
+        ASSERT_THROWS(Execute(*failing, failing_closure, context), std::runtime_error);
+    }
+
+    void TestReturnStatus() {
+        const string program = R"(
+class Finder:
+  def find(n):
+    if n > 2:
+      if n > 5:
+        return 'big'
+      return 'middle'
+    self.helper(n)
+    return 'small'
+
+  def helper(n):
+    return n
+
+  def no_return(n):
+    self.helper(n)
+    print 'done'
+
+f = Finder()
+print f.find(7), f.find(4), f.find(1)
+print f.no_return(3)
+)"s;
+
+        runtime::DummyContext context;
+
+        runtime::Closure closure;
+        auto tree = ParseProgramFromString(program);
+        Execute(*tree, closure, context);
+
+        ASSERT_EQUAL(context.output.str(), "big middle small\ndone\nNone\n"s);
+
+        ASSERT_THROWS(ParseProgramFromString("x = 1\nreturn x\n"s), ParseError);
+    }
+
+    void TestCmpProtocol() {
+        const string program = R"(
+class Version:
+  def __init__(major, minor):
+    self.major = major
+    self.minor = minor
+    self.calls = 0
+
+  def __cmp__(other):
+    self.calls = self.calls + 1
+    if self.major != other.major:
+      return self.major - other.major
+    return self.minor - other.minor
+
+a = Version(1, 2)
+b = Version(1, 10)
+print a < b, a > b, a <= b, a >= b, a == b, a != b, a == a
+print a.calls
+)"s;
+
+        runtime::DummyContext context;
+
+        runtime::Closure closure;
+        auto tree = ParseProgramFromString(program);
+        Execute(*tree, closure, context);
+
+        ASSERT_EQUAL(context.output.str(), "True False True False False True True\n7\n"s);
+    }
+
+    void TestNewInstancePerEvaluation() {
+        const string program = R"(
+class Node:
+  def __init__(value):
+    self.value = value
+    self.next = None
+    if value > 1:
+      self.value = value - 1
+
+class Maker:
+  def make(value):
+    return Node(value)
+
+m = Maker()
+a = m.make(1)
+b = m.make(3)
+print a.value, b.value
+)"s;
+
+        runtime::DummyContext context;
+
+        runtime::Closure closure;
+        auto tree = ParseProgramFromString(program);
+        Execute(*tree, closure, context);
+
+        ASSERT_EQUAL(context.output.str(), "1 2\n"s);
+        ASSERT(closure.at("a"s).Get() != closure.at("b"s).Get());
+
+        ASSERT_EQUAL(closure.at("Node"s).TryAs<runtime::Class>()->GetInstanceFieldCount(), 2U);
+        ASSERT_EQUAL(closure.at("Maker"s).TryAs<runtime::Class>()->GetInstanceFieldCount(), 0U);
+    }
+
 } // namespace parse
 
 void TestParseProgram(TestRunner& tr) {
@@ -278,4 +446,36 @@ void TestParseProgram(TestRunner& tr) {
     RUN_TEST(tr, parse::TestRecursion2);
     RUN_TEST(tr, parse::TestComplexLogicalExpression);
     RUN_TEST(tr, parse::TestClassicalPolymorphism);
-}
\ No newline at end of file
+    RUN_TEST(tr, parse::TestMethodFrames);
+    RUN_TEST(tr, parse::TestReturnStatus);
+    RUN_TEST(tr, parse::TestCmpProtocol);
+    RUN_TEST(tr, parse::TestNewInstancePerEvaluation);
+
+    RUN_TEST(tr, parse::OnVm<parse::TestSimpleProgram>);
+    RUN_TEST(tr, parse::OnVm<parse::TestSimpleProgram2>);
+    RUN_TEST(tr, parse::OnVm<parse::TestProgramWithClasses>);
+    RUN_TEST(tr, parse::OnVm<parse::TestProgramWithIf>);
+    RUN_TEST(tr, parse::OnVm<parse::TestReturnFromIf>);
+    RUN_TEST(tr, parse::OnVm<parse::TestRecursion>);
+    RUN_TEST(tr, parse::OnVm<parse::TestRecursion2>);
+    RUN_TEST(tr, parse::OnVm<parse::TestComplexLogicalExpression>);
+    RUN_TEST(tr, parse::OnVm<parse::TestClassicalPolymorphism>);
+    RUN_TEST(tr, parse::OnVm<parse::TestMethodFrames>);
+    RUN_TEST(tr, parse::OnVm<parse::TestReturnStatus>);
+    RUN_TEST(tr, parse::OnVm<parse::TestCmpProtocol>);
+    RUN_TEST(tr, parse::OnVm<parse::TestNewInstancePerEvaluation>);
+
+    RUN_TEST(tr, parse::OnJit<parse::TestSimpleProgram>);
+    RUN_TEST(tr, parse::OnJit<parse::TestSimpleProgram2>);
+    RUN_TEST(tr, parse::OnJit<parse::TestProgramWithClasses>);
+    RUN_TEST(tr, parse::OnJit<parse::TestProgramWithIf>);
+    RUN_TEST(tr, parse::OnJit<parse::TestReturnFromIf>);
+    RUN_TEST(tr, parse::OnJit<parse::TestRecursion>);
+    RUN_TEST(tr, parse::OnJit<parse::TestRecursion2>);
+    RUN_TEST(tr, parse::OnJit<parse::TestComplexLogicalExpression>);
+    RUN_TEST(tr, parse::OnJit<parse::TestClassicalPolymorphism>);
+    RUN_TEST(tr, parse::OnJit<parse::TestMethodFrames>);
+    RUN_TEST(tr, parse::OnJit<parse::TestReturnStatus>);
+    RUN_TEST(tr, parse::OnJit<parse::TestCmpProtocol>);
+    RUN_TEST(tr, parse::OnJit<parse::TestNewInstancePerEvaluation>);
+}
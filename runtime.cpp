@@ -1,37 +1,195 @@
 #include "runtime.h"
 
+#include "call_stack.h"
+
+#include <algorithm>
 #include <cassert>
+#include <functional>
 #include <iostream>
 #include <optional>
 #include <sstream>
+#include <string_view>
 
 using namespace std;
 
 namespace {
-    const string SELF_OBJECT = "self"s;
-    const string STR_METHOD = "__str__"s;
-    const string EQ_METHOD = "__eq__"s;
-    const string LT_METHOD = "__lt__"s;
+    const runtime::Symbol SELF_OBJECT{ "self"sv };
+    struct SpecialMethodInfo {
+        runtime::SpecialMethod method;
+        runtime::Symbol name;
+        // -1 for any number of parameters
+        int params_count;
+    };
+
+    const SpecialMethodInfo SPECIAL_METHODS[] = {
+        { runtime::SpecialMethod::Init, "__init__"sv, -1 },
+        { runtime::SpecialMethod::Str, "__str__"sv, 0 },
+        { runtime::SpecialMethod::Eq, "__eq__"sv, 1 },
+        { runtime::SpecialMethod::Lt, "__lt__"sv, 1 },
+        { runtime::SpecialMethod::Cmp, "__cmp__"sv, 1 },
+        { runtime::SpecialMethod::Add, "__add__"sv, 1 },
+    };
 } // namespace
 
 namespace runtime {
 
-    ObjectHolder::ObjectHolder(std::shared_ptr<Object> data)
-        : data_(std::move(data)) {
+    ObjectHolder::ObjectHolder(Object* data)
+        : data_(data) {
+        data_->owned_ = true;
+        data_->ref_count_ = 1;
+    }
+
+    ObjectHolder::ObjectHolder(const Number& number)
+        : storage_(Storage::Number) {
+        new (&immediate_.number) Number(number);
+    }
+
+    ObjectHolder::ObjectHolder(const Bool& boolean)
+        : storage_(Storage::Bool) {
+        new (&immediate_.boolean) Bool(boolean);
+    }
+
+    ObjectHolder::ObjectHolder(const ObjectHolder& other)
+        : data_(other.data_) {
+        CopyStorage(other);
+        Retain();
+    }
+
+    ObjectHolder::ObjectHolder(ObjectHolder&& other) noexcept
+        : data_(other.data_) {
+        CopyStorage(other);
+        other.data_ = nullptr;
+        other.storage_ = Storage::Counted;
+    }
+
+    ObjectHolder::~ObjectHolder() {
+        Release(data_, storage_);
+    }
+
+    ObjectHolder& ObjectHolder::operator=(const ObjectHolder& other) {
+        if (this != &other) {
+            // Other may be owned by the object we release, so release it last
+            Object* old_data = data_;
+            Storage old_storage = storage_;
+            data_ = other.data_;
+            CopyStorage(other);
+            Retain();
+            Release(old_data, old_storage);
+        }
+        return *this;
+    }
+
+    ObjectHolder& ObjectHolder::operator=(ObjectHolder&& other) noexcept {
+        if (this != &other) {
+            Object* old_data = data_;
+            Storage old_storage = storage_;
+            data_ = other.data_;
+            CopyStorage(other);
+            other.data_ = nullptr;
+            other.storage_ = Storage::Counted;
+            Release(old_data, old_storage);
+        }
+        return *this;
+    }
+
+    void ObjectHolder::CopyStorage(const ObjectHolder& other) {
+        storage_ = other.storage_;
+
+        if (storage_ == Storage::Number) {
+            new (&immediate_.number) Number(other.immediate_.number);
+        } else if (storage_ == Storage::Bool) {
+            new (&immediate_.boolean) Bool(other.immediate_.boolean);
+        }
+    }
+
+    void ObjectHolder::Destroy(Object* data) {
+        if (data->kind_ != ObjectKind::ClassInstance) {
+            Delete(data);
+            return;
+        }
+
+        if (CycleCollector* collector = CycleCollector::Current()) {
+            collector->DeferFree(static_cast<ClassInstance&>(*data));
+            return;
+        }
+
+        // Instances released while another one is being destroyed are queued and
+        // destroyed by the outermost call
+        thread_local bool destroying = false;
+        thread_local vector<Object*> pending;
+
+        if (destroying) {
+            pending.push_back(data);
+            return;
+        }
+
+        destroying = true;
+        Delete(data);
+        while (!pending.empty()) {
+            Object* next = pending.back();
+            pending.pop_back();
+            Delete(next);
+        }
+        destroying = false;
+    }
+
+    void ObjectHolder::Delete(Object* data) {
+        const unsigned char size_class = data->size_class_;
+
+        if (size_class == Arena::NO_SIZE_CLASS) {
+            delete data;
+            return;
+        }
+
+        Arena& arena = Arena::Owner(data);
+        data->~Object();
+        arena.Deallocate(data, size_class);
+    }
+
+    void ObjectHolder::AddPossibleRoot(Object* data) {
+        if (CycleCollector* collector = CycleCollector::Current()) {
+            collector->AddPossibleRoot(static_cast<ClassInstance&>(*data));
+        }
     }
 
     void ObjectHolder::AssertIsValid() const {
-        assert(data_ != nullptr);
+        assert(Get() != nullptr);
     }
 
     ObjectHolder ObjectHolder::Share(Object& object) {
-        return ObjectHolder(std::shared_ptr<Object>(&object, [](auto* /*p*/) { /* do nothing */ }));
+        // Owned objects (e.g. an instance binding itself as self) get a new reference,
+        // unowned ones are only pointed to
+        ObjectHolder holder;
+        holder.data_ = &object;
+        holder.storage_ = object.owned_ ? Storage::Counted : Storage::Borrowed;
+        holder.Retain();
+        return holder;
     }
 
     ObjectHolder ObjectHolder::None() {
         return ObjectHolder();
     }
 
+    ObjectHolder MakeInteger(BigInt value) {
+        int64_t number;
+        if (value.ToInt64(number)) {
+            return MakeNumber(number);
+        }
+        return ObjectHolder::Own(BigNumber{ std::move(value) });
+    }
+
+    bool TryGetInteger(const ObjectHolder& object, BigInt& value) {
+        if (const auto* number = object.TryAs<Number>()) {
+            value = number->GetValue();
+            return true;
+        }
+        if (const auto* big_number = object.TryAs<BigNumber>()) {
+            value = big_number->GetValue();
+            return true;
+        }
+        return false;
+    }
+
     Object& ObjectHolder::operator*() const {
         AssertIsValid();
         return *Get();
@@ -43,11 +201,29 @@ namespace runtime {
     }
 
     Object* ObjectHolder::Get() const {
-        return data_.get();
+        switch (storage_) {
+            case Storage::Number:
+                return &immediate_.number;
+            case Storage::Bool:
+                return &immediate_.boolean;
+            default:
+                return data_;
+        }
+    }
+
+    ObjectHolder::NumberLayout ObjectHolder::GetNumberLayout() {
+        const ObjectHolder sample(Number{ 0 });
+        const auto* base = reinterpret_cast<const unsigned char*>(&sample);
+        const auto* tag = reinterpret_cast<const unsigned char*>(&sample.storage_);
+        const auto* value = reinterpret_cast<const unsigned char*>(&sample.immediate_.number.GetValue());
+
+        static_assert(sizeof(Storage) == 1);
+        return { static_cast<size_t>(tag - base), static_cast<unsigned char>(Storage::Number),
+                 static_cast<size_t>(value - base) };
     }
 
     ObjectHolder::operator bool() const {
-        return Get() != nullptr;
+        return data_ != nullptr || storage_ == Storage::Number || storage_ == Storage::Bool;
     }
 
     bool IsTrue(const ObjectHolder& object) {
@@ -55,45 +231,32 @@ namespace runtime {
             return false;
         }
 
-        auto ptr_b = object.TryAs<runtime::Bool>();
-        if (ptr_b != nullptr) {
-            return ptr_b->GetValue();
-        }
-
-        auto ptr_n = object.TryAs<runtime::Number>();
-        if (ptr_n != nullptr) {
-            return ptr_n->GetValue() != 0;
-        }
-
-        auto ptr_s = object.TryAs<runtime::String>();
-        if (ptr_s != nullptr) {
-            if (ptr_s->GetValue() == ""s) {
+        switch (object->Kind()) {
+            case ObjectKind::Bool:
+                return static_cast<const Bool&>(*object).GetValue();
+            case ObjectKind::Number:
+                return static_cast<const Number&>(*object).GetValue() != 0;
+            case ObjectKind::BigNumber:
+                return !static_cast<const BigNumber&>(*object).GetValue().IsZero();
+            case ObjectKind::String:
+                return static_cast<const String&>(*object).GetSize() != 0;
+            default:
                 return false;
-            } else {
-                return true;
-            }
         }
-
-        auto ptr_vo_bool = object.TryAs<runtime::ValueObject<bool>>();
-        if (ptr_vo_bool != nullptr) {
-            return ptr_vo_bool->GetValue();
-        }
-
-        return false;
     }
 
     void ClassInstance::Print(std::ostream& os, Context& context) {
-        auto method_ptr = this->cls_.GetMethod(STR_METHOD);
+        auto method_ptr = this->cls_.GetSpecialMethod(SpecialMethod::Str);
 
         if (method_ptr != nullptr) {
-            auto res = Call(method_ptr->name, {}, context);
+            auto res = Call(*method_ptr, {}, context);
             res->Print(os, context);
         } else {
             os << this;
         }
     }
 
-    bool ClassInstance::HasMethod(const std::string& method, size_t argument_count) const {
+    bool ClassInstance::HasMethod(Symbol method, size_t argument_count) const {
 
         auto ptr = cls_.GetMethod(method);
 
@@ -104,55 +267,213 @@ namespace runtime {
         return false;
     }
 
-    Closure& ClassInstance::Fields() {
+    size_t Shape::FindSlot(Symbol field) const {
+        // Instances rarely have many fields, a linear scan beats hashing for them
+        constexpr size_t LINEAR_SCAN_LIMIT = 8;
+
+        if (fields_.size() <= LINEAR_SCAN_LIMIT) {
+            for (size_t slot = 0; slot < fields_.size(); ++slot) {
+                if (fields_[slot] == field) {
+                    return slot;
+                }
+            }
+            return NO_SLOT;
+        }
+
+        auto it = field_to_slot_.find(field);
+        return it != field_to_slot_.end() ? it->second : NO_SLOT;
+    }
+
+    Shape* Shape::AddField(Symbol field) {
+        auto& next = transitions_[field];
+
+        if (!next) {
+            next = std::make_unique<Shape>();
+            next->fields_ = fields_;
+            next->fields_.push_back(field);
+            next->field_to_slot_ = field_to_slot_;
+            next->field_to_slot_[field] = fields_.size();
+        }
+
+        return next.get();
+    }
+
+    ObjectHolder& FieldTable::operator[](Symbol field) {
+        size_t slot = shape_->FindSlot(field);
+
+        if (slot == Shape::NO_SLOT) {
+            return AddSlot(*shape_->AddField(field));
+        }
+
+        return slots_[slot];
+    }
+
+    ObjectHolder& FieldTable::at(Symbol field) {
+        size_t slot = shape_->FindSlot(field);
+
+        if (slot == Shape::NO_SLOT) {
+            throw std::out_of_range("No field "s + field.GetName());
+        }
+
+        return slots_[slot];
+    }
+
+    const ObjectHolder& FieldTable::at(Symbol field) const {
+        return const_cast<FieldTable&>(*this).at(field);
+    }
+
+    FieldTable::iterator FieldTable::find(Symbol field) {
+        size_t slot = shape_->FindSlot(field);
+        return { this, slot == Shape::NO_SLOT ? slots_.size() : slot };
+    }
+
+    FieldTable::const_iterator FieldTable::find(Symbol field) const {
+        size_t slot = shape_->FindSlot(field);
+        return { this, slot == Shape::NO_SLOT ? slots_.size() : slot };
+    }
+
+    FieldTable& ClassInstance::Fields() {
         return fields_;
     }
 
-    const Closure& ClassInstance::Fields() const {
+    const FieldTable& ClassInstance::Fields() const {
         return fields_;
     }
 
     ClassInstance::ClassInstance(const Class& cls)
-        : cls_(cls) {
+        : Object(ObjectKind::ClassInstance)
+        , cls_(cls)
+        , fields_(cls.GetRootShape()) {
+        fields_.Reserve(cls.GetInstanceFieldCount());
     }
 
-    ObjectHolder ClassInstance::Call(const std::string& method,
-                                     const std::vector<ObjectHolder>& actual_args,
+    ClassInstance::ClassInstance(const ClassInstance& other)
+        : Object(other)
+        , cls_(other.cls_)
+        , fields_(other.fields_) {
+    }
+
+    ClassInstance::ClassInstance(ClassInstance&& other) noexcept
+        : Object(other)
+        , cls_(other.cls_)
+        , fields_(std::move(other.fields_)) {
+    }
+
+    ClassInstance::~ClassInstance() {
+        if (gc_root_index_ != NO_GC_ROOT) {
+            if (CycleCollector* collector = CycleCollector::Current()) {
+                collector->Forget(*this);
+            }
+        }
+    }
+
+    ObjectHolder ClassInstance::Call(Symbol method, const std::vector<ObjectHolder>& actual_args,
                                      Context& context) {
 
         if (!this->HasMethod(method, actual_args.size())) {
             throw std::runtime_error("No method found");
         }
 
-        auto* method_ptr = cls_.GetMethod(method);
+        return Call(*cls_.GetMethod(method), actual_args, context);
+    }
+
+    ObjectHolder ClassInstance::Call(const Method& method, const std::vector<ObjectHolder>& actual_args,
+                                     Context& context) {
+        const size_t params_size = method.formal_params.size();
+
+        if (method.frame_size != 0) {
+            CallStack::Frame frame(method.frame_size);
+            frame.Slot(0) = ObjectHolder::Share(*this);
+
+            for (size_t i = 0; i < params_size; ++i) {
+                frame.Slot(i + 1) = actual_args[i];
+            }
+
+            return CallInFrame(method, frame, context);
+        }
 
         Closure cl;
 
         cl[SELF_OBJECT] = ObjectHolder::Share(*this);
 
-        size_t params_size = method_ptr->formal_params.size();
-
         for (size_t i = 0; i < params_size; ++i) {
-            auto arg = method_ptr->formal_params[i];
-            cl[arg] = actual_args[i];
+            cl[method.formal_params[i]] = actual_args[i];
         }
 
-        return method_ptr->body->Execute(cl, context);
+        return method.body->Execute(cl, context);
+    }
+
+    namespace {
+        class MethodSlots {
+        public:
+            size_t Get(Symbol name) {
+                size_t slot = Find(name);
+
+                if (slot == NO_METHOD_SLOT) {
+                    slot = slot_count_++;
+                    symbol_to_slot_.resize(std::max<size_t>(symbol_to_slot_.size(), name.GetId() + 1), NO_METHOD_SLOT);
+                    symbol_to_slot_[name.GetId()] = slot;
+                }
+
+                return slot;
+            }
+
+            size_t Find(Symbol name) const {
+                return name.GetId() < symbol_to_slot_.size() ? symbol_to_slot_[name.GetId()] : NO_METHOD_SLOT;
+            }
+
+        private:
+            // Symbol ids are dense, so the slot of a name is found without hashing
+            std::vector<size_t> symbol_to_slot_;
+            size_t slot_count_ = 0;
+        };
+
+        MethodSlots& GetMethodSlots() {
+            static MethodSlots slots;
+            return slots;
+        }
+    } // namespace
+
+    size_t GetMethodSlot(Symbol name) {
+        return GetMethodSlots().Get(name);
+    }
+
+    size_t FindMethodSlot(Symbol name) {
+        return GetMethodSlots().Find(name);
     }
 
     Class::Class(std::string name, std::vector<Method> methods, const Class* parent)
-        : name_(std::move(name))
+        : Object(ObjectKind::Class)
+        , name_(std::move(name))
         , methods_(std::move(methods))
         , parent_(parent) {
 
+        // The parent table is already flattened, so methods of all ancestors are inherited
         if (parent_ != nullptr) {
-            for (const auto& method : parent_->methods_) {
-                name_to_method_[method.name] = &method;
-            }
+            method_table_ = parent_->method_table_;
         }
 
         for (const auto& method : methods_) {
-            name_to_method_[method.name] = &method;
+            size_t slot = GetMethodSlot(method.name);
+
+            if (slot >= method_table_.size()) {
+                method_table_.resize(slot + 1, nullptr);
+            }
+
+            method_table_[slot] = &method;
+        }
+
+        for (const auto& info : SPECIAL_METHODS) {
+            const Method* method = GetMethod(info.name);
+
+            if (method != nullptr
+                && (info.params_count < 0 || method->formal_params.size() == static_cast<size_t>(info.params_count))) {
+                special_methods_[static_cast<size_t>(info.method)] = method;
+            }
+        }
+
+        if (const Method* init = GetSpecialMethod(SpecialMethod::Init)) {
+            instance_field_count_ = init->self_field_count;
         }
     }
 
@@ -160,15 +481,12 @@ namespace runtime {
         return parent_;
     }
 
-    const Method* Class::GetMethod(const std::string& name) const {
-
-        auto it = name_to_method_.find(name);
-
-        if (it != name_to_method_.end()) {
-            return it->second;
-        }
+    Shape& Class::GetRootShape() const {
+        return *root_shape_;
+    }
 
-        return nullptr;
+    const Method* Class::GetMethod(Symbol name) const {
+        return GetMethodBySlot(FindMethodSlot(name));
     }
 
     const std::string& Class::GetName() const {
@@ -180,46 +498,195 @@ namespace runtime {
         os << this->GetName();
     }
 
-    void Bool::Print(std::ostream& os, Context& /* context */) {
-        os << (GetValue() ? "True"sv : "False"sv);
+    size_t StringBuffer::GetHash() const {
+        if (!has_hash_) {
+            hash_ = std::hash<std::string_view>{}(value_);
+            has_hash_ = true;
+        }
+        return hash_;
     }
 
-    bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
-        if (!lhs && !rhs) {
-            return true;
+    String::String(ObjectHolder left, ObjectHolder right, size_t size)
+        : Object(ObjectKind::String)
+        , left_(std::move(left))
+        , right_(std::move(right))
+        , size_(size) {
+    }
+
+    String::~String() {
+        if (IsFlat()) {
+            return;
         }
 
-        if (!lhs) {
-            throw std::runtime_error("Cannot compare objects for equality"s);
+        // Long chains of nodes are released iteratively instead of recursing through
+        // the destructors; nodes shared with other strings are left intact
+        vector<ObjectHolder> pending;
+        pending.push_back(std::move(left_));
+        pending.push_back(std::move(right_));
+
+        while (!pending.empty()) {
+            ObjectHolder holder = std::move(pending.back());
+            pending.pop_back();
+
+            if (holder.UseCount() == 1) {
+                auto& node = static_cast<String&>(*holder);
+
+                if (!node.IsFlat()) {
+                    pending.push_back(std::move(node.left_));
+                    pending.push_back(std::move(node.right_));
+                }
+            }
+        }
+    }
+
+    ObjectHolder String::Concat(const ObjectHolder& lhs, const ObjectHolder& rhs) {
+        const auto& lhs_str = static_cast<const String&>(*lhs);
+        const auto& rhs_str = static_cast<const String&>(*rhs);
+        const size_t size = lhs_str.size_ + rhs_str.size_;
+
+        if (lhs_str.size_ == 0) {
+            return ObjectHolder::Own(String{ rhs_str.GetBuffer() });
+        }
+        if (rhs_str.size_ == 0) {
+            return ObjectHolder::Own(String{ lhs_str.GetBuffer() });
+        }
+
+        if (size <= MIN_ROPE_SIZE) {
+            string value;
+            value.reserve(size);
+            value += lhs_str.GetValue();
+            value += rhs_str.GetValue();
+            return ObjectHolder::Own(String{ std::move(value) });
         }
 
-        auto l_ptr_n = lhs.TryAs<runtime::Number>();
-        auto r_ptr_n = rhs.TryAs<runtime::Number>();
+        // Borrowed strings (e.g. literals of the program) may die before the result
+        auto keep = [](const ObjectHolder& part) {
+            return part.UseCount() != 0 ? part
+                                        : ObjectHolder::Own(String{ static_cast<const String&>(*part).GetBuffer() });
+        };
+
+        return ObjectHolder::Own(String{ keep(lhs), keep(rhs), size });
+    }
+
+    void String::Flatten() const {
+        string value;
+        value.reserve(size_);
+
+        vector<const String*> stack{ this };
+        while (!stack.empty()) {
+            const String* node = stack.back();
+            stack.pop_back();
+
+            if (node->IsFlat()) {
+                value += node->buffer_->GetValue();
+            } else {
+                stack.push_back(&static_cast<const String&>(*node->right_));
+                stack.push_back(&static_cast<const String&>(*node->left_));
+            }
+        }
+
+        buffer_ = std::make_shared<const StringBuffer>(std::move(value));
+        left_ = ObjectHolder::None();
+        right_ = ObjectHolder::None();
+    }
+
+    void String::Print(std::ostream& os, Context& /* context */) {
+        os << GetValue();
+    }
+
+    void Bool::Print(std::ostream& os, Context& /* context */) {
+        os << (GetValue() ? "True"sv : "False"sv);
+    }
 
-        if (l_ptr_n != nullptr && r_ptr_n != nullptr) {
-            return l_ptr_n->GetValue() == r_ptr_n->GetValue();
+    namespace {
+        bool StringsEqual(const String& lhs, const String& rhs) {
+            if (lhs.GetSize() != rhs.GetSize()) {
+                return false;
+            }
+
+            const auto& lhs_buffer = lhs.GetBuffer();
+            const auto& rhs_buffer = rhs.GetBuffer();
+            if (lhs_buffer == rhs_buffer) {
+                return true;
+            }
+            if (lhs_buffer->GetHash() != rhs_buffer->GetHash()) {
+                return false;
+            }
+            return lhs_buffer->GetValue() == rhs_buffer->GetValue();
         }
 
-        auto l_ptr_s = lhs.TryAs<runtime::String>();
-        auto r_ptr_s = rhs.TryAs<runtime::String>();
+        int CompareStrings(const String& lhs, const String& rhs) {
+            const auto& lhs_buffer = lhs.GetBuffer();
+            const auto& rhs_buffer = rhs.GetBuffer();
+            return lhs_buffer == rhs_buffer ? 0 : lhs_buffer->GetValue().compare(rhs_buffer->GetValue());
+        }
 
-        if (l_ptr_s != nullptr && r_ptr_s != nullptr) {
-            return l_ptr_s->GetValue() == r_ptr_s->GetValue();
+        bool StringsLess(const String& lhs, const String& rhs) {
+            return CompareStrings(lhs, rhs) < 0;
         }
 
-        auto l_ptr_b = lhs.TryAs<runtime::Bool>();
-        auto r_ptr_b = rhs.TryAs<runtime::Bool>();
+        // Sign of the result of __cmp__
+        int CallCmp(ClassInstance& instance, const Method& method, const ObjectHolder& rhs, Context& context) {
+            auto res = instance.Call(method, { rhs }, context);
+            auto number = res.TryAs<Number>();
+
+            if (number == nullptr) {
+                throw std::runtime_error("__cmp__ must return a number"s);
+            }
 
-        if (l_ptr_b != nullptr && r_ptr_b != nullptr) {
-            return l_ptr_b->GetValue() == r_ptr_b->GetValue();
+            return number->GetValue() < 0 ? -1 : (number->GetValue() > 0 ? 1 : 0);
         }
+    } // namespace
 
-        auto l_ptr_class_inst = lhs.TryAs<runtime::ClassInstance>();
+    bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        if (!lhs && !rhs) {
+            return true;
+        }
 
-        constexpr int EQ_METHOD_ARGS_COUNT = 1;
-        if (l_ptr_class_inst != nullptr && l_ptr_class_inst->HasMethod(EQ_METHOD, EQ_METHOD_ARGS_COUNT)) {
-            auto res = l_ptr_class_inst->Call(EQ_METHOD, { rhs }, context);
-            return res.TryAs<Bool>()->GetValue();
+        if (!lhs) {
+            throw std::runtime_error("Cannot compare objects for equality"s);
+        }
+
+        const ObjectKind kind = lhs->Kind();
+        const bool same_kind = rhs && rhs->Kind() == kind;
+
+        switch (kind) {
+            case ObjectKind::Number:
+                if (same_kind) {
+                    return static_cast<const Number&>(*lhs).GetValue() == static_cast<const Number&>(*rhs).GetValue();
+                }
+                [[fallthrough]];
+            case ObjectKind::BigNumber: {
+                BigInt l_value;
+                BigInt r_value;
+                if (TryGetInteger(lhs, l_value) && TryGetInteger(rhs, r_value)) {
+                    return l_value == r_value;
+                }
+                break;
+            }
+            case ObjectKind::String:
+                if (same_kind) {
+                    return StringsEqual(static_cast<const String&>(*lhs), static_cast<const String&>(*rhs));
+                }
+                break;
+            case ObjectKind::Bool:
+                if (same_kind) {
+                    return static_cast<const Bool&>(*lhs).GetValue() == static_cast<const Bool&>(*rhs).GetValue();
+                }
+                break;
+            case ObjectKind::ClassInstance: {
+                auto& l_class_inst = static_cast<ClassInstance&>(*lhs);
+                if (auto method = l_class_inst.GetClass().GetSpecialMethod(SpecialMethod::Eq)) {
+                    auto res = l_class_inst.Call(*method, { rhs }, context);
+                    return res.TryAs<Bool>()->GetValue();
+                }
+                if (auto method = l_class_inst.GetClass().GetSpecialMethod(SpecialMethod::Cmp)) {
+                    return CallCmp(l_class_inst, *method, rhs, context) == 0;
+                }
+                break;
+            }
+            default:
+                break;
         }
 
         throw std::runtime_error("Cannot compare objects for equality"s);
@@ -231,52 +698,251 @@ namespace runtime {
             throw std::runtime_error("Cannot compare objects for equality"s);
         }
 
-        auto l_ptr_n = lhs.TryAs<runtime::Number>();
-        auto r_ptr_n = rhs.TryAs<runtime::Number>();
+        const ObjectKind kind = lhs->Kind();
+        const bool same_kind = rhs && rhs->Kind() == kind;
+
+        switch (kind) {
+            case ObjectKind::Number:
+                if (same_kind) {
+                    return static_cast<const Number&>(*lhs).GetValue() < static_cast<const Number&>(*rhs).GetValue();
+                }
+                [[fallthrough]];
+            case ObjectKind::BigNumber: {
+                BigInt l_value;
+                BigInt r_value;
+                if (TryGetInteger(lhs, l_value) && TryGetInteger(rhs, r_value)) {
+                    return l_value < r_value;
+                }
+                break;
+            }
+            case ObjectKind::String:
+                if (same_kind) {
+                    return StringsLess(static_cast<const String&>(*lhs), static_cast<const String&>(*rhs));
+                }
+                break;
+            case ObjectKind::Bool:
+                if (same_kind) {
+                    return static_cast<const Bool&>(*lhs).GetValue() < static_cast<const Bool&>(*rhs).GetValue();
+                }
+                break;
+            case ObjectKind::ClassInstance: {
+                auto& l_class_inst = static_cast<ClassInstance&>(*lhs);
+                if (auto method = l_class_inst.GetClass().GetSpecialMethod(SpecialMethod::Cmp)) {
+                    return CallCmp(l_class_inst, *method, rhs, context) < 0;
+                }
+                if (auto method = l_class_inst.GetClass().GetSpecialMethod(SpecialMethod::Lt)) {
+                    auto res = l_class_inst.Call(*method, { rhs }, context);
+                    return res.TryAs<Bool>()->GetValue();
+                }
+                break;
+            }
+            default:
+                break;
+        }
+
+        throw std::runtime_error("Cannot compare objects for less"s);
+    }
+
+    bool NotEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        return Compare(CompareOp::NotEqual, lhs, rhs, context);
+    }
+
+    bool Greater(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        return Compare(CompareOp::Greater, lhs, rhs, context);
+    }
+
+    bool LessOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        return Compare(CompareOp::LessOrEqual, lhs, rhs, context);
+    }
+
+    bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        return Compare(CompareOp::GreaterOrEqual, lhs, rhs, context);
+    }
+
+    bool Compare(CompareOp op, const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        if (lhs && rhs && lhs->Kind() == rhs->Kind()) {
+            if (lhs->Kind() == ObjectKind::Number) {
+                return ApplyCompareOp(op, static_cast<const Number&>(*lhs).GetValue(),
+                                      static_cast<const Number&>(*rhs).GetValue());
+            }
+
+            if (lhs->Kind() == ObjectKind::String) {
+                const auto& l_string = static_cast<const String&>(*lhs);
+                const auto& r_string = static_cast<const String&>(*rhs);
 
-        if (l_ptr_n != nullptr && r_ptr_n != nullptr) {
-            return l_ptr_n->GetValue() < r_ptr_n->GetValue();
+                if (op == CompareOp::Equal || op == CompareOp::NotEqual) {
+                    return StringsEqual(l_string, r_string) == (op == CompareOp::Equal);
+                }
+                return ApplyCompareOp(op, CompareStrings(l_string, r_string), 0);
+            }
         }
 
-        auto l_ptr_s = lhs.TryAs<runtime::String>();
-        auto r_ptr_s = rhs.TryAs<runtime::String>();
+        if (lhs && lhs->Kind() == ObjectKind::ClassInstance) {
+            auto& instance = static_cast<ClassInstance&>(*lhs);
+            const Class& cls = instance.GetClass();
+            const Method* cmp = cls.GetSpecialMethod(SpecialMethod::Cmp);
+            const bool equality = op == CompareOp::Equal || op == CompareOp::NotEqual;
+
+            if (cmp != nullptr && !(equality && cls.GetSpecialMethod(SpecialMethod::Eq) != nullptr)) {
+                return ApplyCompareOp(op, CallCmp(instance, *cmp, rhs, context), 0);
+            }
+        }
 
-        if (l_ptr_s != nullptr && r_ptr_s != nullptr) {
-            return l_ptr_s->GetValue() < r_ptr_s->GetValue();
+        switch (op) {
+            case CompareOp::Equal:
+                return Equal(lhs, rhs, context);
+            case CompareOp::NotEqual:
+                return !Equal(lhs, rhs, context);
+            case CompareOp::Less:
+                return Less(lhs, rhs, context);
+            case CompareOp::Greater:
+                return !Less(lhs, rhs, context) && !Equal(lhs, rhs, context);
+            case CompareOp::LessOrEqual:
+                return Less(lhs, rhs, context) || Equal(lhs, rhs, context);
+            case CompareOp::GreaterOrEqual:
+                return !Less(lhs, rhs, context);
         }
 
-        auto l_ptr_b = lhs.TryAs<runtime::Bool>();
-        auto r_ptr_b = rhs.TryAs<runtime::Bool>();
+        return false;
+    }
 
-        if (l_ptr_b != nullptr && r_ptr_b != nullptr) {
-            return l_ptr_b->GetValue() < r_ptr_b->GetValue();
+    namespace {
+        // Integer arithmetic: int64_t first, arbitrary precision when the checked int64_t
+        // operation overflows (returns true) or an operand is already a BigNumber.
+        // Returns nullopt if an operand is not an integer.
+        template <typename Int64Operation, typename BigOperation>
+        std::optional<ObjectHolder> IntegerOperation(const ObjectHolder& lhs, const ObjectHolder& rhs,
+                                                     Int64Operation int64_operation, BigOperation big_operation) {
+            const auto* l_num = lhs.TryAs<Number>();
+            const auto* r_num = rhs.TryAs<Number>();
+
+            if (l_num != nullptr && r_num != nullptr) {
+                int64_t result;
+                if (!int64_operation(l_num->GetValue(), r_num->GetValue(), result)) {
+                    return MakeNumber(result);
+                }
+            }
+
+            BigInt l_value;
+            BigInt r_value;
+            if (!TryGetInteger(lhs, l_value) || !TryGetInteger(rhs, r_value)) {
+                return std::nullopt;
+            }
+
+            return MakeInteger(big_operation(l_value, r_value));
         }
+    } // namespace
 
-        auto l_ptr_class_inst = lhs.TryAs<runtime::ClassInstance>();
+    ObjectHolder Add(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
+        if (!lhs) {
+            throw std::runtime_error("incorrect add operands"s);
+        }
 
-        constexpr int LT_METHOD_ARGS_COUNT = 1;
-        if (l_ptr_class_inst != nullptr && l_ptr_class_inst->HasMethod(LT_METHOD, LT_METHOD_ARGS_COUNT)) {
-            auto res = l_ptr_class_inst->Call(LT_METHOD, { rhs }, context);
-            return res.TryAs<Bool>()->GetValue();
+        const ObjectKind kind = lhs->Kind();
+        const bool same_kind = rhs && rhs->Kind() == kind;
+
+        switch (kind) {
+            case ObjectKind::Number:
+            case ObjectKind::BigNumber: {
+                auto result = IntegerOperation(
+                    lhs, rhs,
+                    [](int64_t l_value, int64_t r_value, int64_t& result) {
+                        return __builtin_add_overflow(l_value, r_value, &result);
+                    },
+                    [](const BigInt& l_value, const BigInt& r_value) {
+                        return l_value + r_value;
+                    });
+
+                if (result) {
+                    return std::move(*result);
+                }
+                break;
+            }
+            case ObjectKind::String:
+                if (same_kind) {
+                    return String::Concat(lhs, rhs);
+                }
+                break;
+            case ObjectKind::ClassInstance: {
+                auto& lhs_class_inst = static_cast<ClassInstance&>(*lhs);
+
+                if (auto add_method = lhs_class_inst.GetClass().GetSpecialMethod(SpecialMethod::Add)) {
+                    return lhs_class_inst.Call(*add_method, { rhs }, context);
+                }
+                break;
+            }
+            default:
+                break;
         }
 
-        throw std::runtime_error("Cannot compare objects for less"s);
+        throw std::runtime_error("incorrect add operands"s);
     }
 
-    bool NotEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
-        return !Equal(lhs, rhs, context);
+    ObjectHolder Sub(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& /* context */) {
+        auto result = IntegerOperation(
+            lhs, rhs,
+            [](int64_t l_value, int64_t r_value, int64_t& result) {
+                return __builtin_sub_overflow(l_value, r_value, &result);
+            },
+            [](const BigInt& l_value, const BigInt& r_value) {
+                return l_value - r_value;
+            });
+
+        if (!result) {
+            throw std::runtime_error("incorrect sub operands"s);
+        }
+        return std::move(*result);
     }
 
-    bool Greater(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
-        return !Less(lhs, rhs, context) && !Equal(lhs, rhs, context);
+    ObjectHolder Mult(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& /* context */) {
+        auto result = IntegerOperation(
+            lhs, rhs,
+            [](int64_t l_value, int64_t r_value, int64_t& result) {
+                return __builtin_mul_overflow(l_value, r_value, &result);
+            },
+            [](const BigInt& l_value, const BigInt& r_value) {
+                return l_value * r_value;
+            });
+
+        if (!result) {
+            throw std::runtime_error("incorrect mult operands"s);
+        }
+        return std::move(*result);
     }
 
-    bool LessOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
-        return Less(lhs, rhs, context) || Equal(lhs, rhs, context);
+    ObjectHolder Div(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& /* context */) {
+        auto result = IntegerOperation(
+            lhs, rhs,
+            [](int64_t l_value, int64_t r_value, int64_t& result) {
+                if (r_value == 0) {
+                    throw std::runtime_error("division by zero"s);
+                }
+                // INT64_MIN / -1 is the only overflowing quotient
+                if (l_value == INT64_MIN && r_value == -1) {
+                    return true;
+                }
+                result = l_value / r_value;
+                return false;
+            },
+            [](const BigInt& l_value, const BigInt& r_value) {
+                return l_value / r_value;
+            });
+
+        if (!result) {
+            throw std::runtime_error("incorrect div operands"s);
+        }
+        return std::move(*result);
     }
 
-    bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context) {
-        return !Less(lhs, rhs, context);
+    ObjectHolder Stringify(const ObjectHolder& object) {
+        if (!object) {
+            return ObjectHolder::Own(String{ "None"s });
+        }
+
+        DummyContext dummy_context;
+        object->Print(dummy_context.GetOutputStream(), dummy_context);
+
+        return ObjectHolder::Own(String{ dummy_context.output.str() });
     }
 
-} // namespace runtime
\ No newline at end of file
+} // namespace runtime
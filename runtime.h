@@ -1,8 +1,15 @@
 #pragma once
 
+#include "arena.h"
+#include "bignum.h"
+#include "cycle_collector.h"
+#include "symbol.h"
+
+#include <array>
 #include <memory>
 #include <sstream>
 #include <string>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -16,19 +23,151 @@ namespace runtime {
         ~Context() = default;
     };
 
+    // Compact type tag checked on the hot path instead of an RTTI walk.
+    // Objects defined outside the runtime (tests, extensions) are tagged Extension.
+    enum class ObjectKind : unsigned char {
+        Number,
+        BigNumber,
+        String,
+        Bool,
+        Class,
+        ClassInstance,
+        Extension,
+    };
+
+    // Objects carry an intrusive, non-atomic reference count. Only objects created by
+    // ObjectHolder::Own() are counted and freed; objects living on the stack, inside
+    // AST nodes or in static storage are unowned and ObjectHolder never touches them.
     class Object {
     public:
+        Object() = default;
+        Object(const Object& other)
+            : kind_(other.kind_) {
+        }
+        Object& operator=(const Object& /*other*/) {
+            return *this;
+        }
         virtual ~Object() = default;
         virtual void Print(std::ostream& os, Context& context) = 0;
+
+        ObjectKind Kind() const {
+            return kind_;
+        }
+
+    protected:
+        explicit Object(ObjectKind kind)
+            : kind_(kind) {
+        }
+
+    private:
+        friend class ObjectHolder;
+        friend class CycleCollector;
+
+        unsigned ref_count_ = 0;
+        ObjectKind kind_ = ObjectKind::Extension;
+        bool owned_ = false;
+        unsigned char size_class_ = Arena::NO_SIZE_CLASS;
+    };
+
+    class Class;
+    class ClassInstance;
+
+    template <typename T>
+    class ValueObject;
+
+    class String;
+    class Bool;
+
+    template <typename T>
+    struct KindOf : std::integral_constant<ObjectKind, ObjectKind::Extension> {};
+
+    template <>
+    struct KindOf<ValueObject<int64_t>> : std::integral_constant<ObjectKind, ObjectKind::Number> {};
+
+    template <>
+    struct KindOf<ValueObject<BigInt>> : std::integral_constant<ObjectKind, ObjectKind::BigNumber> {};
+
+    template <>
+    struct KindOf<String> : std::integral_constant<ObjectKind, ObjectKind::String> {};
+
+    template <>
+    struct KindOf<Bool> : std::integral_constant<ObjectKind, ObjectKind::Bool> {};
+
+    template <>
+    struct KindOf<Class> : std::integral_constant<ObjectKind, ObjectKind::Class> {};
+
+    template <>
+    struct KindOf<ClassInstance> : std::integral_constant<ObjectKind, ObjectKind::ClassInstance> {};
+
+    template <typename T>
+    class ValueObject : public Object {
+    public:
+        ValueObject(T v)
+            : Object(KindOf<ValueObject<T>>::value)
+            , value_(v) {
+        }
+
+        void Print(std::ostream& os, [[maybe_unused]] Context& context) override {
+            os << value_;
+        }
+
+        const T& GetValue() const {
+            return value_;
+        }
+
+    protected:
+        ValueObject(ObjectKind kind, T v)
+            : Object(kind)
+            , value_(v) {
+        }
+
+    private:
+        T value_;
     };
 
+    // Integers are int64_t; arithmetic that overflows it produces a BigNumber, and
+    // BigNumber results that fit int64_t again are turned back into Numbers
+    using Number = ValueObject<int64_t>;
+    using BigNumber = ValueObject<BigInt>;
+
+    class Bool : public ValueObject<bool> {
+    public:
+        Bool(bool v)
+            : ValueObject<bool>(ObjectKind::Bool, v) {
+        }
+
+        void Print(std::ostream& os, Context& context) override;
+    };
+
+    // Numbers and Bools are stored inline (unboxed) inside the holder, so producing
+    // them never touches the heap. Get() and TryAs<Number>() return a pointer to the
+    // inline object, which stays valid as long as the holder itself is alive.
     class ObjectHolder {
     public:
         ObjectHolder() = default;
 
+        ObjectHolder(const ObjectHolder& other);
+        ObjectHolder(ObjectHolder&& other) noexcept;
+        ~ObjectHolder();
+
+        ObjectHolder& operator=(const ObjectHolder& other);
+        ObjectHolder& operator=(ObjectHolder&& other) noexcept;
+
         template <typename T>
         static ObjectHolder Own(T&& object) {
-            return ObjectHolder(std::make_shared<T>(std::forward<T>(object)));
+            using Type = std::decay_t<T>;
+            if constexpr (std::is_same_v<Type, Number> || std::is_same_v<Type, Bool>) {
+                return ObjectHolder(object);
+            } else if constexpr (KindOf<Type>::value == ObjectKind::String
+                                 || KindOf<Type>::value == ObjectKind::BigNumber
+                                 || KindOf<Type>::value == ObjectKind::ClassInstance) {
+                if (Arena* arena = Arena::Current()) {
+                    return ObjectHolder(NewInArena<Type>(*arena, std::forward<T>(object)));
+                }
+                return ObjectHolder(new Type(std::forward<T>(object)));
+            } else {
+                return ObjectHolder(new Type(std::forward<T>(object)));
+            }
         }
 
         static ObjectHolder Share(Object& object);
@@ -42,38 +181,211 @@ namespace runtime {
 
         template <typename T>
         [[nodiscard]] T* TryAs() const {
-            return dynamic_cast<T*>(this->Get());
+            if constexpr (std::is_same_v<T, Number>) {
+                if (storage_ == Storage::Number) {
+                    return &immediate_.number;
+                }
+            } else if constexpr (std::is_same_v<T, Bool>) {
+                if (storage_ == Storage::Bool) {
+                    return &immediate_.boolean;
+                }
+            }
+
+            if constexpr (KindOf<T>::value != ObjectKind::Extension) {
+                Object* object = this->Get();
+                return object != nullptr && object->Kind() == KindOf<T>::value ? static_cast<T*>(object)
+                                                                                : nullptr;
+            } else {
+                return dynamic_cast<T*>(this->Get());
+            }
         }
 
         explicit operator bool() const;
 
+        // Number of holders sharing a counted object; 0 for borrowed and inline values
+        unsigned UseCount() const {
+            return storage_ == Storage::Counted && data_ != nullptr ? data_->ref_count_ : 0;
+        }
+
+        // Where a holder keeps an inline Number, for the native code of jit::Compiler:
+        // it holds one if its byte at tag_offset is number_tag, and then the value is
+        // the int64_t at value_offset. Overwriting that value changes the Number.
+        struct NumberLayout {
+            size_t tag_offset;
+            unsigned char number_tag;
+            size_t value_offset;
+        };
+
+        static NumberLayout GetNumberLayout();
+
     private:
-        explicit ObjectHolder(std::shared_ptr<Object> data);
+        friend class CycleCollector;
+
+        // Counted holders own a reference to a heap object created by Own(); Borrowed
+        // ones point to an unowned object and never dereference it on their own.
+        enum class Storage : unsigned char { Counted, Borrowed, Number, Bool };
+
+        union Immediate {
+            Immediate() {
+            }
+            ~Immediate() {
+            }
+
+            Number number;
+            Bool boolean;
+        };
+
+        // Adopts a freshly created heap object
+        explicit ObjectHolder(Object* data);
+        explicit ObjectHolder(const Number& number);
+        explicit ObjectHolder(const Bool& boolean);
+
         void AssertIsValid() const;
+        void CopyStorage(const ObjectHolder& other);
+
+        template <typename Type, typename T>
+        static Object* NewInArena(Arena& arena, T&& object) {
+            unsigned char size_class;
+            void* memory = arena.Allocate(sizeof(Type), size_class);
+
+            if (memory == nullptr) {
+                return new Type(std::forward<T>(object));
+            }
+
+            try {
+                Object* data = new (memory) Type(std::forward<T>(object));
+                data->size_class_ = size_class;
+                return data;
+            } catch (...) {
+                arena.Deallocate(memory, size_class);
+                throw;
+            }
+        }
 
-        std::shared_ptr<Object> data_;
+        // Frees the object; instances are handed to the cycle collector or, outside a
+        // run, freed iteratively so that long chains do not recurse
+        static void Destroy(Object* data);
+        // Runs the destructor and returns the memory right away
+        static void Delete(Object* data);
+
+        void Retain() const {
+            if (storage_ == Storage::Counted && data_ != nullptr) {
+                ++data_->ref_count_;
+            }
+        }
+
+        static void Release(Object* data, Storage storage) {
+            if (storage == Storage::Counted && data != nullptr) {
+                if (--data->ref_count_ == 0) {
+                    Destroy(data);
+                } else if (data->kind_ == ObjectKind::ClassInstance) {
+                    AddPossibleRoot(data);
+                }
+            }
+        }
+
+        // The instance may have just become the entry of a garbage cycle
+        static void AddPossibleRoot(Object* data);
+
+        Object* data_ = nullptr;
+        mutable Immediate immediate_;
+        Storage storage_ = Storage::Counted;
     };
 
-    template <typename T>
-    class ValueObject : public Object {
+    // Immutable character buffer shared by all Strings holding the same value. The
+    // hash is computed on first use and cached.
+    class StringBuffer {
     public:
-        ValueObject(T v)
-            : value_(v) {
+        explicit StringBuffer(std::string value)
+            : value_(std::move(value)) {
         }
 
-        void Print(std::ostream& os, [[maybe_unused]] Context& context) override {
-            os << value_;
+        const std::string& GetValue() const {
+            return value_;
         }
 
-        const T& GetValue() const {
-            return value_;
+        size_t GetHash() const;
+
+    private:
+        std::string value_;
+        mutable size_t hash_ = 0;
+        mutable bool has_hash_ = false;
+    };
+
+    // A string is either flat or a concatenation node (rope) of two other strings.
+    // Concatenation nodes are flattened lazily the first time the value is read, so
+    // building a string by repeated concatenation takes linear time. Flat strings
+    // share an immutable buffer, so copying one never copies the characters.
+    class String : public Object {
+    public:
+        String(std::string value)
+            : String(std::make_shared<const StringBuffer>(std::move(value))) {
+        }
+
+        explicit String(std::shared_ptr<const StringBuffer> buffer)
+            : Object(ObjectKind::String)
+            , buffer_(std::move(buffer))
+            , size_(buffer_->GetValue().size()) {
+        }
+
+        String(const String& other) = default;
+        String(String&& other) = default;
+        ~String() override;
+
+        // Both holders must point to Strings
+        static ObjectHolder Concat(const ObjectHolder& lhs, const ObjectHolder& rhs);
+
+        void Print(std::ostream& os, Context& context) override;
+
+        const std::string& GetValue() const {
+            return GetBuffer()->GetValue();
+        }
+
+        const std::shared_ptr<const StringBuffer>& GetBuffer() const {
+            if (!IsFlat()) {
+                Flatten();
+            }
+            return buffer_;
+        }
+
+        size_t GetSize() const {
+            return size_;
+        }
+
+        bool IsFlat() const {
+            return !left_;
         }
 
     private:
-        T value_;
+        // Shorter results are copied right away: a node costs more than the copy
+        static constexpr size_t MIN_ROPE_SIZE = 64;
+
+        String(ObjectHolder left, ObjectHolder right, size_t size);
+
+        void Flatten() const;
+
+        mutable std::shared_ptr<const StringBuffer> buffer_;
+        mutable ObjectHolder left_;
+        mutable ObjectHolder right_;
+        size_t size_ = 0;
     };
 
-    using Closure = std::unordered_map<std::string, ObjectHolder>;
+    using Closure = std::unordered_map<Symbol, ObjectHolder>;
+
+    // The value is stored inline in the holder, see ObjectHolder
+    inline ObjectHolder MakeBool(bool value) {
+        return ObjectHolder::Own(Bool{ value });
+    }
+
+    inline ObjectHolder MakeNumber(int64_t value) {
+        return ObjectHolder::Own(Number{ value });
+    }
+
+    // Returns a Number if the value fits int64_t and a BigNumber otherwise
+    ObjectHolder MakeInteger(BigInt value);
+
+    // Reads a Number or BigNumber; returns false for other objects
+    bool TryGetInteger(const ObjectHolder& object, BigInt& value);
 
     bool IsTrue(const ObjectHolder& object);
 
@@ -83,27 +395,213 @@ namespace runtime {
         virtual ObjectHolder Execute(Closure& closure, Context& context) = 0;
     };
 
-    using String = ValueObject<std::string>;
-    using Number = ValueObject<int>;
+    struct Method {
+        std::string name;
+        std::vector<Symbol> formal_params;
+        std::unique_ptr<Executable> body;
+        // Number of frame slots (self, parameters, locals) if the parser resolved the
+        // variables of the body to slots, 0 if the body works on a Closure
+        size_t frame_size = 0;
+        // Distinct fields the body assigns on self; for __init__ this presizes the
+        // field slots of new instances
+        size_t self_field_count = 0;
+        // Calls counted by CallInFrame and the body compiled once the method got hot,
+        // see MethodCompiler. The compiled body replaces `body` on later calls.
+        mutable size_t call_count = 0;
+        mutable std::unique_ptr<Executable> compiled_body = nullptr;
+    };
 
-    class Bool : public ValueObject<bool> {
+    // Hidden class of an instance: the ordered list of its field names. Instances that
+    // got the same fields in the same order share one shape, so an instance only keeps
+    // a vector of slots. Shapes form a transition tree rooted at their Class.
+    class Shape {
     public:
-        using ValueObject<bool>::ValueObject;
+        static constexpr size_t NO_SLOT = static_cast<size_t>(-1);
 
-        void Print(std::ostream& os, Context& context) override;
+        Shape() = default;
+        Shape(const Shape&) = delete;
+        Shape& operator=(const Shape&) = delete;
+
+        // Returns NO_SLOT if the shape has no such field
+        size_t FindSlot(Symbol field) const;
+
+        // Shape with the field appended, created on first use and cached
+        Shape* AddField(Symbol field);
+
+        size_t GetFieldCount() const {
+            return fields_.size();
+        }
+
+        Symbol GetField(size_t slot) const {
+            return fields_[slot];
+        }
+
+    private:
+        std::vector<Symbol> fields_;
+        std::unordered_map<Symbol, size_t> field_to_slot_;
+        std::unordered_map<Symbol, std::unique_ptr<Shape>> transitions_;
     };
 
-    struct Method {
-        std::string name;
-        std::vector<std::string> formal_params;
-        std::unique_ptr<Executable> body;
+    // Fields of a class instance: a shape and one slot per field.
+    // Provides the map-like subset of the Closure interface.
+    class FieldTable {
+    public:
+        template <typename Holder>
+        struct Entry {
+            Symbol first;
+            Holder& second;
+
+            const Entry* operator->() const {
+                return this;
+            }
+        };
+
+        template <typename Table, typename Holder>
+        class Iterator {
+        public:
+            Iterator(Table* table, size_t slot)
+                : table_(table)
+                , slot_(slot) {
+            }
+
+            Entry<Holder> operator*() const {
+                return { table_->shape_->GetField(slot_), table_->slots_[slot_] };
+            }
+
+            Entry<Holder> operator->() const {
+                return **this;
+            }
+
+            Iterator& operator++() {
+                ++slot_;
+                return *this;
+            }
+
+            bool operator==(const Iterator& other) const {
+                return slot_ == other.slot_;
+            }
+
+            bool operator!=(const Iterator& other) const {
+                return slot_ != other.slot_;
+            }
+
+        private:
+            Table* table_;
+            size_t slot_;
+        };
+
+        using iterator = Iterator<FieldTable, ObjectHolder>;
+        using const_iterator = Iterator<const FieldTable, const ObjectHolder>;
+
+        explicit FieldTable(Shape& shape)
+            : shape_(&shape) {
+        }
+
+        // Adds the field (moving to the next shape) if it is missing
+        ObjectHolder& operator[](Symbol field);
+
+        ObjectHolder& at(Symbol field);
+        const ObjectHolder& at(Symbol field) const;
+
+        iterator find(Symbol field);
+        const_iterator find(Symbol field) const;
+
+        iterator begin() {
+            return { this, 0 };
+        }
+        iterator end() {
+            return { this, slots_.size() };
+        }
+        const_iterator begin() const {
+            return { this, 0 };
+        }
+        const_iterator end() const {
+            return { this, slots_.size() };
+        }
+
+        size_t count(Symbol field) const {
+            return shape_->FindSlot(field) == Shape::NO_SLOT ? 0 : 1;
+        }
+
+        size_t size() const {
+            return slots_.size();
+        }
+
+        bool empty() const {
+            return slots_.empty();
+        }
+
+        Shape& GetShape() {
+            return *shape_;
+        }
+
+        const Shape& GetShape() const {
+            return *shape_;
+        }
+
+        ObjectHolder& GetSlot(size_t slot) {
+            return slots_[slot];
+        }
+
+        const ObjectHolder& GetSlot(size_t slot) const {
+            return slots_[slot];
+        }
+
+        void Reserve(size_t count) {
+            slots_.reserve(count);
+        }
+
+        // Appends a field using a transition already resolved from the current shape
+        ObjectHolder& AddSlot(Shape& next_shape) {
+            shape_ = &next_shape;
+            return slots_.emplace_back();
+        }
+
+    private:
+        Shape* shape_;
+        std::vector<ObjectHolder> slots_;
+    };
+
+    // Dense process-wide index of a method name. Every Class lays out its flattened
+    // method table by these slots, so dispatch is an array index.
+    constexpr size_t NO_METHOD_SLOT = static_cast<size_t>(-1);
+
+    // Assigns a slot to the name on first use
+    size_t GetMethodSlot(Symbol name);
+    // Returns NO_METHOD_SLOT if no class has a method with this name
+    size_t FindMethodSlot(Symbol name);
+
+    // Special methods resolved once per class into typed slots
+    enum class SpecialMethod {
+        Init,
+        Str,
+        Eq,
+        Lt,
+        Cmp,
+        Add,
+        Count,
     };
 
     class Class : public Object {
     public:
         explicit Class(std::string name, std::vector<Method> methods, const Class* parent);
 
-        const Method* GetMethod(const std::string& name) const;
+        // Returns nullptr if the class has no such method or it takes a wrong number of
+        // parameters (__init__ may take any number)
+        const Method* GetSpecialMethod(SpecialMethod method) const {
+            return special_methods_[static_cast<size_t>(method)];
+        }
+
+        const Method* GetMethod(Symbol name) const;
+
+        const Method* GetMethodBySlot(size_t slot) const {
+            return slot < method_table_.size() ? method_table_[slot] : nullptr;
+        }
+
+        // Methods defined by this class itself, without the inherited ones
+        const std::vector<Method>& GetMethods() const {
+            return methods_;
+        }
 
         const std::string& GetName() const;
 
@@ -111,32 +609,67 @@ namespace runtime {
 
         const Class* GetParent() const;
 
+        // Shape of a freshly created instance
+        Shape& GetRootShape() const;
+
+        // Number of fields __init__ is expected to add, see Method::self_field_count
+        size_t GetInstanceFieldCount() const {
+            return instance_field_count_;
+        }
+
     private:
         std::string name_;
         std::vector<Method> methods_;
         const Class* parent_;
+        std::unique_ptr<Shape> root_shape_ = std::make_unique<Shape>();
+        size_t instance_field_count_ = 0;
 
-        std::unordered_map<std::string_view, const Method*> name_to_method_;
+        // Methods of the whole inheritance chain indexed by method slot
+        std::vector<const Method*> method_table_;
+        std::array<const Method*, static_cast<size_t>(SpecialMethod::Count)> special_methods_{};
     };
 
     class ClassInstance : public Object {
     public:
         explicit ClassInstance(const Class& cls);
+        // Copies the class and the fields; the copy is not known to the cycle collector
+        ClassInstance(const ClassInstance& other);
+        // Takes over the fields, which keep their reserved capacity
+        ClassInstance(ClassInstance&& other) noexcept;
+        ~ClassInstance() override;
 
         void Print(std::ostream& os, Context& context) override;
 
-        ObjectHolder Call(const std::string& method, const std::vector<ObjectHolder>& actual_args,
+        ObjectHolder Call(Symbol method, const std::vector<ObjectHolder>& actual_args, Context& context);
+
+        // Calls an already resolved method of the instance's class, the caller checks
+        // that the number of arguments matches
+        ObjectHolder Call(const Method& method, const std::vector<ObjectHolder>& actual_args,
                           Context& context);
 
-        bool HasMethod(const std::string& method, size_t argument_count) const;
+        const Class& GetClass() const {
+            return cls_;
+        }
+
+        bool HasMethod(Symbol method, size_t argument_count) const;
 
-        Closure& Fields();
+        FieldTable& Fields();
 
-        const Closure& Fields() const;
+        const FieldTable& Fields() const;
 
     private:
+        friend class CycleCollector;
+
+        static constexpr uint32_t NO_GC_ROOT = static_cast<uint32_t>(-1);
+
+        // Trial deletion colors, see CycleCollector
+        enum class GcColor : unsigned char { Black, Gray, White, Garbage };
+
         const Class& cls_;
-        Closure fields_;
+        FieldTable fields_;
+        // Position in the collector's candidate buffer
+        uint32_t gc_root_index_ = NO_GC_ROOT;
+        GcColor gc_color_ = GcColor::Black;
     };
 
     bool Equal(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
@@ -147,6 +680,50 @@ namespace runtime {
     bool LessOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
     bool GreaterOrEqual(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
 
+    enum class CompareOp {
+        Equal,
+        NotEqual,
+        Less,
+        Greater,
+        LessOrEqual,
+        GreaterOrEqual,
+    };
+
+    template <typename T>
+    bool ApplyCompareOp(CompareOp op, const T& lhs, const T& rhs) {
+        switch (op) {
+            case CompareOp::Equal:
+                return lhs == rhs;
+            case CompareOp::NotEqual:
+                return !(lhs == rhs);
+            case CompareOp::Less:
+                return lhs < rhs;
+            case CompareOp::Greater:
+                return rhs < lhs;
+            case CompareOp::LessOrEqual:
+                return !(rhs < lhs);
+            case CompareOp::GreaterOrEqual:
+                return !(lhs < rhs);
+        }
+        return false;
+    }
+
+    // Numbers and strings of the same kind are compared directly. A class instance
+    // defining __cmp__ (returning a negative, zero or positive number) is compared with
+    // a single call to it, except that == and != prefer __eq__. Anything else goes
+    // through Equal and Less.
+    bool Compare(CompareOp op, const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+
+    // Arithmetic of Mython: int64_t, promoted to BigNumber when the result overflows.
+    // Add also concatenates strings and calls __add__ of class instances.
+    ObjectHolder Add(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+    ObjectHolder Sub(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+    ObjectHolder Mult(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+    ObjectHolder Div(const ObjectHolder& lhs, const ObjectHolder& rhs, Context& context);
+
+    // Result of str(object)
+    ObjectHolder Stringify(const ObjectHolder& object);
+
     struct DummyContext : Context {
         std::ostream& GetOutputStream() override {
             return output;
@@ -18,7 +18,8 @@ namespace runtime {
             }
 
             Logger(const Logger& rhs)
-                : id_(rhs.id_) {
+                : Object(rhs)
+                , id_(rhs.id_) {
                 ++instance_count;
             }
 
@@ -67,6 +68,72 @@ namespace runtime {
             ASSERT_EQUAL(word.GetValue(), "hello!"s);
         }
 
+        void TestObjectKinds() {
+            Class cls{ "Empty"s, {}, nullptr };
+            ClassInstance inst{ cls };
+            Logger logger;
+
+            ASSERT(Number(1).Kind() == ObjectKind::Number);
+            ASSERT(String("s"s).Kind() == ObjectKind::String);
+            ASSERT(Bool(true).Kind() == ObjectKind::Bool);
+            ASSERT(cls.Kind() == ObjectKind::Class);
+            ASSERT(inst.Kind() == ObjectKind::ClassInstance);
+            ASSERT(logger.Kind() == ObjectKind::Extension);
+
+            ASSERT(ObjectHolder::Share(inst).TryAs<ClassInstance>() == &inst);
+            ASSERT(ObjectHolder::Share(cls).TryAs<ClassInstance>() == nullptr);
+            ASSERT(ObjectHolder::Share(logger).TryAs<Logger>() == &logger);
+            ASSERT(ObjectHolder::Share(logger).TryAs<String>() == nullptr);
+            ASSERT(ObjectHolder::None().TryAs<Class>() == nullptr);
+        }
+
+        void TestSymbols() {
+            Symbol x("x"s);
+            ASSERT(x == Symbol("x"sv));
+            ASSERT(x != Symbol("y"));
+            ASSERT_EQUAL(x.GetName(), "x"s);
+            ASSERT_EQUAL(Symbol().GetName(), ""s);
+
+            Closure closure{ { "x"s, ObjectHolder::Own(Number{ 1 }) } };
+            ASSERT_EQUAL(closure.count(x), 1U);
+            ASSERT_EQUAL(closure.at("x"s).TryAs<Number>()->GetValue(), 1);
+        }
+
+        void TestShapes() {
+            Class cls{ "Point"s, {}, nullptr };
+            ClassInstance a{ cls };
+            ClassInstance b{ cls };
+            ClassInstance c{ cls };
+
+            ASSERT(&a.Fields().GetShape() == &cls.GetRootShape());
+
+            a.Fields()["x"s] = ObjectHolder::Own(Number{ 1 });
+            a.Fields()["y"s] = ObjectHolder::Own(Number{ 2 });
+            b.Fields()["x"s] = ObjectHolder::Own(Number{ 3 });
+            b.Fields()["y"s] = ObjectHolder::Own(Number{ 4 });
+            c.Fields()["y"s] = ObjectHolder::Own(Number{ 5 });
+            c.Fields()["x"s] = ObjectHolder::Own(Number{ 6 });
+
+            ASSERT(&a.Fields().GetShape() == &b.Fields().GetShape());
+            ASSERT(&a.Fields().GetShape() != &c.Fields().GetShape());
+
+            ASSERT_EQUAL(a.Fields().GetShape().FindSlot("y"s), 1U);
+            ASSERT_EQUAL(c.Fields().GetShape().FindSlot("y"s), 0U);
+            ASSERT_EQUAL(b.Fields().GetSlot(1).TryAs<Number>()->GetValue(), 4);
+
+            b.Fields()["x"s] = ObjectHolder::Own(Number{ 7 });
+            ASSERT_EQUAL(b.Fields().size(), 2U);
+            ASSERT_EQUAL(b.Fields().at("x"s).TryAs<Number>()->GetValue(), 7);
+            ASSERT(b.Fields().find("z"s) == b.Fields().end());
+            ASSERT_THROWS(b.Fields().at("z"s), std::out_of_range);
+
+            int sum = 0;
+            for (auto it = c.Fields().begin(); it != c.Fields().end(); ++it) {
+                sum += it->second.TryAs<Number>()->GetValue();
+            }
+            ASSERT_EQUAL(sum, 11);
+        }
+
         struct TestMethodBody : Executable {
             using Fn = std::function<ObjectHolder(Closure& closure, Context& context)>;
             Fn body;
@@ -253,6 +320,277 @@ namespace runtime {
             }
         }
 
+        void TestShareOwned() {
+            ASSERT_EQUAL(Logger::instance_count, 0);
+            {
+                ObjectHolder shared;
+                {
+                    auto owner = ObjectHolder::Own(Logger(5));
+                    shared = ObjectHolder::Share(*owner);
+                    ASSERT(shared.Get() == owner.Get());
+                }
+                ASSERT_EQUAL(Logger::instance_count, 1);
+
+                ObjectHolder copy = shared;
+                shared = ObjectHolder::None();
+                ASSERT_EQUAL(Logger::instance_count, 1);
+                ASSERT_EQUAL(copy.TryAs<Logger>()->GetId(), 5);
+            }
+            ASSERT_EQUAL(Logger::instance_count, 0);
+        }
+
+        void TestImmediateValues() {
+            auto num = ObjectHolder::Own(Number{ 42 });
+            auto flag = ObjectHolder::Own(Bool{ true });
+            ASSERT(num && flag);
+
+            ASSERT(num.TryAs<Number>() != nullptr);
+            ASSERT_EQUAL(num.TryAs<Number>()->GetValue(), 42);
+            ASSERT(num.TryAs<Bool>() == nullptr);
+            ASSERT(num.TryAs<String>() == nullptr);
+            ASSERT(flag.TryAs<Bool>() != nullptr);
+            ASSERT(flag.TryAs<Number>() == nullptr);
+
+            ObjectHolder copy = num;
+            ASSERT(copy.Get() != num.Get());
+            ASSERT_EQUAL(copy.TryAs<Number>()->GetValue(), 42);
+
+            ObjectHolder moved = std::move(flag);
+            ASSERT(!flag);
+            ASSERT(moved.TryAs<Bool>()->GetValue());
+
+            moved = copy;
+            ASSERT_EQUAL(moved.TryAs<Number>()->GetValue(), 42);
+
+            DummyContext context;
+            moved->Print(context.output, context);
+            ASSERT_EQUAL(context.output.str(), "42"s);
+        }
+
+        void TestArenaAllocation() {
+            Arena arena;
+            ASSERT(Arena::Current() == nullptr);
+            {
+                Arena::Scope scope(arena);
+                ASSERT(Arena::Current() == &arena);
+
+                auto str = ObjectHolder::Own(String{ "abc"s });
+                Object* first = str.Get();
+                ASSERT(&Arena::Owner(first) == &arena);
+                ASSERT(arena.GetReservedBytes() > 0U);
+
+                str = ObjectHolder::None();
+                auto again = ObjectHolder::Own(String{ "def"s });
+                ASSERT(again.Get() == first);
+                ASSERT_EQUAL(again.TryAs<String>()->GetValue(), "def"s);
+            }
+            ASSERT(Arena::Current() == nullptr);
+        }
+
+        void TestMakeValues() {
+            auto t = MakeBool(true);
+            ASSERT(IsTrue(t));
+            ASSERT(!IsTrue(MakeBool(false)));
+            ASSERT_EQUAL(t.UseCount(), 0U);
+
+            auto n = MakeNumber(42);
+            ASSERT_EQUAL(n.TryAs<Number>()->GetValue(), 42);
+            ASSERT_EQUAL(n.UseCount(), 0U);
+            ASSERT_EQUAL(MakeNumber(INT64_MIN).TryAs<Number>()->GetValue(), INT64_MIN);
+        }
+
+        void TestStringRope() {
+            const string chunk(40, 'x');
+            auto piece = ObjectHolder::Own(String{ chunk });
+
+            auto str = ObjectHolder::Own(String{ ""s });
+            for (int i = 0; i < 100000; ++i) {
+                str = String::Concat(str, piece);
+            }
+            auto& rope = *str.TryAs<String>();
+            ASSERT(!rope.IsFlat());
+            ASSERT_EQUAL(rope.GetSize(), chunk.size() * 100000);
+
+            auto longer = String::Concat(str, piece);
+            ASSERT_EQUAL(longer.TryAs<String>()->GetValue().size(), chunk.size() * 100001);
+            ASSERT(!rope.IsFlat());
+            ASSERT_EQUAL(rope.GetValue().substr(0, 40), chunk);
+            ASSERT(rope.IsFlat());
+
+            auto small = String::Concat(ObjectHolder::Own(String{ "ab"s }), ObjectHolder::Own(String{ "cd"s }));
+            ASSERT(small.TryAs<String>()->IsFlat());
+            ASSERT_EQUAL(small.TryAs<String>()->GetValue(), "abcd"s);
+
+            // Deep ropes nobody has read are released without recursion
+            str = ObjectHolder::Own(String{ ""s });
+            for (int i = 0; i < 100000; ++i) {
+                str = String::Concat(str, piece);
+            }
+            str = ObjectHolder::None();
+        }
+
+        void TestStringBuffers() {
+            DummyContext context;
+            String hello("hello"s);
+            String copy = hello;
+            ASSERT(copy.GetBuffer() == hello.GetBuffer());
+            ASSERT_EQUAL(hello.GetBuffer()->GetHash(), std::hash<std::string_view>{}("hello"sv));
+
+            auto lhs = ObjectHolder::Own(String{ hello.GetBuffer() });
+            auto same = ObjectHolder::Own(String{ "hello"s });
+            auto other = ObjectHolder::Own(String{ "hellp"s });
+            ASSERT(Equal(lhs, ObjectHolder::Share(copy), context));
+            ASSERT(Equal(lhs, same, context));
+            ASSERT(!Equal(lhs, other, context));
+            ASSERT(Less(lhs, other, context));
+            ASSERT(!Less(lhs, same, context));
+            ASSERT(!Less(lhs, ObjectHolder::Share(copy), context));
+
+            auto empty = ObjectHolder::Own(String{ ""s });
+            ASSERT(String::Concat(empty, lhs).TryAs<String>()->GetBuffer() == hello.GetBuffer());
+            ASSERT(!IsTrue(empty));
+        }
+
+        void TestBigInt() {
+            ASSERT_EQUAL(BigInt(INT64_MIN).ToString(), "-9223372036854775808"s);
+            ASSERT_EQUAL((BigInt(INT64_MAX) + BigInt(1)).ToString(), "9223372036854775808"s);
+
+            int64_t value = 0;
+            ASSERT(BigInt(INT64_MIN).ToInt64(value));
+            ASSERT_EQUAL(value, INT64_MIN);
+            ASSERT(!(BigInt(INT64_MAX) + BigInt(1)).ToInt64(value));
+            ASSERT((BigInt(INT64_MIN) - BigInt(1) + BigInt(1)).ToInt64(value));
+            ASSERT_EQUAL(value, INT64_MIN);
+
+            // 10^400 - 1 is long enough to be multiplied by Karatsuba
+            constexpr int DIGITS = 400;
+            BigInt nines(1);
+            for (int i = 0; i < DIGITS; ++i) {
+                nines = nines * BigInt(10);
+            }
+            nines = nines - BigInt(1);
+
+            BigInt square = nines * nines;
+            const string expected = string(DIGITS - 1, '9') + "8"s + string(DIGITS - 1, '0') + "1"s;
+            ASSERT_EQUAL(square.ToString(), expected);
+            ASSERT(BigInt(string_view(expected)) == square);
+            ASSERT_EQUAL(BigInt("0001000000000"sv).ToString(), "1000000000"s);
+            ASSERT_THROWS(BigInt("12a"sv), std::invalid_argument);
+            ASSERT(square / nines == nines);
+            ASSERT((square + nines - BigInt(1)) / nines == nines);
+            ASSERT((square + nines) / nines == nines + BigInt(1));
+            ASSERT((BigInt(0) - square) / nines == BigInt(0) - nines);
+            ASSERT(BigInt(0) - square < nines);
+            ASSERT(nines < square);
+            ASSERT_THROWS(square / BigInt(0), std::runtime_error);
+        }
+
+        void TestCycleCollector() {
+            Class cls("Node"s, {}, nullptr);
+            CycleCollector::Settings settings;
+            settings.root_threshold = 1'000'000;
+            CycleCollector collector(settings);
+            CycleCollector::Scope scope(collector);
+
+            {
+                auto a = ObjectHolder::Own(ClassInstance{ cls });
+                auto b = ObjectHolder::Own(ClassInstance{ cls });
+                a.TryAs<ClassInstance>()->Fields()["peer"s] = b;
+                b.TryAs<ClassInstance>()->Fields()["peer"s] = a;
+                b.TryAs<ClassInstance>()->Fields()["name"s] = ObjectHolder::Own(String{ "b"s });
+            }
+            ASSERT_EQUAL(collector.GetRootCount(), 2U);
+
+            // A cycle still referenced from outside survives
+            auto kept = ObjectHolder::Own(ClassInstance{ cls });
+            kept.TryAs<ClassInstance>()->Fields()["self"s] = kept;
+            {
+                auto tmp = kept;
+            }
+
+            collector.Collect();
+            ASSERT_EQUAL(collector.GetStats().collections, 1U);
+            ASSERT_EQUAL(collector.GetStats().reclaimed_objects, 2U);
+            ASSERT(collector.GetStats().reclaimed_bytes > 0U);
+            ASSERT(kept.TryAs<ClassInstance>()->Fields().at("self"s).Get() == kept.Get());
+
+            // A long ring is traversed without recursion
+            constexpr int RING_SIZE = 100000;
+            {
+                auto first = ObjectHolder::Own(ClassInstance{ cls });
+                auto last = first;
+                for (int i = 1; i < RING_SIZE; ++i) {
+                    auto next = ObjectHolder::Own(ClassInstance{ cls });
+                    last.TryAs<ClassInstance>()->Fields()["next"s] = next;
+                    last = next;
+                }
+                last.TryAs<ClassInstance>()->Fields()["next"s] = first;
+            }
+            collector.Collect();
+            ASSERT_EQUAL(collector.GetStats().reclaimed_objects, 2U + RING_SIZE);
+            ASSERT(kept.TryAs<ClassInstance>()->Fields().at("self"s).Get() == kept.Get());
+        }
+
+        void TestDeferredFree() {
+            Class cls("Node"s, {}, nullptr);
+            constexpr int LIST_SIZE = 1'000'000;
+
+            auto make_list = [&cls]() {
+                auto head = ObjectHolder::Own(ClassInstance{ cls });
+                for (int i = 1; i < LIST_SIZE; ++i) {
+                    auto node = ObjectHolder::Own(ClassInstance{ cls });
+                    node.TryAs<ClassInstance>()->Fields()["next"s] = std::move(head);
+                    head = std::move(node);
+                }
+                return head;
+            };
+
+            // Without a collector the list is destroyed at once but without recursion
+            {
+                auto head = make_list();
+            }
+
+            CycleCollector::Settings settings;
+            settings.free_batch_size = 10;
+            CycleCollector collector(settings);
+            CycleCollector::Scope scope(collector);
+            {
+                auto head = make_list();
+            }
+            ASSERT_EQUAL(collector.GetPendingFreeCount(), 1U);
+
+            CycleCollector::Safepoint();
+            ASSERT_EQUAL(collector.GetPendingFreeCount(), 1U);
+            ASSERT_EQUAL(collector.GetStats().deferred_frees, 11U);
+
+            collector.FreeAllPending();
+            ASSERT_EQUAL(collector.GetPendingFreeCount(), 0U);
+            ASSERT_EQUAL(collector.GetStats().deferred_frees, static_cast<size_t>(LIST_SIZE));
+
+            // A collector outliving its Scope still owns the instances it has queued or
+            // buffered: freeing them on destruction must forget their candidate entries
+            {
+                CycleCollector other(settings);
+                {
+                    CycleCollector::Scope other_scope(other);
+                    auto head = make_list();
+
+                    vector<ObjectHolder> nodes;
+                    for (ObjectHolder node = head; node; node = node.TryAs<ClassInstance>()->Fields().at("next"s)) {
+                        nodes.push_back(node);
+                        if (nodes.size() == 3000) {
+                            break;
+                        }
+                    }
+                    // Each node keeps a reference from its predecessor and is buffered
+                    nodes.clear();
+                }
+                ASSERT_EQUAL(other.GetPendingFreeCount(), 1U);
+                ASSERT(other.GetRootCount() > 0U);
+            }
+            ASSERT_EQUAL(CycleCollector::Current(), &collector);
+        }
+
         void TestNullptr() {
             ObjectHolder oh;
             ASSERT(!oh);
@@ -504,6 +842,9 @@ namespace runtime {
     void RunObjectsTests(TestRunner& tr) {
         RUN_TEST(tr, runtime::TestNumber);
         RUN_TEST(tr, runtime::TestString);
+        RUN_TEST(tr, runtime::TestObjectKinds);
+        RUN_TEST(tr, runtime::TestSymbols);
+        RUN_TEST(tr, runtime::TestShapes);
         RUN_TEST(tr, runtime::TestMethodInvocation);
     }
 
@@ -511,7 +852,16 @@ namespace runtime {
         RUN_TEST(tr, runtime::TestNonowning);
         RUN_TEST(tr, runtime::TestOwning);
         RUN_TEST(tr, runtime::TestMove);
+        RUN_TEST(tr, runtime::TestShareOwned);
+        RUN_TEST(tr, runtime::TestImmediateValues);
         RUN_TEST(tr, runtime::TestNullptr);
+        RUN_TEST(tr, runtime::TestArenaAllocation);
+        RUN_TEST(tr, runtime::TestMakeValues);
+        RUN_TEST(tr, runtime::TestStringRope);
+        RUN_TEST(tr, runtime::TestStringBuffers);
+        RUN_TEST(tr, runtime::TestBigInt);
+        RUN_TEST(tr, runtime::TestCycleCollector);
+        RUN_TEST(tr, runtime::TestDeferredFree);
     }
 
     void RunUserTests(TestRunner& tr) {
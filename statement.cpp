@@ -12,50 +12,133 @@ namespace ast {
     using runtime::ObjectHolder;
 
     namespace {
-        const string ADD_METHOD = "__add__"s;
-        const string INIT_METHOD = "__init__"s;
+        // Set by Return and cleared by the MethodBody it returns from
+        thread_local bool returning = false;
+
+        runtime::ObjectHolder* FindField(runtime::FieldTable& fields, runtime::Symbol field, FieldCache& cache) {
+            const runtime::Shape* shape = &fields.GetShape();
+
+            if (shape != cache.shape) {
+                size_t slot = shape->FindSlot(field);
+
+                if (slot == runtime::Shape::NO_SLOT) {
+                    return nullptr;
+                }
+
+                cache = { shape, nullptr, slot };
+            }
+
+            return &fields.GetSlot(cache.slot);
+        }
+    } // namespace
+
+    namespace {
+        VariableValue::Access SelectAccess(size_t id_count, size_t local_slot) {
+            if (local_slot != runtime::NO_LOCAL_SLOT) {
+                return id_count == 1 ? VariableValue::Access::Local
+                     : id_count == 2 ? VariableValue::Access::LocalField
+                                     : VariableValue::Access::Path;
+            }
+
+            return id_count == 1 ? VariableValue::Access::Global : VariableValue::Access::Path;
+        }
     } // namespace
 
-    VariableValue::VariableValue(std::string var_name) {
-        dotted_ids_.push_back(std::move(var_name));
+    VariableValue::VariableValue(std::string var_name)
+        : access_(Access::Global) {
+        dotted_ids_.emplace_back(var_name);
+        field_caches_.resize(dotted_ids_.size());
     }
 
-    VariableValue::VariableValue(std::vector<std::string> dotted_ids)
-        : dotted_ids_(std::move(dotted_ids)) {
+    VariableValue::VariableValue(std::vector<std::string> dotted_ids, size_t local_slot)
+        : dotted_ids_(dotted_ids.begin(), dotted_ids.end())
+        , local_slot_(local_slot)
+        , access_(SelectAccess(dotted_ids_.size(), local_slot))
+        , field_caches_(dotted_ids_.size()) {
     }
 
-    ObjectHolder VariableValue::Execute(Closure& closure, Context& /* context */) {
+    ObjectHolder& VariableValue::GetLocal() const {
+        auto& stack = runtime::CallStack::Get();
+        ObjectHolder& local = stack.Local(local_slot_);
 
-        Closure* closure_ptr = &closure;
+        if (stack.IsUnbound(local)) {
+            throw std::runtime_error("var is not found");
+        }
 
-        runtime::Closure::iterator current_obj_it;
+        return local;
+    }
 
-        for (const auto& var : dotted_ids_) {
+    ObjectHolder& VariableValue::GetGlobal(Closure& closure) const {
+        auto it = closure.find(dotted_ids_.front());
 
-            current_obj_it = closure_ptr->find(var);
+        if (it == closure.end()) {
+            throw std::runtime_error("var is not found");
+        }
 
-            if (current_obj_it == closure_ptr->end()) {
-                throw std::runtime_error("var is not found");
+        return it->second;
+    }
+
+    ObjectHolder VariableValue::Execute(Closure& closure, Context& /* context */) {
+        switch (access_) {
+            case Access::Local:
+                return GetLocal();
+            case Access::Global:
+                return GetGlobal(closure);
+            case Access::LocalField: {
+                ObjectHolder& object = GetLocal();
+                auto* instance = object.TryAs<runtime::ClassInstance>();
+
+                if (instance == nullptr) {
+                    return object;
+                }
+
+                ObjectHolder* field = FindField(instance->Fields(), dotted_ids_[1], field_caches_[1]);
+
+                if (field == nullptr) {
+                    throw std::runtime_error("var is not found");
+                }
+
+                return *field;
             }
+            case Access::Path:
+                break;
+        }
 
-            auto class_inst_current_ptr = current_obj_it->second.TryAs<runtime::ClassInstance>();
+        ObjectHolder* current_obj = local_slot_ != runtime::NO_LOCAL_SLOT ? &GetLocal() : &GetGlobal(closure);
+
+        for (size_t i = 1; i < dotted_ids_.size(); ++i) {
+
+            auto class_inst_current_ptr = current_obj->TryAs<runtime::ClassInstance>();
 
             if (class_inst_current_ptr == nullptr) {
-                return current_obj_it->second;
+                return *current_obj;
             }
 
-            closure_ptr = &class_inst_current_ptr->Fields();
+            current_obj = FindField(class_inst_current_ptr->Fields(), dotted_ids_[i], field_caches_[i]);
+
+            if (current_obj == nullptr) {
+                throw std::runtime_error("var is not found");
+            }
         }
 
-        return current_obj_it->second;
+        return *current_obj;
     }
 
-    Assignment::Assignment(std::string var, std::unique_ptr<Statement> rv)
-        : var_(std::move(var))
-        , rv_(std::move(rv)) {
+    Assignment::Assignment(std::string var, std::unique_ptr<Statement> rv, size_t local_slot)
+        : var_(var)
+        , rv_(std::move(rv))
+        , local_slot_(local_slot) {
     }
 
     ObjectHolder Assignment::Execute(Closure& closure, Context& context) {
+        if (local_slot_ != runtime::NO_LOCAL_SLOT) {
+            auto value = rv_->Execute(closure, context);
+            ObjectHolder& local = runtime::CallStack::Get().Local(local_slot_);
+            local = std::move(value);
+
+            return local;
+        }
+
         closure[var_] = std::move(rv_->Execute(closure, context));
 
         return closure.at(var_);
@@ -63,7 +146,7 @@ namespace ast {
 
     FieldAssignment::FieldAssignment(VariableValue object, std::string field_name, std::unique_ptr<Statement> rv)
         : object_(std::move(object))
-        , field_name_(std::move(field_name))
+        , field_name_(field_name)
         , rv_(std::move(rv)) {
     }
 
@@ -72,56 +155,134 @@ namespace ast {
 
         auto clacc_inst_ptr = obj.TryAs<runtime::ClassInstance>();
 
-        clacc_inst_ptr->Fields()[field_name_] = std::move(rv_->Execute(closure, context));
+        if (clacc_inst_ptr == nullptr) {
+            throw std::runtime_error("fields can be assigned only to class instances"s);
+        }
+
+        auto value = rv_->Execute(closure, context);
 
-        return clacc_inst_ptr->Fields().at(field_name_);
+        return Store(*clacc_inst_ptr, std::move(value));
+    }
+
+    ObjectHolder& FieldAssignment::Store(runtime::ClassInstance& instance, ObjectHolder value) {
+        runtime::FieldTable& fields = instance.Fields();
+        runtime::Shape& shape = fields.GetShape();
+
+        if (&shape != field_cache_.shape) {
+            size_t slot = shape.FindSlot(field_name_);
+
+            if (slot == runtime::Shape::NO_SLOT) {
+                field_cache_ = { &shape, shape.AddField(field_name_), shape.GetFieldCount() };
+            } else {
+                field_cache_ = { &shape, nullptr, slot };
+            }
+        }
+
+        ObjectHolder& field = field_cache_.next_shape != nullptr ? fields.AddSlot(*field_cache_.next_shape)
+                                                                 : fields.GetSlot(field_cache_.slot);
+        field = std::move(value);
+
+        return field;
     }
 
     NewInstance::NewInstance(const runtime::Class& class_)
-        : class_inst_(class_) {
+        : class_(class_) {
     }
 
     NewInstance::NewInstance(const runtime::Class& class_, std::vector<std::unique_ptr<Statement>> args)
-        : class_inst_(class_)
+        : class_(class_)
         , args_(std::move(args)) {
     }
 
+    // Every evaluation creates a new instance. Instances come from the arena's free
+    // lists, and their field slots are presized from the fields __init__ assigns.
     ObjectHolder NewInstance::Execute(Closure& closure, Context& context) {
+        auto instance = runtime::ObjectHolder::Own(runtime::ClassInstance(class_));
+        auto& class_inst = *instance.TryAs<runtime::ClassInstance>();
 
         std::vector<runtime::ObjectHolder> actual_args;
+        actual_args.reserve(args_.size());
 
         for (const auto& arg : args_) {
-            actual_args.push_back(std::move(arg->Execute(closure, context)));
+            actual_args.push_back(arg->Execute(closure, context));
         }
 
-        if (class_inst_.HasMethod(INIT_METHOD, args_.size())) {
-            class_inst_.Call(INIT_METHOD, std::move(actual_args), context);
+        auto init_method = class_.GetSpecialMethod(runtime::SpecialMethod::Init);
+
+        if (init_method != nullptr && init_method->formal_params.size() == args_.size()) {
+            class_inst.Call(*init_method, actual_args, context);
         }
 
-        return runtime::ObjectHolder::Share(class_inst_);
+        return instance;
     }
 
     MethodCall::MethodCall(std::unique_ptr<Statement> object, std::string method_name,
                            std::vector<std::unique_ptr<Statement>> args)
         : object_(std::move(object))
-        , method_name_(std::move(method_name))
+        , method_name_(method_name)
+        , method_slot_(runtime::GetMethodSlot(method_name_))
         , args_(std::move(args)) {
     }
 
+    const runtime::Method* MethodCall::FindMethod(const runtime::Class& cls) {
+        for (size_t i = 0; i < cache_size_; ++i) {
+            if (cache_[i].cls == &cls) {
+                return cache_[i].method;
+            }
+        }
+
+        const runtime::Method* method = cls.GetMethodBySlot(method_slot_);
+
+        if (method == nullptr || method->formal_params.size() != args_.size()) {
+            return nullptr;
+        }
+
+        if (!megamorphic_) {
+            if (cache_size_ < cache_.size()) {
+                cache_[cache_size_++] = { &cls, method };
+            } else {
+                megamorphic_ = true;
+            }
+        }
+
+        return method;
+    }
+
     ObjectHolder MethodCall::Execute(Closure& closure, Context& context) {
         auto obj = object_->Execute(closure, context);
 
         auto class_ptr = obj.TryAs<runtime::ClassInstance>();
 
+        if (class_ptr == nullptr) {
+            throw std::runtime_error("methods can be called only on class instances"s);
+        }
+
+        const runtime::Method* method = FindMethod(class_ptr->GetClass());
+
+        if (method == nullptr) {
+            throw std::runtime_error("No method found");
+        }
+
+        if (method->frame_size != 0) {
+            // Arguments are evaluated right into the callee's frame
+            runtime::CallStack::Frame frame(method->frame_size);
+
+            for (size_t i = 0; i < args_.size(); ++i) {
+                auto value = args_[i]->Execute(closure, context);
+                frame.Slot(i + 1) = std::move(value);
+            }
+            frame.Slot(0) = std::move(obj);
+
+            return runtime::CallInFrame(*method, frame, context);
+        }
+
         std::vector<runtime::ObjectHolder> actual_args;
 
         for (const auto& arg : args_) {
             actual_args.push_back(std::move(arg->Execute(closure, context)));
         }
 
-        auto res = class_ptr->Call(method_name_, actual_args, context);
-
-        return res;
+        return class_ptr->Call(*method, actual_args, context);
     }
 
     void Compound::AddStatement(std::unique_ptr<Statement> stmt) {
@@ -130,28 +291,26 @@ namespace ast {
 
     ObjectHolder Compound::Execute(Closure& closure, Context& context) {
         for (const auto& statement : statements_) {
-            statement->Execute(closure, context);
+            auto result = statement->Execute(closure, context);
+            runtime::CycleCollector::Safepoint();
+
+            if (returning) {
+                return result;
+            }
         }
 
         return {};
     }
 
-    RuntimeReturnExeption::RuntimeReturnExeption(const runtime::ObjectHolder& obj)
-        : obj_(obj) {
-    }
-
-    runtime::ObjectHolder RuntimeReturnExeption::GetValue() {
-        return obj_;
-    }
-
     Return::Return(std::unique_ptr<Statement> statement)
         : statement_(std::move(statement)) {
     }
 
     ObjectHolder Return::Execute(Closure& closure, Context& context) {
         auto obj = statement_->Execute(closure, context);
+        returning = true;
 
-        throw RuntimeReturnExeption(obj);
+        return obj;
     }
 
     MethodBody::MethodBody(std::unique_ptr<Statement>&& body)
@@ -159,24 +318,23 @@ namespace ast {
     }
 
     ObjectHolder MethodBody::Execute(Closure& closure, Context& context) {
+        auto result = body_->Execute(closure, context);
 
-        try {
-            body_->Execute(closure, context);
-        } catch (RuntimeReturnExeption& obj) {
-            return obj.GetValue();
+        if (!returning) {
+            return {};
         }
 
-        return {};
+        returning = false;
+        return result;
     }
 
     ClassDefinition::ClassDefinition(ObjectHolder cls)
-        : cls_(cls) {
+        : cls_(cls)
+        , name_(cls_.TryAs<runtime::Class>()->GetName()) {
     }
 
     ObjectHolder ClassDefinition::Execute(Closure& closure, Context& /* context */) {
-        auto obj = cls_.TryAs<runtime::Class>();
-
-        closure[obj->GetName()] = std::move(cls_);
+        closure[name_] = cls_;
 
         return {};
     }
@@ -216,19 +374,37 @@ namespace ast {
     }
 
     ObjectHolder Stringify::Execute(Closure& closure, Context& context) {
+        return runtime::Stringify(argument_->Execute(closure, context));
+    }
 
-        auto obj = argument_->Execute(closure, context);
-
-        if (!obj) {
-            return ObjectHolder::Own(runtime::String{ "None"s });
-        }
+    namespace {
+        // Numbers-or-generic specialization of Sub, Mult and Div. int_operation returns
+        // true when it has no int64 result, which then comes from the generic operation.
+        template <typename IntOperation, typename GenericOperation>
+        ObjectHolder ExecuteSpecialized(Specialization& specialization, const ObjectHolder& lhs,
+                                        const ObjectHolder& rhs, Context& context, IntOperation int_operation,
+                                        GenericOperation generic_operation) {
+            auto* l_number = lhs.TryAs<runtime::Number>();
+            auto* r_number = rhs.TryAs<runtime::Number>();
+            const bool numbers = l_number != nullptr && r_number != nullptr;
+
+            if (specialization == Specialization::Unspecialized) {
+                specialization = numbers ? Specialization::Numbers : Specialization::Generic;
+            } else if (specialization == Specialization::Numbers && !numbers) {
+                specialization = Specialization::Generic;
+            }
 
-        runtime::DummyContext dummy_context;
+            if (specialization == Specialization::Numbers) {
+                int64_t result;
 
-        obj->Print(dummy_context.GetOutputStream(), dummy_context);
+                if (!int_operation(l_number->GetValue(), r_number->GetValue(), result)) {
+                    return runtime::MakeNumber(result);
+                }
+            }
 
-        return ObjectHolder::Own(runtime::String{ dummy_context.output.str() });
-    }
+            return generic_operation(lhs, rhs, context);
+        }
+    } // namespace
 
     ObjectHolder Add::Execute(Closure& closure, Context& context) {
         if (!rhs_ || !lhs_) {
@@ -238,37 +414,57 @@ namespace ast {
         auto obj_lhs = lhs_->Execute(closure, context);
         auto obj_rhs = rhs_->Execute(closure, context);
 
-        auto ptr_lhs_n = obj_lhs.TryAs<runtime::Number>();
-        auto ptr_rhs_n = obj_rhs.TryAs<runtime::Number>();
-
-        if (ptr_lhs_n != nullptr && ptr_rhs_n != nullptr) {
-            auto l_num = ptr_lhs_n->GetValue();
-            auto r_num = ptr_rhs_n->GetValue();
-
-            return ObjectHolder::Own(runtime::Number{ l_num + r_num });
-        }
-
-        auto ptr_lhs_s = obj_lhs.TryAs<runtime::String>();
-        auto ptr_rhs_s = obj_rhs.TryAs<runtime::String>();
+        switch (specialization_) {
+            case Specialization::Numbers: {
+                auto* l_number = obj_lhs.TryAs<runtime::Number>();
+                auto* r_number = obj_rhs.TryAs<runtime::Number>();
 
-        if (ptr_lhs_s != nullptr && ptr_rhs_s != nullptr) {
-            auto l_str = ptr_lhs_s->GetValue();
-            auto r_str = ptr_rhs_s->GetValue();
+                if (l_number != nullptr && r_number != nullptr) {
+                    int64_t sum;
 
-            return ObjectHolder::Own(runtime::String{ l_str + r_str });
-        }
-
-        auto ptr_lhs_class_inst = obj_lhs.TryAs<runtime::ClassInstance>();
-
-        if (ptr_lhs_class_inst != nullptr) {
-            constexpr int ADD_METHOD_ARGS_COUNT = 1;
-
-            if (ptr_lhs_class_inst->HasMethod(ADD_METHOD, ADD_METHOD_ARGS_COUNT)) {
-                return ptr_lhs_class_inst->Call(ADD_METHOD, { obj_rhs }, context);
+                    if (!__builtin_add_overflow(l_number->GetValue(), r_number->GetValue(), &sum)) {
+                        return runtime::MakeNumber(sum);
+                    }
+                    return runtime::Add(obj_lhs, obj_rhs, context);
+                }
+                break;
+            }
+            case Specialization::Strings:
+                if (obj_lhs.TryAs<runtime::String>() != nullptr && obj_rhs.TryAs<runtime::String>() != nullptr) {
+                    return runtime::String::Concat(obj_lhs, obj_rhs);
+                }
+                break;
+            case Specialization::Instances: {
+                auto* instance = obj_lhs.TryAs<runtime::ClassInstance>();
+
+                if (instance != nullptr && &instance->GetClass() == add_class_) {
+                    return instance->Call(*add_method_, { obj_rhs }, context);
+                }
+                break;
             }
+            case Specialization::Generic:
+                return runtime::Add(obj_lhs, obj_rhs, context);
+            case Specialization::Unspecialized:
+                if (obj_lhs.TryAs<runtime::Number>() != nullptr && obj_rhs.TryAs<runtime::Number>() != nullptr) {
+                    specialization_ = Specialization::Numbers;
+                } else if (obj_lhs.TryAs<runtime::String>() != nullptr
+                           && obj_rhs.TryAs<runtime::String>() != nullptr) {
+                    specialization_ = Specialization::Strings;
+                } else if (auto* instance = obj_lhs.TryAs<runtime::ClassInstance>();
+                           instance != nullptr
+                           && instance->GetClass().GetSpecialMethod(runtime::SpecialMethod::Add) != nullptr) {
+                    specialization_ = Specialization::Instances;
+                    add_class_ = &instance->GetClass();
+                    add_method_ = add_class_->GetSpecialMethod(runtime::SpecialMethod::Add);
+                } else {
+                    specialization_ = Specialization::Generic;
+                }
+                return runtime::Add(obj_lhs, obj_rhs, context);
         }
 
-        throw std::runtime_error("incorrect add operands"s);
+        // The guard failed: the operands are not of the type seen first
+        specialization_ = Specialization::Generic;
+        return runtime::Add(obj_lhs, obj_rhs, context);
     }
 
     ObjectHolder Sub::Execute(Closure& closure, Context& context) {
@@ -279,17 +475,12 @@ namespace ast {
         auto obj_lhs = lhs_->Execute(closure, context);
         auto obj_rhs = rhs_->Execute(closure, context);
 
-        auto ptr_lhs_n = obj_lhs.TryAs<runtime::Number>();
-        auto ptr_rhs_n = obj_rhs.TryAs<runtime::Number>();
-
-        if (ptr_lhs_n != nullptr && ptr_rhs_n != nullptr) {
-            auto l_num = ptr_lhs_n->GetValue();
-            auto r_num = ptr_rhs_n->GetValue();
-
-            return ObjectHolder::Own(runtime::Number{ l_num - r_num });
-        }
-
-        throw std::runtime_error("incorrect sub operands"s);
+        return ExecuteSpecialized(
+            specialization_, obj_lhs, obj_rhs, context,
+            [](int64_t l_value, int64_t r_value, int64_t& result) {
+                return __builtin_sub_overflow(l_value, r_value, &result);
+            },
+            runtime::Sub);
     }
 
     ObjectHolder Mult::Execute(Closure& closure, Context& context) {
@@ -300,17 +491,12 @@ namespace ast {
         auto obj_lhs = lhs_->Execute(closure, context);
         auto obj_rhs = rhs_->Execute(closure, context);
 
-        auto ptr_lhs_n = obj_lhs.TryAs<runtime::Number>();
-        auto ptr_rhs_n = obj_rhs.TryAs<runtime::Number>();
-
-        if (ptr_lhs_n != nullptr && ptr_rhs_n != nullptr) {
-            auto l_num = ptr_lhs_n->GetValue();
-            auto r_num = ptr_rhs_n->GetValue();
-
-            return ObjectHolder::Own(runtime::Number{ l_num * r_num });
-        }
-
-        throw std::runtime_error("incorrect mult operands"s);
+        return ExecuteSpecialized(
+            specialization_, obj_lhs, obj_rhs, context,
+            [](int64_t l_value, int64_t r_value, int64_t& result) {
+                return __builtin_mul_overflow(l_value, r_value, &result);
+            },
+            runtime::Mult);
     }
 
     ObjectHolder Div::Execute(Closure& closure, Context& context) {
@@ -321,53 +507,42 @@ namespace ast {
         auto obj_lhs = lhs_->Execute(closure, context);
         auto obj_rhs = rhs_->Execute(closure, context);
 
-        auto ptr_lhs_n = obj_lhs.TryAs<runtime::Number>();
-        auto ptr_rhs_n = obj_rhs.TryAs<runtime::Number>();
-
-        if (ptr_lhs_n != nullptr && ptr_rhs_n != nullptr) {
-            auto l_num = ptr_lhs_n->GetValue();
-            auto r_num = ptr_rhs_n->GetValue();
-
-            if (r_num == 0) {
-                throw std::runtime_error("division by zero"s);
-            }
-
-            return ObjectHolder::Own(runtime::Number{ l_num / r_num });
-        }
-
-        throw std::runtime_error("incorrect div operands"s);
+        return ExecuteSpecialized(
+            specialization_, obj_lhs, obj_rhs, context,
+            [](int64_t l_value, int64_t r_value, int64_t& result) {
+                // Division by zero and INT64_MIN / -1 are left to runtime::Div
+                if (r_value == 0 || (l_value == INT64_MIN && r_value == -1)) {
+                    return true;
+                }
+                result = l_value / r_value;
+                return false;
+            },
+            runtime::Div);
     }
 
     ObjectHolder Or::Execute(Closure& closure, Context& context) {
         if (!rhs_ || !lhs_) {
             throw std::runtime_error("null operands are not supported"s);
         }
-        auto l_obj = lhs_->Execute(closure, context);
-        auto r_obj = rhs_->Execute(closure, context);
 
-        if (runtime::IsTrue(l_obj)) {
-            return ObjectHolder::Own(runtime::Bool{ true });
+        // The rhs is evaluated only when the lhs doesn't decide the result
+        if (runtime::IsTrue(lhs_->Execute(closure, context))) {
+            return runtime::MakeBool(true);
         }
 
-        if (runtime::IsTrue(r_obj)) {
-            return ObjectHolder::Own(runtime::Bool{ true });
-        }
-
-        return ObjectHolder::Own(runtime::Bool{ false });
+        return runtime::MakeBool(runtime::IsTrue(rhs_->Execute(closure, context)));
     }
 
     ObjectHolder And::Execute(Closure& closure, Context& context) {
         if (!rhs_ || !lhs_) {
             throw std::runtime_error("null operands are not supported"s);
         }
-        auto l_obj = lhs_->Execute(closure, context);
-        auto r_obj = rhs_->Execute(closure, context);
 
-        if (runtime::IsTrue(l_obj) && runtime::IsTrue(r_obj)) {
-            return ObjectHolder::Own(runtime::Bool{ true });
+        if (!runtime::IsTrue(lhs_->Execute(closure, context))) {
+            return runtime::MakeBool(false);
         }
 
-        return ObjectHolder::Own(runtime::Bool{ false });
+        return runtime::MakeBool(runtime::IsTrue(rhs_->Execute(closure, context)));
     }
 
     ObjectHolder Not::Execute(Closure& closure, Context& context) {
@@ -378,15 +553,11 @@ namespace ast {
 
         auto res = runtime::IsTrue(obj);
 
-        return ObjectHolder::Own(runtime::Bool{ !res });
-    }
-
-    Comparison::Comparison(Comparator cmp, unique_ptr<Statement> lhs, unique_ptr<Statement> rhs)
-        : BinaryOperation(std::move(lhs), std::move(rhs))
-        , cmp_(std::move(cmp)) {
+        return runtime::MakeBool(!res);
     }
 
-    ObjectHolder Comparison::Execute(Closure& closure, Context& context) {
+    template <runtime::CompareOp op>
+    ObjectHolder Comparison<op>::Execute(Closure& closure, Context& context) {
         if (!rhs_ || !lhs_) {
             throw std::runtime_error("null operands are not supported"s);
         }
@@ -394,9 +565,20 @@ namespace ast {
         auto l_obj = lhs_->Execute(closure, context);
         auto r_obj = rhs_->Execute(closure, context);
 
-        bool res = cmp_(l_obj, r_obj, context);
+        auto* l_number = l_obj.TryAs<runtime::Number>();
+        auto* r_number = r_obj.TryAs<runtime::Number>();
+        const bool numbers = l_number != nullptr && r_number != nullptr;
 
-        return ObjectHolder::Own(runtime::Bool{ res });
+        if (specialization_ == Specialization::Numbers) {
+            if (numbers) {
+                return runtime::MakeBool(runtime::ApplyCompareOp(op, l_number->GetValue(), r_number->GetValue()));
+            }
+            specialization_ = Specialization::Generic;
+        } else if (specialization_ == Specialization::Unspecialized) {
+            specialization_ = numbers ? Specialization::Numbers : Specialization::Generic;
+        }
+
+        return runtime::MakeBool(runtime::Compare(op, l_obj, r_obj, context));
     }
 
     IfElse::IfElse(std::unique_ptr<Statement> condition, std::unique_ptr<Statement> if_body,
@@ -418,4 +600,111 @@ namespace ast {
         }
     }
 
+    void None::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void VariableValue::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void Assignment::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void FieldAssignment::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void NewInstance::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void MethodCall::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void Compound::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void Return::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void MethodBody::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void ClassDefinition::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void Print::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void Stringify::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void Add::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void Sub::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void Mult::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void Div::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void Or::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void And::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    void Not::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    template <runtime::CompareOp op>
+    void Comparison<op>::Accept(Visitor& visitor) {
+        visitor.VisitComparison(*this, op);
+    }
+
+    void IfElse::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
+    template class Comparison<runtime::CompareOp::Equal>;
+    template class Comparison<runtime::CompareOp::NotEqual>;
+    template class Comparison<runtime::CompareOp::Less>;
+    template class Comparison<runtime::CompareOp::Greater>;
+    template class Comparison<runtime::CompareOp::LessOrEqual>;
+    template class Comparison<runtime::CompareOp::GreaterOrEqual>;
+
+    namespace {
+        template <runtime::CompareOp... ops>
+        std::optional<runtime::CompareOp> FindCompareOp(Statement& statement) {
+            std::optional<runtime::CompareOp> result;
+            ((dynamic_cast<Comparison<ops>*>(&statement) != nullptr && (result = ops, true)) || ...);
+            return result;
+        }
+    } // namespace
+
+    std::optional<runtime::CompareOp> GetCompareOp(Statement& statement) {
+        return FindCompareOp<runtime::CompareOp::Equal, runtime::CompareOp::NotEqual, runtime::CompareOp::Less,
+                             runtime::CompareOp::Greater, runtime::CompareOp::LessOrEqual,
+                             runtime::CompareOp::GreaterOrEqual>(statement);
+    }
+
 } // namespace ast
\ No newline at end of file
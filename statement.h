@@ -1,11 +1,21 @@
 #pragma once
 
+#include "call_stack.h"
 #include "runtime.h"
 
-#include <functional>
+#include <array>
+#include <cstdint>
+#include <optional>
 
 namespace ast {
-    using Statement = runtime::Executable;
+    class Visitor;
+
+    // Node of the syntax tree. Nodes are executed directly by walking the tree and
+    // accept visitors for passes over it, such as the bytecode compiler.
+    class Statement : public runtime::Executable {
+    public:
+        virtual void Accept(Visitor& visitor) = 0;
+    };
 
     template <typename T>
     class ValueStatement : public Statement {
@@ -19,11 +29,19 @@ namespace ast {
             return runtime::ObjectHolder::Share(value_);
         }
 
+        void Accept(Visitor& visitor) override;
+
+        T& GetValue() {
+            return value_;
+        }
+
     private:
         T value_;
     };
 
     using NumericConst = ValueStatement<runtime::Number>;
+    // Integer literal above INT64_MAX
+    using BigNumericConst = ValueStatement<runtime::BigNumber>;
     using StringConst = ValueStatement<runtime::String>;
     using BoolConst = ValueStatement<runtime::Bool>;
 
@@ -33,28 +51,80 @@ namespace ast {
                                       runtime::Context& /* context */) override {
             return {};
         }
+
+        void Accept(Visitor& visitor) override;
+    };
+
+    // Inline cache of a field access: the slot of the field in the last seen shape.
+    // next_shape is set when the access added the field to that shape.
+    struct FieldCache {
+        const runtime::Shape* shape = nullptr;
+        runtime::Shape* next_shape = nullptr;
+        size_t slot = 0;
     };
 
     class VariableValue : public Statement {
     public:
+        // Shape of the name, which selects a specialized Execute path
+        enum class Access : uint8_t {
+            Local,       // a frame slot
+            Global,      // a closure variable
+            LocalField,  // a field of a frame slot, like self.x
+            Path,        // anything longer
+        };
+
         explicit VariableValue(std::string var_name);
-        explicit VariableValue(std::vector<std::string> dotted_ids);
+        // local_slot is the frame slot of the first id inside a resolved method body
+        explicit VariableValue(std::vector<std::string> dotted_ids, size_t local_slot = runtime::NO_LOCAL_SLOT);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
+
+        const std::vector<runtime::Symbol>& GetDottedIds() const {
+            return dotted_ids_;
+        }
+
+        size_t GetLocalSlot() const {
+            return local_slot_;
+        }
+
+        Access GetAccess() const {
+            return access_;
+        }
 
     private:
-        std::vector<std::string> dotted_ids_;
+        runtime::ObjectHolder& GetLocal() const;
+        runtime::ObjectHolder& GetGlobal(runtime::Closure& closure) const;
+
+        std::vector<runtime::Symbol> dotted_ids_;
+        size_t local_slot_ = runtime::NO_LOCAL_SLOT;
+        Access access_;
+        std::vector<FieldCache> field_caches_;
     };
 
     class Assignment : public Statement {
     public:
-        Assignment(std::string var, std::unique_ptr<Statement> rv);
+        Assignment(std::string var, std::unique_ptr<Statement> rv, size_t local_slot = runtime::NO_LOCAL_SLOT);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
+
+        runtime::Symbol GetName() const {
+            return var_;
+        }
+
+        Statement& GetValue() {
+            return *rv_;
+        }
+
+        size_t GetLocalSlot() const {
+            return local_slot_;
+        }
 
     public:
-        std::string var_;
+        runtime::Symbol var_;
         std::unique_ptr<Statement> rv_;
+        size_t local_slot_;
     };
 
     class FieldAssignment : public Statement {
@@ -62,11 +132,29 @@ namespace ast {
         FieldAssignment(VariableValue object, std::string field_name, std::unique_ptr<Statement> rv);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
+
+        VariableValue& GetObject() {
+            return object_;
+        }
+
+        runtime::Symbol GetFieldName() const {
+            return field_name_;
+        }
+
+        Statement& GetValue() {
+            return *rv_;
+        }
+
+        // Stores the value in the field through the cache of the node, adding the
+        // field if the instance has none
+        runtime::ObjectHolder& Store(runtime::ClassInstance& instance, runtime::ObjectHolder value);
 
     private:
         VariableValue object_;
-        std::string field_name_;
+        runtime::Symbol field_name_;
         std::unique_ptr<Statement> rv_;
+        FieldCache field_cache_;
     };
 
     class NewInstance : public Statement {
@@ -75,9 +163,18 @@ namespace ast {
         NewInstance(const runtime::Class& class_, std::vector<std::unique_ptr<Statement>> args);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
+
+        const runtime::Class& GetClass() const {
+            return class_;
+        }
+
+        const std::vector<std::unique_ptr<Statement>>& GetArgs() const {
+            return args_;
+        }
 
     private:
-        runtime::ClassInstance class_inst_;
+        const runtime::Class& class_;
         std::vector<std::unique_ptr<Statement>> args_;
     };
 
@@ -87,11 +184,43 @@ namespace ast {
                    std::vector<std::unique_ptr<Statement>> args);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
+
+        Statement& GetObject() {
+            return *object_;
+        }
+
+        runtime::Symbol GetMethodName() const {
+            return method_name_;
+        }
+
+        const std::vector<std::unique_ptr<Statement>>& GetArgs() const {
+            return args_;
+        }
+
+        // Method called on an instance of the class, nullptr if it has none taking the
+        // arguments of the node
+        const runtime::Method* FindMethod(const runtime::Class& cls);
 
     private:
+        // Polymorphic inline cache: methods resolved at this call site for the last few
+        // classes. A site that sees more classes than fit goes megamorphic and always
+        // looks the method up.
+        struct CacheEntry {
+            const runtime::Class* cls;
+            const runtime::Method* method;
+        };
+
+        static constexpr size_t POLYMORPHIC_CACHE_SIZE = 4;
+
         std::unique_ptr<Statement> object_;
-        std::string method_name_;
+        runtime::Symbol method_name_;
+        size_t method_slot_;
         std::vector<std::unique_ptr<Statement>> args_;
+
+        std::array<CacheEntry, POLYMORPHIC_CACHE_SIZE> cache_{};
+        size_t cache_size_ = 0;
+        bool megamorphic_ = false;
     };
 
     class Compound : public Statement {
@@ -105,6 +234,11 @@ namespace ast {
 
         void AddStatement(std::unique_ptr<Statement> stmt);
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
+
+        const std::vector<std::unique_ptr<Statement>>& GetStatements() const {
+            return statements_;
+        }
 
     private:
         template <typename T0, typename... Ts>
@@ -121,21 +255,18 @@ namespace ast {
         std::vector<std::unique_ptr<Statement>> statements_;
     };
 
-    class RuntimeReturnExeption : public std::exception {
-    public:
-        explicit RuntimeReturnExeption(const runtime::ObjectHolder& obj);
-
-        runtime::ObjectHolder GetValue();
-
-    private:
-        runtime::ObjectHolder obj_;
-    };
-
+    // Returns the value of the expression and marks the method as returning: every
+    // enclosing Compound stops right away and passes the value up to MethodBody
     class Return : public Statement {
     public:
         explicit Return(std::unique_ptr<Statement> statement);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
+
+        Statement& GetValue() {
+            return *statement_;
+        }
 
     private:
         std::unique_ptr<Statement> statement_;
@@ -146,6 +277,11 @@ namespace ast {
         explicit MethodBody(std::unique_ptr<Statement>&& body);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
+
+        Statement& GetBody() {
+            return *body_;
+        }
 
     private:
         std::unique_ptr<Statement> body_;
@@ -156,9 +292,19 @@ namespace ast {
         explicit ClassDefinition(runtime::ObjectHolder cls);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
+
+        const runtime::ObjectHolder& GetClass() const {
+            return cls_;
+        }
+
+        runtime::Symbol GetName() const {
+            return name_;
+        }
 
     private:
         runtime::ObjectHolder cls_;
+        runtime::Symbol name_;
     };
 
     class Print : public Statement {
@@ -168,6 +314,11 @@ namespace ast {
 
         static std::unique_ptr<Print> Variable(const std::string& name);
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
+
+        const std::vector<std::unique_ptr<Statement>>& GetArgs() const {
+            return args_;
+        }
 
     private:
         std::vector<std::unique_ptr<Statement>> args_;
@@ -179,6 +330,11 @@ namespace ast {
             : argument_(std::move(argument)) {
         }
 
+        // nullptr if the node was built without an argument
+        Statement* GetArgument() {
+            return argument_.get();
+        }
+
     protected:
         std::unique_ptr<Statement> argument_;
     };
@@ -190,44 +346,87 @@ namespace ast {
             , rhs_(std::move(rhs)) {
         }
 
+        // nullptr if the node was built without the operand
+        Statement* GetLhs() {
+            return lhs_.get();
+        }
+
+        Statement* GetRhs() {
+            return rhs_.get();
+        }
+
     protected:
         std::unique_ptr<Statement> lhs_;
         std::unique_ptr<Statement> rhs_;
     };
 
+    // Operand types an arithmetic or comparison node specialized itself for. The node
+    // starts unspecialized, picks a variant from the operands of its first evaluation
+    // and then only checks a cheap guard; when the guard fails it falls back to the
+    // generic runtime operation for good.
+    enum class Specialization : uint8_t {
+        Unspecialized,
+        Numbers,    // int64 operands
+        Strings,    // str + str
+        Instances,  // the __add__ of one class
+        Generic,
+    };
+
+    class SpecializingOperation : public BinaryOperation {
+    public:
+        using BinaryOperation::BinaryOperation;
+
+        Specialization GetSpecialization() const {
+            return specialization_;
+        }
+
+    protected:
+        Specialization specialization_ = Specialization::Unspecialized;
+    };
+
     class Stringify : public UnaryOperation {
     public:
         using UnaryOperation::UnaryOperation;
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
     };
 
-    class Add : public BinaryOperation {
+    class Add : public SpecializingOperation {
     public:
-        using BinaryOperation::BinaryOperation;
+        using SpecializingOperation::SpecializingOperation;
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
+
+    private:
+        // Class and __add__ of the Instances specialization
+        const runtime::Class* add_class_ = nullptr;
+        const runtime::Method* add_method_ = nullptr;
     };
 
-    class Sub : public BinaryOperation {
+    class Sub : public SpecializingOperation {
     public:
-        using BinaryOperation::BinaryOperation;
+        using SpecializingOperation::SpecializingOperation;
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
     };
 
-    class Mult : public BinaryOperation {
+    class Mult : public SpecializingOperation {
     public:
-        using BinaryOperation::BinaryOperation;
+        using SpecializingOperation::SpecializingOperation;
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
     };
 
-    class Div : public BinaryOperation {
+    class Div : public SpecializingOperation {
     public:
-        using BinaryOperation::BinaryOperation;
+        using SpecializingOperation::SpecializingOperation;
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
     };
 
     class Or : public BinaryOperation {
@@ -235,6 +434,7 @@ namespace ast {
         using BinaryOperation::BinaryOperation;
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
     };
 
     class And : public BinaryOperation {
@@ -242,6 +442,7 @@ namespace ast {
         using BinaryOperation::BinaryOperation;
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
     };
 
     class Not : public UnaryOperation {
@@ -249,27 +450,50 @@ namespace ast {
         using UnaryOperation::UnaryOperation;
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
     };
 
-    class Comparison : public BinaryOperation {
+    // One node type per operator, so numbers and strings are compared without an
+    // indirect call
+    template <runtime::CompareOp op>
+    class Comparison : public SpecializingOperation {
     public:
-        using Comparator = std::function<bool(const runtime::ObjectHolder&,
-                                              const runtime::ObjectHolder&, runtime::Context&)>;
-
-        Comparison(Comparator cmp, std::unique_ptr<Statement> lhs, std::unique_ptr<Statement> rhs);
+        using SpecializingOperation::SpecializingOperation;
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
-
-    private:
-        Comparator cmp_;
+        void Accept(Visitor& visitor) override;
     };
 
+    using Equal = Comparison<runtime::CompareOp::Equal>;
+    using NotEqual = Comparison<runtime::CompareOp::NotEqual>;
+    using Less = Comparison<runtime::CompareOp::Less>;
+    using Greater = Comparison<runtime::CompareOp::Greater>;
+    using LessOrEqual = Comparison<runtime::CompareOp::LessOrEqual>;
+    using GreaterOrEqual = Comparison<runtime::CompareOp::GreaterOrEqual>;
+
+    // Operator of a comparison node, nullopt for any other statement
+    std::optional<runtime::CompareOp> GetCompareOp(Statement& statement);
+
     class IfElse : public Statement {
     public:
         IfElse(std::unique_ptr<Statement> condition, std::unique_ptr<Statement> if_body,
                std::unique_ptr<Statement> else_body);
 
         runtime::ObjectHolder Execute(runtime::Closure& closure, runtime::Context& context) override;
+        void Accept(Visitor& visitor) override;
+
+        Statement& GetCondition() {
+            return *condition_;
+        }
+
+        Statement& GetIfBody() {
+            return *if_body_;
+        }
+
+        // nullptr if there is no else branch
+        Statement* GetElseBody() {
+            return else_body_.get();
+        }
 
     private:
         std::unique_ptr<Statement> condition_;
@@ -277,4 +501,41 @@ namespace ast {
         std::unique_ptr<Statement> else_body_;
     };
 
+    class Visitor {
+    public:
+        virtual ~Visitor() = default;
+
+        virtual void Visit(NumericConst& node) = 0;
+        virtual void Visit(BigNumericConst& node) = 0;
+        virtual void Visit(StringConst& node) = 0;
+        virtual void Visit(BoolConst& node) = 0;
+        virtual void Visit(None& node) = 0;
+        virtual void Visit(VariableValue& node) = 0;
+        virtual void Visit(Assignment& node) = 0;
+        virtual void Visit(FieldAssignment& node) = 0;
+        virtual void Visit(NewInstance& node) = 0;
+        virtual void Visit(MethodCall& node) = 0;
+        virtual void Visit(Compound& node) = 0;
+        virtual void Visit(Return& node) = 0;
+        virtual void Visit(MethodBody& node) = 0;
+        virtual void Visit(ClassDefinition& node) = 0;
+        virtual void Visit(Print& node) = 0;
+        virtual void Visit(Stringify& node) = 0;
+        virtual void Visit(Add& node) = 0;
+        virtual void Visit(Sub& node) = 0;
+        virtual void Visit(Mult& node) = 0;
+        virtual void Visit(Div& node) = 0;
+        virtual void Visit(Or& node) = 0;
+        virtual void Visit(And& node) = 0;
+        virtual void Visit(Not& node) = 0;
+        // All six comparison node types
+        virtual void VisitComparison(BinaryOperation& node, runtime::CompareOp op) = 0;
+        virtual void Visit(IfElse& node) = 0;
+    };
+
+    template <typename T>
+    void ValueStatement<T>::Accept(Visitor& visitor) {
+        visitor.Visit(*this);
+    }
+
 } // namespace ast
@@ -1,7 +1,12 @@
+#include "bytecode.h"
+#include "jit.h"
 #include "lexer.h"
 #include "parse.h"
 #include "statement.h"
 #include "test_runner_p.h"
+#include "vm.h"
+
+#include <iterator>
 
 using namespace std;
 
@@ -357,6 +362,41 @@ namespace ast {
             ASSERT(context.output.str().empty());
         }
 
+        void TestMethodCallSiteCache() {
+            runtime::DummyContext context;
+
+            vector<unique_ptr<runtime::Class>> classes;
+            vector<ObjectHolder> instances;
+
+            for (int i = 0; i < 6; ++i) {
+                vector<runtime::Method> methods;
+                methods.push_back({ "id"s, {}, make_unique<NumericConst>(i) });
+                methods.push_back({ "twice"s, { "x"s }, make_unique<Add>(make_unique<VariableValue>("x"s),
+                                                                        make_unique<VariableValue>("x"s)) });
+                classes.push_back(make_unique<runtime::Class>("C"s + to_string(i), std::move(methods), nullptr));
+                instances.push_back(ObjectHolder::Own(runtime::ClassInstance{ *classes.back() }));
+            }
+
+            MethodCall call_id(make_unique<VariableValue>("x"s), "id"s, {});
+
+            // Goes through the monomorphic, polymorphic and megamorphic states twice
+            for (int round = 0; round < 2; ++round) {
+                for (int i = 0; i < 6; ++i) {
+                    Closure closure{ { "x"s, instances[i] } };
+                    ASSERT_OBJECT_VALUE_EQUAL(call_id.Execute(closure, context), i);
+                }
+            }
+
+            vector<unique_ptr<Statement>> args;
+            args.push_back(make_unique<NumericConst>(1));
+            args.push_back(make_unique<NumericConst>(2));
+            MethodCall call_wrong_arity(make_unique<VariableValue>("x"s), "twice"s, std::move(args));
+
+            Closure closure{ { "x"s, instances[0] } };
+            ASSERT_THROWS(call_wrong_arity.Execute(closure, context), std::runtime_error);
+            ASSERT_THROWS(call_wrong_arity.Execute(closure, context), std::runtime_error);
+        }
+
         void TestBaseClass() {
             vector<runtime::Method> methods;
             methods.push_back({ "GetValue"s, {}, make_unique<VariableValue>(vector{ "self"s, "value"s }) });
@@ -420,6 +460,55 @@ namespace ast {
             ASSERT(!cls.GetMethod("AsStringValue"s));
         }
 
+        void TestGrandparentMethods() {
+            vector<runtime::Method> methods;
+            methods.push_back({ "name"s, {}, make_unique<StringConst>("base"s) });
+            methods.push_back({ "kind"s, {}, make_unique<StringConst>("base kind"s) });
+            runtime::Class base("Base"s, std::move(methods), nullptr);
+
+            methods.clear();
+            methods.push_back({ "name"s, {}, make_unique<StringConst>("middle"s) });
+            runtime::Class middle("Middle"s, std::move(methods), &base);
+
+            methods.clear();
+            methods.push_back({ "extra"s, {}, make_unique<StringConst>("leaf extra"s) });
+            runtime::Class leaf("Leaf"s, std::move(methods), &middle);
+
+            runtime::DummyContext context;
+            runtime::ClassInstance inst(leaf);
+
+            ASSERT(inst.HasMethod("kind"s, 0U));
+            ASSERT_OBJECT_VALUE_EQUAL(inst.Call("kind"s, {}, context), "base kind"s);
+            ASSERT_OBJECT_VALUE_EQUAL(inst.Call("name"s, {}, context), "middle"s);
+            ASSERT_OBJECT_VALUE_EQUAL(inst.Call("extra"s, {}, context), "leaf extra"s);
+            ASSERT(!middle.GetMethod("extra"s));
+            ASSERT(!leaf.GetMethod("no_such_method"s));
+        }
+
+        void TestSpecialMethodSlots() {
+            vector<runtime::Method> methods;
+            methods.push_back({ "__str__"s, {}, make_unique<StringConst>("base"s) });
+            methods.push_back({ "__eq__"s, {}, make_unique<StringConst>("wrong arity"s) });
+            runtime::Class base("Base"s, std::move(methods), nullptr);
+
+            methods.clear();
+            methods.push_back({ "__init__"s, { "a"s, "b"s }, make_unique<StringConst>("init"s) });
+            runtime::Class leaf("Leaf"s, std::move(methods), &base);
+
+            using runtime::SpecialMethod;
+            ASSERT(leaf.GetSpecialMethod(SpecialMethod::Str) == base.GetSpecialMethod(SpecialMethod::Str));
+            ASSERT(leaf.GetSpecialMethod(SpecialMethod::Str) != nullptr);
+            ASSERT(leaf.GetSpecialMethod(SpecialMethod::Init) != nullptr);
+            ASSERT(base.GetSpecialMethod(SpecialMethod::Init) == nullptr);
+            ASSERT(leaf.GetSpecialMethod(SpecialMethod::Eq) == nullptr);
+            ASSERT(leaf.GetSpecialMethod(SpecialMethod::Add) == nullptr);
+
+            runtime::DummyContext context;
+            runtime::ClassInstance inst(leaf);
+            inst.Print(context.output, context);
+            ASSERT_EQUAL(context.output.str(), "base"s);
+        }
+
         void TestOr() {
             auto test_or = [](bool lhs, bool rhs) {
                 Or or_statement{ make_unique<BoolConst>(lhs), make_unique<BoolConst>(rhs) };
@@ -456,6 +545,156 @@ namespace ast {
             test_ond(false, false);
         }
 
+        void TestShortCircuit() {
+            Closure closure;
+            runtime::DummyContext context;
+
+            // Evaluating the missing variable would throw
+            Or or_statement{ make_unique<BoolConst>(true), make_unique<VariableValue>("missing"s) };
+            ASSERT(runtime::IsTrue(or_statement.Execute(closure, context)));
+
+            And and_statement{ make_unique<BoolConst>(false), make_unique<VariableValue>("missing"s) };
+            ASSERT(!runtime::IsTrue(and_statement.Execute(closure, context)));
+
+            Or or_decided_by_rhs{ make_unique<BoolConst>(false), make_unique<VariableValue>("missing"s) };
+            ASSERT_THROWS(or_decided_by_rhs.Execute(closure, context), std::runtime_error);
+
+            // Results are inline Bools
+            And and_true{ make_unique<BoolConst>(true), make_unique<BoolConst>(true) };
+            ASSERT(and_true.Execute(closure, context).TryAs<runtime::Bool>()->GetValue());
+            ASSERT(or_statement.Execute(closure, context).TryAs<runtime::Bool>()->GetValue());
+        }
+
+        void TestComparisonNodes() {
+            Closure closure;
+            runtime::DummyContext context;
+
+            auto compare = [&](auto node) {
+                return runtime::IsTrue(node.Execute(closure, context));
+            };
+            auto num = [](int64_t value) {
+                return make_unique<NumericConst>(runtime::Number(value));
+            };
+            auto str = [](string value) {
+                return make_unique<StringConst>(runtime::String(std::move(value)));
+            };
+
+            ASSERT(compare(Less{ num(1), num(2) }));
+            ASSERT(!compare(Greater{ num(1), num(2) }));
+            ASSERT(compare(LessOrEqual{ num(2), num(2) }));
+            ASSERT(compare(GreaterOrEqual{ num(2), num(2) }));
+            ASSERT(compare(Equal{ num(-5), num(-5) }));
+            ASSERT(compare(NotEqual{ num(-5), num(5) }));
+
+            ASSERT(compare(Less{ str("abc"s), str("abd"s) }));
+            ASSERT(compare(Greater{ str("b"s), str("abc"s) }));
+            ASSERT(compare(LessOrEqual{ str("abc"s), str("abc"s) }));
+            ASSERT(compare(Equal{ str("abc"s), str("abc"s) }));
+            ASSERT(compare(NotEqual{ str("abc"s), str("ab"s) }));
+
+            ASSERT(compare(Equal{ make_unique<None>(), make_unique<None>() }));
+            ASSERT_THROWS(compare(Less{ num(1), str("1"s) }), std::runtime_error);
+        }
+
+        void TestQuickening() {
+            runtime::DummyContext context;
+            Closure closure;
+
+            auto set = [&closure](ObjectHolder a, ObjectHolder b) {
+                closure["a"s] = std::move(a);
+                closure["b"s] = std::move(b);
+            };
+            auto num = [](int64_t value) {
+                return ObjectHolder::Own(runtime::Number(value));
+            };
+            auto str = [](string value) {
+                return ObjectHolder::Own(runtime::String(std::move(value)));
+            };
+
+            {
+                Add sum(make_unique<VariableValue>("a"s), make_unique<VariableValue>("b"s));
+                ASSERT(sum.GetSpecialization() == Specialization::Unspecialized);
+
+                set(num(1), num(2));
+                ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), 3);
+                ASSERT(sum.GetSpecialization() == Specialization::Numbers);
+
+                // An overflow leaves the specialization in place
+                set(num(INT64_MAX), num(1));
+                ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), "9223372036854775808"s);
+                ASSERT(sum.GetSpecialization() == Specialization::Numbers);
+
+                set(str("ab"s), str("cd"s));
+                ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), "abcd"s);
+                ASSERT(sum.GetSpecialization() == Specialization::Generic);
+
+                set(num(2), num(3));
+                ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), 5);
+            }
+            {
+                Add sum(make_unique<VariableValue>("a"s), make_unique<VariableValue>("b"s));
+
+                set(str("ab"s), str("cd"s));
+                ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), "abcd"s);
+                ASSERT(sum.GetSpecialization() == Specialization::Strings);
+
+                set(num(1), str("cd"s));
+                ASSERT_THROWS(sum.Execute(closure, context), std::runtime_error);
+                ASSERT(sum.GetSpecialization() == Specialization::Generic);
+            }
+            {
+                auto make_class = [](string name, string prefix) {
+                    vector<runtime::Method> methods;
+                    methods.push_back({ "__add__"s,
+                                        { "rhs"s },
+                                        make_unique<Add>(make_unique<StringConst>(std::move(prefix)),
+                                                         make_unique<VariableValue>("rhs"s)) });
+                    return runtime::Class(std::move(name), std::move(methods), nullptr);
+                };
+                runtime::Class first = make_class("First"s, "first "s);
+                runtime::Class second = make_class("Second"s, "second "s);
+
+                Add sum(make_unique<VariableValue>("a"s), make_unique<VariableValue>("b"s));
+
+                set(ObjectHolder::Own(runtime::ClassInstance(first)), str("call"s));
+                ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), "first call"s);
+                ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), "first call"s);
+                ASSERT(sum.GetSpecialization() == Specialization::Instances);
+
+                set(ObjectHolder::Own(runtime::ClassInstance(second)), str("call"s));
+                ASSERT_OBJECT_VALUE_EQUAL(sum.Execute(closure, context), "second call"s);
+                ASSERT(sum.GetSpecialization() == Specialization::Generic);
+            }
+            {
+                Div quotient(make_unique<VariableValue>("a"s), make_unique<VariableValue>("b"s));
+
+                set(num(7), num(2));
+                ASSERT_OBJECT_VALUE_EQUAL(quotient.Execute(closure, context), 3);
+                ASSERT(quotient.GetSpecialization() == Specialization::Numbers);
+
+                set(num(7), num(0));
+                ASSERT_THROWS(quotient.Execute(closure, context), std::runtime_error);
+                ASSERT(quotient.GetSpecialization() == Specialization::Numbers);
+            }
+            {
+                Less less(make_unique<VariableValue>("a"s), make_unique<VariableValue>("b"s));
+
+                set(num(1), num(2));
+                ASSERT(runtime::IsTrue(less.Execute(closure, context)));
+                ASSERT(less.GetSpecialization() == Specialization::Numbers);
+
+                set(str("b"s), str("a"s));
+                ASSERT(!runtime::IsTrue(less.Execute(closure, context)));
+                ASSERT(less.GetSpecialization() == Specialization::Generic);
+            }
+
+            ASSERT(VariableValue("x"s).GetAccess() == VariableValue::Access::Global);
+            ASSERT(VariableValue(vector{ "x"s }, 1).GetAccess() == VariableValue::Access::Local);
+            ASSERT(VariableValue(vector{ "self"s, "x"s }, 0).GetAccess() == VariableValue::Access::LocalField);
+            ASSERT(VariableValue(vector{ "self"s, "x"s, "y"s }, 0).GetAccess() == VariableValue::Access::Path);
+            ASSERT(VariableValue(vector{ "x"s, "y"s }).GetAccess() == VariableValue::Access::Path);
+        }
+
         void TestNot() {
             auto test_not = [](bool arg) {
                 Not not_statement{ make_unique<BoolConst>(arg) };
@@ -470,13 +709,49 @@ namespace ast {
             test_not(false);
         }
 
+        // Runs the program on the tree walker, on the bytecode VM and with every method
+        // compiled by the JIT, which must all print the same output
         void RunMythonProgram(istream& input, ostream& output) {
-            parse::Lexer lexer(input);
-            auto program = ParseProgram(lexer);
+            const string source{ istreambuf_iterator<char>(input), istreambuf_iterator<char>() };
+            ostringstream tree_output;
+            ostringstream vm_output;
+            ostringstream jit_output;
+
+            {
+                istringstream program_input(source);
+                parse::Lexer lexer(program_input);
+                auto program = ParseProgram(lexer);
+
+                runtime::SimpleContext context{ tree_output };
+                runtime::Closure closure;
+                program->Execute(closure, context);
+            }
+            {
+                istringstream program_input(source);
+                parse::Lexer lexer(program_input);
+                auto program = ParseProgram(lexer);
+
+                runtime::SimpleContext context{ vm_output };
+                runtime::Closure closure;
+                bytecode::Module module(*program);
+                vm::Run(module, closure, context);
+            }
 
-            runtime::SimpleContext context{ output };
-            runtime::Closure closure;
-            program->Execute(closure, context);
+            {
+                istringstream program_input(source);
+                parse::Lexer lexer(program_input);
+                auto program = ParseProgram(lexer);
+
+                jit::Compiler compiler(1);
+                runtime::MethodCompiler::Scope scope(compiler);
+                runtime::SimpleContext context{ jit_output };
+                runtime::Closure closure;
+                program->Execute(closure, context);
+            }
+
+            ASSERT_EQUAL(vm_output.str(), tree_output.str());
+            ASSERT_EQUAL(jit_output.str(), tree_output.str());
+            output << tree_output.str();
         }
 
         void TestSimplePrints() {
@@ -524,6 +799,32 @@ print x, y
             ASSERT_EQUAL(output.str(), "15 120 -13 3 15\n");
         }
 
+        void TestIntegerOverflow() {
+            istringstream input(R"(
+class Factorial:
+  def calc(n):
+    if n < 2:
+      return 1
+    return n * self.calc(n - 1)
+
+f = Factorial()
+x = 4294967296
+y = x * x * x
+print y, y / x / x, 9223372036854775807 + 1 - 1, x * x / 2, 0 - x * x
+print f.calc(30), f.calc(30) / f.calc(28), y > x, y == x * x * x
+print 9223372036854775808, -9223372036854775808, 100000000000000000000 / x, 18446744073709551616 == x * x
+)");
+
+            ostringstream output;
+            RunMythonProgram(input, output);
+
+            ASSERT_EQUAL(output.str(),
+                         "79228162514264337593543950336 4294967296 9223372036854775807 9223372036854775808 "
+                         "-18446744073709551616\n"
+                         "265252859812191058636308480000000 870 True True\n"
+                         "9223372036854775808 -9223372036854775808 23283064365 True\n");
+        }
+
         void TestVariablesArePointers() {
             istringstream input(R"(
 class Counter:
@@ -574,14 +875,21 @@ print y.value
         RUN_TEST(tr, ast::TestClassInstanceAddWithoutMethod);
         RUN_TEST(tr, ast::TestCompound);
         RUN_TEST(tr, ast::TestFields);
+        RUN_TEST(tr, ast::TestMethodCallSiteCache);
         RUN_TEST(tr, ast::TestBaseClass);
         RUN_TEST(tr, ast::TestInheritance);
+        RUN_TEST(tr, ast::TestGrandparentMethods);
+        RUN_TEST(tr, ast::TestSpecialMethodSlots);
         RUN_TEST(tr, ast::TestOr);
         RUN_TEST(tr, ast::TestAnd);
+        RUN_TEST(tr, ast::TestShortCircuit);
+        RUN_TEST(tr, ast::TestComparisonNodes);
+        RUN_TEST(tr, ast::TestQuickening);
         RUN_TEST(tr, ast::TestNot);
         RUN_TEST(tr, ast::TestSimplePrints);
         RUN_TEST(tr, ast::TestAssignments);
         RUN_TEST(tr, ast::TestArithmetics);
+        RUN_TEST(tr, ast::TestIntegerOverflow);
         RUN_TEST(tr, ast::TestVariablesArePointers);
     }
 
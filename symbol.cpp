@@ -0,0 +1,68 @@
+#include "symbol.h"
+
+#include <deque>
+#include <ostream>
+#include <unordered_map>
+
+using namespace std;
+
+namespace runtime {
+
+    namespace {
+        class SymbolTable {
+        public:
+            SymbolTable() {
+                // id 0 is the default-constructed (empty) symbol
+                Intern({});
+            }
+
+            uint32_t Intern(string_view name) {
+                auto it = ids_.find(name);
+                if (it != ids_.end()) {
+                    return it->second;
+                }
+
+                const auto id = static_cast<uint32_t>(names_.size());
+                const string& stored = names_.emplace_back(name);
+                ids_.emplace(stored, id);
+
+                return id;
+            }
+
+            const string& GetName(uint32_t id) const {
+                return names_[id];
+            }
+
+        private:
+            // deque keeps the interned strings in place, so the string_view keys stay valid
+            deque<string> names_;
+            unordered_map<string_view, uint32_t> ids_;
+        };
+
+        SymbolTable& GetSymbolTable() {
+            static SymbolTable table;
+            return table;
+        }
+    } // namespace
+
+    Symbol::Symbol(string_view name)
+        : id_(GetSymbolTable().Intern(name)) {
+    }
+
+    Symbol::Symbol(const string& name)
+        : Symbol(string_view(name)) {
+    }
+
+    Symbol::Symbol(const char* name)
+        : Symbol(string_view(name)) {
+    }
+
+    const string& Symbol::GetName() const {
+        return GetSymbolTable().GetName(id_);
+    }
+
+    ostream& operator<<(ostream& os, Symbol symbol) {
+        return os << symbol.GetName();
+    }
+
+} // namespace runtime
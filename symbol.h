@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <string_view>
+
+namespace runtime {
+
+    // Interned identifier. Names are interned once (at parse time) into a process-wide
+    // symbol table, after which comparing and hashing a symbol only touches its 32-bit id.
+    // The string form is kept for printing and error messages.
+    class Symbol {
+    public:
+        Symbol() = default;
+        Symbol(std::string_view name);
+        Symbol(const std::string& name);
+        Symbol(const char* name);
+
+        uint32_t GetId() const {
+            return id_;
+        }
+
+        const std::string& GetName() const;
+
+        bool operator==(Symbol other) const {
+            return id_ == other.id_;
+        }
+
+        bool operator!=(Symbol other) const {
+            return id_ != other.id_;
+        }
+
+    private:
+        uint32_t id_ = 0;
+    };
+
+    std::ostream& operator<<(std::ostream& os, Symbol symbol);
+
+} // namespace runtime
+
+template <>
+struct std::hash<runtime::Symbol> {
+    size_t operator()(runtime::Symbol symbol) const {
+        return symbol.GetId();
+    }
+};
@@ -0,0 +1,486 @@
+#include "vm.h"
+
+#include "call_stack.h"
+
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__GNUC__) && !defined(MYTHON_VM_SWITCH_DISPATCH)
+#define MYTHON_VM_COMPUTED_GOTO 1
+#else
+#define MYTHON_VM_COMPUTED_GOTO 0
+#endif
+
+using namespace std;
+
+namespace vm {
+
+    using bytecode::CallSite;
+    using bytecode::Function;
+    using bytecode::OpCode;
+    using runtime::Closure;
+    using runtime::Context;
+    using runtime::ObjectHolder;
+
+    namespace {
+        class UnboundValue : public runtime::Object {
+        public:
+            void Print(std::ostream& /* os */, Context& /* context */) override {
+            }
+        };
+
+        UnboundValue unbound_value;
+
+        // Registers of all active calls live in one vector: the window of a callee
+        // starts where the window of its caller ends. The vector may be reallocated by
+        // a call, so handlers address registers through `r` reloaded after calls.
+        class Machine {
+        public:
+            Machine(bytecode::Module& module, Context& context)
+                : module_(module)
+                , context_(context)
+                , unbound_(ObjectHolder::Share(unbound_value)) {
+            }
+
+            // Runs the function in the window starting at base, where self and the
+            // arguments are already stored
+            ObjectHolder Execute(Function& function, Closure& closure, size_t base);
+
+            size_t GetExecutedCount() const {
+                return executed_;
+            }
+
+        private:
+            // Drops the window of a function when it returns or throws
+            class WindowGuard {
+            public:
+                WindowGuard(vector<ObjectHolder>& registers, size_t base, size_t& executed)
+                    : registers_(registers)
+                    , base_(base)
+                    , executed_(executed) {
+                }
+
+                WindowGuard(const WindowGuard&) = delete;
+                WindowGuard& operator=(const WindowGuard&) = delete;
+
+                ~WindowGuard() {
+                    registers_.resize(base_);
+                    executed_ += count;
+                }
+
+                size_t count = 0;
+
+            private:
+                vector<ObjectHolder>& registers_;
+                size_t base_;
+                size_t& executed_;
+            };
+
+            static runtime::ClassInstance& GetInstance(const ObjectHolder& object, const char* message) {
+                auto* instance = object.TryAs<runtime::ClassInstance>();
+
+                if (instance == nullptr) {
+                    throw runtime_error(message);
+                }
+
+                return *instance;
+            }
+
+            CallSite::Entry FindMethod(CallSite& site, const runtime::Class& cls);
+            ObjectHolder Call(const runtime::Method& method, Function* code, size_t self, size_t argument_count);
+
+            void LoadField(Function& function, const bytecode::Instruction& instruction, ObjectHolder* r);
+            void StoreField(Function& function, const bytecode::Instruction& instruction, ObjectHolder* r);
+
+            bool Compare(runtime::CompareOp op, const ObjectHolder& lhs, const ObjectHolder& rhs) {
+                auto* l_number = lhs.TryAs<runtime::Number>();
+                auto* r_number = rhs.TryAs<runtime::Number>();
+
+                if (l_number != nullptr && r_number != nullptr) {
+                    return runtime::ApplyCompareOp(op, l_number->GetValue(), r_number->GetValue());
+                }
+
+                return runtime::Compare(op, lhs, rhs, context_);
+            }
+
+            bytecode::Module& module_;
+            Context& context_;
+            vector<ObjectHolder> registers_;
+            ObjectHolder unbound_;
+            size_t executed_ = 0;
+        };
+
+        CallSite::Entry Machine::FindMethod(CallSite& site, const runtime::Class& cls) {
+            for (size_t i = 0; i < site.cache_size; ++i) {
+                if (site.cache[i].cls == &cls) {
+                    return site.cache[i];
+                }
+            }
+
+            const runtime::Method* method = cls.GetMethodBySlot(site.method_slot);
+
+            if (method == nullptr || method->formal_params.size() != site.argument_count) {
+                throw runtime_error("No method found");
+            }
+
+            CallSite::Entry entry{ &cls, method, module_.GetMethodCode(*method) };
+
+            if (!site.megamorphic) {
+                if (site.cache_size < site.cache.size()) {
+                    site.cache[site.cache_size++] = entry;
+                } else {
+                    site.megamorphic = true;
+                }
+            }
+
+            return entry;
+        }
+
+        // self is the absolute index of the register holding the object, the arguments
+        // follow it. Those registers are moved from.
+        ObjectHolder Machine::Call(const runtime::Method& method, Function* code, size_t self,
+                                   size_t argument_count) {
+            if (code != nullptr) {
+                const size_t base = registers_.size();
+
+                for (size_t i = 0; i <= argument_count; ++i) {
+                    // Moved out first: the push may reallocate the vector
+                    ObjectHolder value = std::move(registers_[self + i]);
+                    registers_.push_back(std::move(value));
+                }
+
+                Closure closure;
+                return Execute(*code, closure, base);
+            }
+
+            if (method.frame_size != 0) {
+                runtime::CallStack::Frame frame(method.frame_size);
+
+                for (size_t i = 0; i <= argument_count; ++i) {
+                    frame.Slot(i) = std::move(registers_[self + i]);
+                }
+
+                return runtime::CallInFrame(method, frame, context_);
+            }
+
+            vector<ObjectHolder> actual_args(make_move_iterator(registers_.begin() + self + 1),
+                                             make_move_iterator(registers_.begin() + self + 1 + argument_count));
+            ObjectHolder object = registers_[self];
+
+            return object.TryAs<runtime::ClassInstance>()->Call(method, actual_args, context_);
+        }
+
+        void Machine::LoadField(Function& function, const bytecode::Instruction& instruction, ObjectHolder* r) {
+            auto* instance = r[instruction.b].TryAs<runtime::ClassInstance>();
+
+            // Like VariableValue, a dotted name stops at the first value that is not an
+            // instance
+            if (instance == nullptr) {
+                if (instruction.a != instruction.b) {
+                    r[instruction.a] = r[instruction.b];
+                }
+                return;
+            }
+
+            auto& [name, cache] = function.field_sites[instruction.c];
+            runtime::FieldTable& fields = instance->Fields();
+            const runtime::Shape* shape = &fields.GetShape();
+
+            if (shape != cache.shape) {
+                const size_t slot = shape->FindSlot(name);
+
+                if (slot == runtime::Shape::NO_SLOT) {
+                    throw runtime_error("var is not found");
+                }
+
+                cache = { shape, nullptr, slot };
+            }
+
+            // The field must be copied before the instance holding it may be released
+            ObjectHolder field = fields.GetSlot(cache.slot);
+            r[instruction.a] = std::move(field);
+        }
+
+        void Machine::StoreField(Function& function, const bytecode::Instruction& instruction, ObjectHolder* r) {
+            runtime::FieldTable& fields = r[instruction.a].TryAs<runtime::ClassInstance>()->Fields();
+            runtime::Shape& shape = fields.GetShape();
+            auto& [name, cache] = function.field_sites[instruction.c];
+
+            if (&shape != cache.shape) {
+                const size_t slot = shape.FindSlot(name);
+
+                if (slot == runtime::Shape::NO_SLOT) {
+                    cache = { &shape, shape.AddField(name), shape.GetFieldCount() };
+                } else {
+                    cache = { &shape, nullptr, slot };
+                }
+            }
+
+            ObjectHolder& field = cache.next_shape != nullptr ? fields.AddSlot(*cache.next_shape)
+                                                              : fields.GetSlot(cache.slot);
+            field = r[instruction.b];
+        }
+
+        ObjectHolder Machine::Execute(Function& function, Closure& closure, size_t base) {
+            WindowGuard guard(registers_, base, executed_);
+            // Locals read before the first assignment hold the unbound marker
+            registers_.resize(base + function.register_count, unbound_);
+
+            const bytecode::Instruction* code = function.code.data();
+            const bytecode::Instruction* instruction = code;
+            ObjectHolder* r = registers_.data() + base;
+
+#if MYTHON_VM_COMPUTED_GOTO
+            // Each handler jumps to the next one directly, which gives every handler its
+            // own indirect branch to predict
+            static const void* const LABELS[] = {
+                &&op_LoadConst, &&op_LoadNone,  &&op_Move,       &&op_CheckBound,       &&op_LoadGlobal,
+                &&op_StoreGlobal, &&op_LoadField, &&op_CheckInstance, &&op_StoreField,  &&op_NewInstance,
+                &&op_LookupMethod, &&op_CallMethod, &&op_Add,    &&op_Sub,              &&op_Mult,
+                &&op_Div,       &&op_Compare,   &&op_Not,        &&op_Stringify,        &&op_ToBool,
+                &&op_Jump,      &&op_JumpIfFalse, &&op_JumpIfTrue, &&op_JumpIfNotCompare, &&op_PrintSpace,
+                &&op_PrintValue, &&op_PrintNewline, &&op_Safepoint, &&op_Return,
+            };
+            static_assert(size(LABELS) == static_cast<size_t>(OpCode::Return) + 1, "every opcode needs a label");
+
+#define VM_OP(name) op_##name:
+#define VM_NEXT()                                                      \
+    do {                                                               \
+        ++guard.count;                                                 \
+        goto* LABELS[static_cast<size_t>((instruction = code++)->op)]; \
+    } while (false)
+
+            VM_NEXT();
+            {
+#else
+#define VM_OP(name) case OpCode::name:
+#define VM_NEXT() continue
+
+            for (;;) {
+                ++guard.count;
+                instruction = code++;
+
+                switch (instruction->op) {
+#endif
+                VM_OP(LoadConst) {
+                    r[instruction->a] = function.constants[instruction->b];
+                    VM_NEXT();
+                }
+
+                VM_OP(LoadNone) {
+                    r[instruction->a] = ObjectHolder();
+                    VM_NEXT();
+                }
+
+                VM_OP(Move) {
+                    r[instruction->a] = r[instruction->b];
+                    VM_NEXT();
+                }
+
+                VM_OP(CheckBound) {
+                    if (r[instruction->a].Get() == unbound_.Get()) {
+                        throw runtime_error("var is not found");
+                    }
+                    VM_NEXT();
+                }
+
+                VM_OP(LoadGlobal) {
+                    auto it = closure.find(function.names[instruction->b]);
+
+                    if (it == closure.end()) {
+                        throw runtime_error("var is not found");
+                    }
+
+                    r[instruction->a] = it->second;
+                    VM_NEXT();
+                }
+
+                VM_OP(StoreGlobal) {
+                    closure[function.names[instruction->b]] = r[instruction->a];
+                    VM_NEXT();
+                }
+
+                VM_OP(LoadField) {
+                    LoadField(function, *instruction, r);
+                    VM_NEXT();
+                }
+
+                VM_OP(CheckInstance) {
+                    GetInstance(r[instruction->a], "fields can be assigned only to class instances");
+                    VM_NEXT();
+                }
+
+                VM_OP(StoreField) {
+                    StoreField(function, *instruction, r);
+                    VM_NEXT();
+                }
+
+                VM_OP(NewInstance) {
+                    const runtime::Class& cls = *function.classes[instruction->c];
+                    auto instance = ObjectHolder::Own(runtime::ClassInstance(cls));
+                    auto init_method = cls.GetSpecialMethod(runtime::SpecialMethod::Init);
+
+                    if (init_method != nullptr && init_method->formal_params.size() == instruction->count) {
+                        r[instruction->b] = instance;
+                        Call(*init_method, module_.GetMethodCode(*init_method), base + instruction->b,
+                             instruction->count);
+                        r = registers_.data() + base;
+                    }
+
+                    r[instruction->a] = std::move(instance);
+                    VM_NEXT();
+                }
+
+                VM_OP(LookupMethod) {
+                    auto& instance = GetInstance(r[instruction->b], "methods can be called only on class instances");
+                    FindMethod(function.call_sites[instruction->c], instance.GetClass());
+                    VM_NEXT();
+                }
+
+                VM_OP(CallMethod) {
+                    auto& instance = GetInstance(r[instruction->b], "methods can be called only on class instances");
+                    const CallSite::Entry entry = FindMethod(function.call_sites[instruction->c], instance.GetClass());
+
+                    ObjectHolder result = Call(*entry.method, entry.code, base + instruction->b, instruction->count);
+
+                    r = registers_.data() + base;
+                    r[instruction->a] = std::move(result);
+                    VM_NEXT();
+                }
+
+                VM_OP(Add) {
+                    auto* l_number = r[instruction->b].TryAs<runtime::Number>();
+                    auto* r_number = r[instruction->c].TryAs<runtime::Number>();
+                    int64_t sum;
+
+                    if (l_number != nullptr && r_number != nullptr
+                        && !__builtin_add_overflow(l_number->GetValue(), r_number->GetValue(), &sum)) {
+                        r[instruction->a] = runtime::MakeNumber(sum);
+                    } else {
+                        r[instruction->a] = runtime::Add(r[instruction->b], r[instruction->c], context_);
+                    }
+                    VM_NEXT();
+                }
+
+                VM_OP(Sub) {
+                    auto* l_number = r[instruction->b].TryAs<runtime::Number>();
+                    auto* r_number = r[instruction->c].TryAs<runtime::Number>();
+                    int64_t difference;
+
+                    if (l_number != nullptr && r_number != nullptr
+                        && !__builtin_sub_overflow(l_number->GetValue(), r_number->GetValue(), &difference)) {
+                        r[instruction->a] = runtime::MakeNumber(difference);
+                    } else {
+                        r[instruction->a] = runtime::Sub(r[instruction->b], r[instruction->c], context_);
+                    }
+                    VM_NEXT();
+                }
+
+                VM_OP(Mult) {
+                    r[instruction->a] = runtime::Mult(r[instruction->b], r[instruction->c], context_);
+                    VM_NEXT();
+                }
+
+                VM_OP(Div) {
+                    r[instruction->a] = runtime::Div(r[instruction->b], r[instruction->c], context_);
+                    VM_NEXT();
+                }
+
+                VM_OP(Compare) {
+                    const bool result = Compare(static_cast<runtime::CompareOp>(instruction->count),
+                                                r[instruction->b], r[instruction->c]);
+                    r[instruction->a] = runtime::MakeBool(result);
+                    VM_NEXT();
+                }
+
+                VM_OP(Not) {
+                    r[instruction->a] = runtime::MakeBool(!runtime::IsTrue(r[instruction->b]));
+                    VM_NEXT();
+                }
+
+                VM_OP(Stringify) {
+                    r[instruction->a] = runtime::Stringify(r[instruction->b]);
+                    VM_NEXT();
+                }
+
+                VM_OP(ToBool) {
+                    r[instruction->a] = runtime::MakeBool(runtime::IsTrue(r[instruction->b]));
+                    VM_NEXT();
+                }
+
+                VM_OP(Jump) {
+                    code = function.code.data() + instruction->a;
+                    VM_NEXT();
+                }
+
+                VM_OP(JumpIfFalse) {
+                    if (!runtime::IsTrue(r[instruction->b])) {
+                        code = function.code.data() + instruction->a;
+                    }
+                    VM_NEXT();
+                }
+
+                VM_OP(JumpIfTrue) {
+                    if (runtime::IsTrue(r[instruction->b])) {
+                        code = function.code.data() + instruction->a;
+                    }
+                    VM_NEXT();
+                }
+
+                VM_OP(JumpIfNotCompare) {
+                    if (!Compare(static_cast<runtime::CompareOp>(instruction->count), r[instruction->b],
+                                 r[instruction->c])) {
+                        code = function.code.data() + instruction->a;
+                    }
+                    VM_NEXT();
+                }
+
+                VM_OP(PrintSpace) {
+                    context_.GetOutputStream() << " "s;
+                    VM_NEXT();
+                }
+
+                VM_OP(PrintValue) {
+                    if (const ObjectHolder& value = r[instruction->a]) {
+                        value->Print(context_.GetOutputStream(), context_);
+                    } else {
+                        context_.GetOutputStream() << "None"s;
+                    }
+                    VM_NEXT();
+                }
+
+                VM_OP(PrintNewline) {
+                    context_.GetOutputStream() << "\n"s;
+                    VM_NEXT();
+                }
+
+                VM_OP(Safepoint) {
+                    runtime::CycleCollector::Safepoint();
+                    VM_NEXT();
+                }
+
+                VM_OP(Return) {
+                    return std::move(r[instruction->a]);
+                }
+#if !MYTHON_VM_COMPUTED_GOTO
+                }
+#endif
+            }
+
+#undef VM_OP
+#undef VM_NEXT
+        }
+    } // namespace
+
+    ObjectHolder Run(bytecode::Module& module, Closure& closure, Context& context, Stats* stats) {
+        Machine machine(module, context);
+        ObjectHolder result = machine.Execute(module.GetMain(), closure, 0);
+
+        if (stats != nullptr) {
+            stats->instructions = machine.GetExecutedCount();
+        }
+
+        return result;
+    }
+
+} // namespace vm
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "bytecode.h"
+
+#include <cstddef>
+
+namespace vm {
+
+    struct Stats {
+        // Instructions dispatched during the run
+        size_t instructions = 0;
+    };
+
+    // Runs the main function of the module. Global variables live in the closure, as
+    // with runtime::Executable::Execute. Methods are compiled on their first call;
+    // special methods called by the runtime (__init__ aside), such as __str__ or
+    // __add__, still run on the tree walker.
+    //
+    // Dispatch uses computed gotos when built with GCC or Clang; define
+    // MYTHON_VM_SWITCH_DISPATCH to use the portable switch loop instead.
+    runtime::ObjectHolder Run(bytecode::Module& module, runtime::Closure& closure, runtime::Context& context,
+                              Stats* stats = nullptr);
+
+} // namespace vm
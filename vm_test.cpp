@@ -0,0 +1,264 @@
+#include "bytecode.h"
+#include "parse.h"
+#include "test_runner_p.h"
+#include "vm.h"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace parse {
+    unique_ptr<ast::Statement> ParseProgramFromString(const string& program);
+}  // namespace parse
+
+namespace vm {
+
+    using bytecode::OpCode;
+    using parse::ParseProgramFromString;
+    using runtime::Closure;
+    using runtime::ObjectHolder;
+
+    namespace {
+        vector<OpCode> GetOpCodes(const bytecode::Function& function) {
+            vector<OpCode> result;
+
+            for (const auto& instruction : function.code) {
+                result.push_back(instruction.op);
+            }
+
+            return result;
+        }
+
+        void TestCompiledCode() {
+            {
+                ast::Assignment assignment("x"s, make_unique<ast::Add>(make_unique<ast::NumericConst>(1),
+                                                                       make_unique<ast::NumericConst>(2)));
+                auto function = bytecode::Compile(assignment);
+
+                ASSERT(GetOpCodes(function)
+                       == (vector{ OpCode::LoadConst, OpCode::LoadConst, OpCode::Add, OpCode::StoreGlobal,
+                                   OpCode::Return }));
+                // The sum reuses the register of the lhs
+                ASSERT_EQUAL(function.code[2].a, 0U);
+                ASSERT_EQUAL(function.register_count, 2U);
+                ASSERT_EQUAL(function.names.size(), 1U);
+            }
+            {
+                // JumpIfTrue lhs, ToBool rhs, Jump, LoadConst True
+                ast::Or or_statement(make_unique<ast::VariableValue>("x"s), make_unique<ast::VariableValue>("y"s));
+                auto function = bytecode::Compile(or_statement);
+
+                ASSERT(GetOpCodes(function)
+                       == (vector{ OpCode::LoadGlobal, OpCode::JumpIfTrue, OpCode::LoadGlobal, OpCode::ToBool,
+                                   OpCode::Jump, OpCode::LoadConst, OpCode::Return }));
+                ASSERT_EQUAL(function.code[1].a, 5U);
+                ASSERT_EQUAL(function.code[4].a, 6U);
+            }
+
+            ast::Add incomplete(make_unique<ast::NumericConst>(1), nullptr);
+            ASSERT_THROWS(bytecode::Compile(incomplete), std::runtime_error);
+        }
+
+        void TestMethodRegisters() {
+            const string program = R"(
+class Fib:
+  def calc(n):
+    if n < 2:
+      return n
+    return self.calc(n - 1) + self.calc(n - 2)
+
+  def unbound(flag):
+    if flag:
+      x = 1
+    return x
+
+  def bound(flag):
+    if flag:
+      x = 1
+    else:
+      x = 2
+    return x
+)"s;
+
+            runtime::DummyContext context;
+            Closure closure;
+            auto tree = ParseProgramFromString(program);
+            bytecode::Module module(*tree);
+            Run(module, closure, context);
+
+            const auto& cls = *closure.at("Fib"s).TryAs<runtime::Class>();
+            const auto ops_of = [&](const string& name) {
+                return GetOpCodes(*module.GetMethodCode(*cls.GetMethod(name)));
+            };
+
+            // n lives in register 1: the condition compares it to the constant and jumps
+            const auto calc = ops_of("calc"s);
+            ASSERT(vector(calc.begin(), calc.begin() + 3)
+                   == (vector{ OpCode::LoadConst, OpCode::JumpIfNotCompare, OpCode::Return }));
+            ASSERT_EQUAL(module.GetMethodCode(*cls.GetMethod("calc"s))->code[2].a, 1U);
+            ASSERT(count(calc.begin(), calc.end(), OpCode::CheckBound) == 0);
+            ASSERT(count(calc.begin(), calc.end(), OpCode::CallMethod) == 2);
+
+            // Only a local that may be unassigned is checked when it is read
+            const auto unbound = ops_of("unbound"s);
+            ASSERT(count(unbound.begin(), unbound.end(), OpCode::CheckBound) == 1);
+            const auto bound = ops_of("bound"s);
+            ASSERT(count(bound.begin(), bound.end(), OpCode::CheckBound) == 0);
+        }
+
+        void TestNodes() {
+            runtime::DummyContext context;
+            Closure closure;
+
+            ast::Compound program;
+            program.AddStatement(make_unique<ast::Assignment>("x"s, make_unique<ast::NumericConst>(57)));
+            program.AddStatement(make_unique<ast::IfElse>(
+                make_unique<ast::Less>(make_unique<ast::VariableValue>("x"s), make_unique<ast::NumericConst>(100)),
+                make_unique<ast::Assignment>("y"s, make_unique<ast::StringConst>("small"s)), nullptr));
+            // The rhs would throw if it was evaluated
+            program.AddStatement(make_unique<ast::Assignment>(
+                "z"s, make_unique<ast::Or>(make_unique<ast::BoolConst>(true),
+                                           make_unique<ast::VariableValue>("unknown"s))));
+            program.AddStatement(make_unique<ast::Print>(make_unique<ast::Stringify>(
+                make_unique<ast::Mult>(make_unique<ast::VariableValue>("x"s), make_unique<ast::NumericConst>(2)))));
+
+            bytecode::Module module(program);
+            ASSERT(!Run(module, closure, context));
+
+            ASSERT_EQUAL(closure.at("x"s).TryAs<runtime::Number>()->GetValue(), 57);
+            ASSERT_EQUAL(closure.at("y"s).TryAs<runtime::String>()->GetValue(), "small"s);
+            ASSERT(closure.at("z"s).TryAs<runtime::Bool>()->GetValue());
+            ASSERT_EQUAL(context.output.str(), "114\n"s);
+
+            // A method built by hand has no frame slots and runs on the tree walker
+            vector<runtime::Method> methods;
+            methods.push_back({ "twice"s, { "x"s }, make_unique<ast::Add>(make_unique<ast::VariableValue>("x"s),
+                                                                          make_unique<ast::VariableValue>("x"s)) });
+            runtime::Class cls("C"s, std::move(methods), nullptr);
+
+            vector<unique_ptr<ast::Statement>> args;
+            args.push_back(make_unique<ast::NumericConst>(21));
+            ast::MethodCall call(make_unique<ast::NewInstance>(cls), "twice"s, std::move(args));
+
+            bytecode::Module call_module(call);
+            ASSERT_EQUAL(Run(call_module, closure, context).TryAs<runtime::Number>()->GetValue(), 42);
+        }
+
+        void TestCallSiteCache() {
+            const string program = R"(
+class A:
+  def get():
+    return 1
+
+class B:
+  def get():
+    return 2
+
+class Caller:
+  def call(o):
+    return o.get()
+
+c = Caller()
+print c.call(A()) + c.call(B()) + c.call(A())
+)"s;
+
+            runtime::DummyContext context;
+            Closure closure;
+            auto tree = ParseProgramFromString(program);
+            bytecode::Module module(*tree);
+            Run(module, closure, context);
+
+            ASSERT_EQUAL(context.output.str(), "4\n"s);
+
+            const auto* call = closure.at("Caller"s).TryAs<runtime::Class>()->GetMethod("call"s);
+            const bytecode::Function* code = module.GetMethodCode(*call);
+            ASSERT(code != nullptr);
+            ASSERT_EQUAL(code->call_sites.size(), 1U);
+            ASSERT_EQUAL(code->call_sites[0].cache_size, 2U);
+            ASSERT(!code->call_sites[0].megamorphic);
+        }
+
+        void TestErrors() {
+            const string program = R"(
+class Thrower:
+  def depth(n):
+    if n == 0:
+      return 1 / n
+    return 1 + self.depth(n - 1)
+
+t = Thrower()
+)"s;
+
+            runtime::DummyContext context;
+            Closure closure;
+            auto tree = ParseProgramFromString(program);
+            bytecode::Module module(*tree);
+            Run(module, closure, context);
+
+            // The frames and operands of the unwound calls are dropped, so the module
+            // can be run again
+            auto failing = ParseProgramFromString("print t.depth(10)\n"s);
+            bytecode::Module failing_module(*failing);
+            ASSERT_THROWS(Run(failing_module, closure, context), std::runtime_error);
+            ASSERT_THROWS(Run(failing_module, closure, context), std::runtime_error);
+
+            auto passing = ParseProgramFromString("x = 5\nprint x, t\n"s);
+            bytecode::Module passing_module(*passing);
+            Run(passing_module, closure, context);
+
+            auto not_instance = ParseProgramFromString("x = 5\nx.y = 1\n"s);
+            bytecode::Module not_instance_module(*not_instance);
+            ASSERT_THROWS(Run(not_instance_module, closure, context), std::runtime_error);
+
+            auto no_method = ParseProgramFromString("t.missing(1)\n"s);
+            bytecode::Module no_method_module(*no_method);
+            ASSERT_THROWS(Run(no_method_module, closure, context), std::runtime_error);
+
+            // The rhs of or runs only sometimes, so it doesn't assign y for the return
+            const string conditional = R"(
+class Picker:
+  def pick(c):
+    if c:
+      z = 0
+    else:
+      y = 1
+    z = c or y
+    return y
+
+p = Picker()
+print p.pick(True)
+)"s;
+            const auto error_of = [](const auto& run) {
+                try {
+                    run();
+                } catch (const std::runtime_error& e) {
+                    return string(e.what());
+                }
+                return "no error"s;
+            };
+            const string tree_error = error_of([&conditional] {
+                runtime::DummyContext tree_context;
+                Closure tree_closure;
+                ParseProgramFromString(conditional)->Execute(tree_closure, tree_context);
+            });
+            const string vm_error = error_of([&conditional] {
+                runtime::DummyContext vm_context;
+                Closure vm_closure;
+                auto conditional_tree = ParseProgramFromString(conditional);
+                bytecode::Module conditional_module(*conditional_tree);
+                Run(conditional_module, vm_closure, vm_context);
+            });
+            ASSERT_EQUAL(vm_error, tree_error);
+            ASSERT_EQUAL(tree_error, "var is not found"s);
+        }
+    } // namespace
+
+    void RunVmTests(TestRunner& tr) {
+        RUN_TEST(tr, vm::TestCompiledCode);
+        RUN_TEST(tr, vm::TestMethodRegisters);
+        RUN_TEST(tr, vm::TestNodes);
+        RUN_TEST(tr, vm::TestCallSiteCache);
+        RUN_TEST(tr, vm::TestErrors);
+    }
+
+} // namespace vm